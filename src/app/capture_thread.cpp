@@ -21,8 +21,6 @@
 
 #include "capture_thread.h"
 #include <capture_splitter.h>
-#include <iostream>
-#include <iomanip>
 
 CaptureThread::CaptureThread(int cam_id)
 {
@@ -35,8 +33,14 @@ CaptureThread::CaptureThread(int cam_id)
   control->addChild( (VarType*) (c_stop   = new VarTrigger("stop capture","Stop")));
   control->addChild( (VarType*) (c_reset  = new VarTrigger("reset bus","Reset")));
   control->addChild( (VarType*) (c_auto_refresh= new VarBool("auto refresh params",true)));
-  // timings should only be printed on demand for a short period of time by temporally activating this flag
+  // prints the latency percentiles once per second while enabled
   control->addChild( (VarType*) (c_print_timings = new VarBool("print timings",false)));
+  // appends the latency percentiles of capture and processing to this file once per second:
+  // JSON lines if it ends in .json, CSV otherwise. Empty to disable.
+  control->addChild( (VarType*) (c_timing_export = new VarString("timing export file","")));
+  // process the capture buffers in place where possible; the input image of a frame
+  // is then only available to the processing plugins, not for display afterwards
+  control->addChild( (VarType*) (c_zero_copy = new VarBool("zero-copy capture",false)));
   control->addChild( (VarType*) (c_refresh= new VarTrigger("re-read params","Refresh")));
   control->addChild( (VarType*) (captureModule= new VarStringEnum("Capture Module","None")));
   captureModule->addFlags(VARTYPE_FLAG_NOLOAD_ENUM_CHILDREN);
@@ -45,6 +49,12 @@ CaptureThread::CaptureThread(int cam_id)
   captureModule->addItem("Generator");
   settings->addChild( (VarType*) (fromfile = new VarList("Read from files")));
   settings->addChild( (VarType*) (generator = new VarList("Generator")));
+  settings->addChild( (VarType*) (latency = new VarList("Latency")));
+  latency->addFlags( VARTYPE_FLAG_NOSTORE );
+  latency->addChild( (latency_get_frame = new LatencyStatistics("getFrame"))->getSettings());
+  latency->addChild( (latency_convert = new LatencyStatistics("copy&convert"))->getSettings());
+  latency->addChild( (latency_process = new LatencyStatistics("process"))->getSettings());
+  latency->addChild( (latency_total = new LatencyStatistics("total"))->getSettings());
   settings->addFlags( VARTYPE_FLAG_AUTO_EXPAND_TREE );
   c_stop->addFlags( VARTYPE_FLAG_READONLY );
   c_refresh->addFlags( VARTYPE_FLAG_READONLY );
@@ -139,6 +149,10 @@ CaptureThread::~CaptureThread()
   delete captureFiles;
   delete captureGenerator;
   delete counter;
+  delete latency_get_frame;
+  delete latency_convert;
+  delete latency_process;
+  delete latency_total;
 
 #ifdef DC1394
   delete captureDC1394;
@@ -293,6 +307,64 @@ void CaptureThread::refresh() {
 }
 
 
+void CaptureThread::updateTimingStatistics() {
+  vector<LatencyStatistics *> stats;
+  stats.push_back(latency_get_frame);
+  stats.push_back(latency_convert);
+  stats.push_back(latency_process);
+  stats.push_back(latency_total);
+  for (auto s : stats) s->update();
+  if (c_print_timings->getBool()) {
+    LatencyStatistics::print(stats);
+  }
+
+  if (stack!=0) {
+    stack->updateTimingStatistics();
+    vector<LatencyStatistics *> stack_stats = stack->getLatencyStatistics();
+    stats.insert(stats.end(), stack_stats.begin(), stack_stats.end());
+  }
+  string filename = c_timing_export->getString();
+  if (!filename.empty()) {
+    LatencyStatistics::exportTo(filename, "thread " + std::to_string(camId), GetTimeSec(), stats);
+  }
+}
+
+bool CaptureThread::captureFrame(CaptureInterface * capture, RawImage & pic_raw, FrameData * d, VisionStack * stack,
+                                 bool zero_copy) {
+  d->time=pic_raw.getTime();
+  //borrowing needs the capture buffer until the frame is complete, so not with a pipelined stack:
+  zero_copy = zero_copy && !(stack!=0 && stack->isPipelined());
+  return (zero_copy && capture->borrowFrame(pic_raw,d->video)) ||
+         capture->copyAndConvertFrame(pic_raw,d->video);
+}
+
+void CaptureThread::processFrame(VisionStack * stack, FrameBuffer * rb, int idx, const std::function<void()> & done) {
+  FrameData * d=rb->getPointer(idx);
+  if (stack!=0 && stack->isPipelined() && !d->video.isBorrowed()) {
+    //the last stage makes the frame readable once it is complete:
+    std::function<void()> complete = done;
+    stack->processPipelined(d, [rb, idx, complete](FrameData *) {
+      complete();
+      rb->publishWrite(idx);
+    });
+    //move past the reader's bin instead of staying on this one, which is
+    //still in the pipeline. The next bin may not be reused before it has
+    //left the pipeline either:
+    int next_idx = rb->advanceWrite(false);
+    if (stack->isInPipeline(rb->getPointer(next_idx))) stack->waitForPipeline();
+  } else {
+    if (stack!=0) {
+      stack->waitForPipeline();
+      stack->process(d);
+      stack->postProcess(d);
+    }
+    //a borrowed capture buffer goes back before the frame becomes readable:
+    d->video.releaseBorrowed();
+    done();
+    rb->nextWrite(true);
+  }
+}
+
 void CaptureThread::run() {
     CaptureStats * stats;
     bool changed;
@@ -305,16 +377,15 @@ void CaptureThread::run() {
       if (rb!=0) {
         int idx=rb->curWrite();
         FrameData * d=rb->getPointer(idx);
-        if ((stats=(CaptureStats *)d->map.get("capture_stats")) == 0) {
-          stats=(CaptureStats *)d->map.insert("capture_stats",new CaptureStats());
+        if ((stats=d->map.get(slot_capture_stats)) == 0) {
+          stats=d->map.insert(slot_capture_stats,new CaptureStats());
         }
         capture_mutex.lock();
         if ((capture != nullptr) && (capture->isCapturing())) {
           auto t_start = std::chrono::steady_clock::now();
           RawImage pic_raw=capture->getFrame();
           auto t_getFrame = std::chrono::steady_clock::now();
-          d->time=pic_raw.getTime();
-          bool bSuccess = capture->copyAndConvertFrame( pic_raw,d->video);
+          bool bSuccess = captureFrame(capture, pic_raw, d, stack, c_zero_copy->getBool());
           auto t_convert = std::chrono::steady_clock::now();
           capture_mutex.unlock();
 
@@ -324,30 +395,20 @@ void CaptureThread::run() {
               stats->fps_capture=counter->getFPS(changed);
 
               stack_mutex.lock();
-              if (stack!=0) {
-                stack->process(d);
-                stack->postProcess(d);
-              }
+              bool pipelined = stack!=0 && stack->isPipelined() && !d->video.isBorrowed();
+              LatencyStatistics * total = latency_total;
+              processFrame(stack, rb, idx, [pipelined, total, t_start]() {
+                if (pipelined) total->histogram.record(std::chrono::steady_clock::now() - t_start);
+              });
               stack_mutex.unlock();
-              rb->nextWrite(true);
 
             auto t_process = std::chrono::steady_clock::now();
 
-              if(c_print_timings->getBool())
-              {
-                auto getFrame_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_getFrame - t_start);
-                std::cout << std::setw(13) << std::left << "getFrame"
-                          << std::setw(5) << std::right << getFrame_duration.count() << " μs" << std::endl;
-                auto convert_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_convert - t_getFrame);
-                std::cout << std::setw(13) << std::left << "copy&convert"
-                          << std::setw(5) << std::right << convert_duration.count() << " μs" << std::endl;
-                auto process_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_process - t_convert);
-                std::cout << std::setw(13) << std::left << "process"
-                          << std::setw(5) << std::right << process_duration.count() << " μs" << std::endl;
-                auto total_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_process - t_start);
-                std::cout << std::setw(13) << std::left << "total"
-                          << std::setw(5) << std::right << total_duration.count() << " μs" << std::endl << std::endl;
-              }
+              latency_get_frame->histogram.record(t_getFrame - t_start);
+              latency_convert->histogram.record(t_convert - t_getFrame);
+              //with a pipelined stack, this only covers the first stage:
+              latency_process->histogram.record(t_process - t_convert);
+              if (!pipelined) latency_total->histogram.record(t_process - t_start);
 
               if (changed) {
                 if (c_auto_refresh->getBool()==true) {
@@ -356,7 +417,7 @@ void CaptureThread::run() {
                   capture_mutex.unlock();
                 }
                 stack_mutex.lock();
-                stack->updateTimingStatistics();
+                updateTimingStatistics();
                 stack_mutex.unlock();
               }
           }
@@ -374,6 +435,9 @@ void CaptureThread::run() {
           usleep(5000);
         }
         if (_kill) {
+          stack_mutex.lock();
+          if (stack!=0) stack->waitForPipeline();
+          stack_mutex.unlock();
           capture_mutex.lock();
           if(capture != nullptr) {
             capture->stopCapture();
@@ -33,6 +33,7 @@
 #include "visionstack.h"
 #include "capturestats.h"
 #include "affinity_manager.h"
+#include "latency_histogram.h"
 
 #ifdef MVIMPACT2
 #include "capture_bluefox2.h"
@@ -63,6 +64,7 @@ class CaptureThread : public QThread
 {
 Q_OBJECT
 protected:
+  FrameDataSlot<CaptureStats> slot_capture_stats{"capture_stats"};
   QMutex stack_mutex; //this mutex protects multi-threaded operations on the stack
   QMutex capture_mutex; //this mutex protects multi-threaded operations on the capture control
   VisionStack * stack;
@@ -100,7 +102,16 @@ protected:
   VarTrigger * c_refresh;
   VarBool * c_auto_refresh;
   VarBool * c_print_timings;
+  VarBool * c_zero_copy;
+  VarString * c_timing_export;
   VarStringEnum * captureModule;
+  VarList * latency;
+  LatencyStatistics * latency_get_frame;
+  LatencyStatistics * latency_convert;
+  LatencyStatistics * latency_process;
+  LatencyStatistics * latency_total;
+
+  void updateTimingStatistics();
 
 public slots:
   bool init();
@@ -118,9 +129,20 @@ public:
   VarList * getSettings();
   void setAffinityManager(AffinityManager * _affinity);
   CaptureInterface* getCaptureSplitter() {return captureSplitter;};
+  /// the currently selected capture module, only to be used while this thread is not running
+  CaptureInterface* getCapture() {return capture;};
   CaptureThread(int cam_id);
   ~CaptureThread();
 
+  /// fills \p d with the captured \p pic_raw. With \p zero_copy, the capture
+  /// buffer is borrowed instead of copied, unless \p stack is pipelined
+  static bool captureFrame(CaptureInterface * capture, RawImage & pic_raw, FrameData * d, VisionStack * stack,
+                           bool zero_copy);
+  /// runs \p stack on the frame in bin \p idx of \p rb and moves on to the next bin.
+  /// The frame becomes readable once it is complete, \p done is called right before.
+  /// With a pipelined stack, that is only after this returns.
+  static void processFrame(VisionStack * stack, FrameBuffer * rb, int idx, const std::function<void()> & done);
+
   virtual void run();
 
 };
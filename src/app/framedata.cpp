@@ -20,6 +20,40 @@
 //========================================================================
 
 #include "framedata.h"
+#include <mutex>
+
+static std::mutex & slotRegistryMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+static map<string,int> & slotRegistry() {
+  static map<string,int> registry;
+  return registry;
+}
+
+int FrameDataSlotRegistry::resolve(const string & label) {
+  std::lock_guard<std::mutex> lock(slotRegistryMutex());
+  map<string,int> & registry = slotRegistry();
+  map<string,int>::const_iterator iter = registry.find(label);
+  if (iter != registry.end()) return iter->second;
+  int id = registry.size();
+  registry[label] = id;
+  return id;
+}
+
+int FrameDataSlotRegistry::find(const string & label) {
+  std::lock_guard<std::mutex> lock(slotRegistryMutex());
+  map<string,int> & registry = slotRegistry();
+  map<string,int>::const_iterator iter = registry.find(label);
+  if (iter == registry.end()) return -1;
+  return iter->second;
+}
+
+int FrameDataSlotRegistry::size() {
+  std::lock_guard<std::mutex> lock(slotRegistryMutex());
+  return slotRegistry().size();
+}
 
 FrameData::FrameData()
 {
@@ -22,11 +22,49 @@
 
 #ifndef FRAMEDATA_H
 #define FRAMEDATA_H
-#include "ringbuffer.h"
+#include "lockfree_ringbuffer.h"
 #include "rawimage.h"
+#include <algorithm>
 #include <map>
+#include <vector>
 using namespace std;
 
+/*!
+  \class   FrameDataSlotRegistry
+  \brief   Assigns integer handles to the labels of FrameDataMap entries
+
+  This is only used when slots are created (e.g. while the stacks are
+  constructed), never while processing a frame.
+*/
+class FrameDataSlotRegistry
+{
+public:
+  /// returns the handle of \p label, creating a new one if needed
+  static int resolve(const string & label);
+  /// returns the handle of \p label, or -1 if it is unknown
+  static int find(const string & label);
+  /// the number of handles so far
+  static int size();
+};
+
+/*!
+  \class   FrameDataSlot
+  \brief   A typed handle to an entry of FrameDataMap
+
+  Resolve it once, e.g. as a member of a plugin, and use it with the
+  FrameDataMap accessors for O(1) lookups without any string handling.
+  Slots and string labels refer to the same entries.
+*/
+template <class T>
+class FrameDataSlot
+{
+protected:
+  int id;
+public:
+  explicit FrameDataSlot(const string & label) : id(FrameDataSlotRegistry::resolve(label)) {}
+  int getId() const { return id; }
+};
+
 /*!
   \class   FrameDataMap
   \brief   A general storage map, for plugins to store and read their data
@@ -35,23 +73,64 @@ using namespace std;
   This class acts as a storage map of string and data-pointer pairs.
   This allows any plugin to make its results publicly available to the
   entire image stack pipeline for the current frame.
+
+  The entries are stored in a table indexed by FrameDataSlot handles.
+  The string based accessors look the label up in the slot registry first,
+  so they are slower and should be avoided in per-frame code.
 */
-class FrameDataMap : protected map<string,void *>
+class FrameDataMap
 {
+protected:
+  vector<void *> items;
+  void * getItem(int id) const {
+    if (id < 0 || id >= (int)items.size()) return 0;
+    return items[id];
+  }
+  void * insertItem(int id, void * item) {
+    if (id >= (int)items.size()) items.resize(id + 1, 0);
+    if (items[id] == 0) items[id] = item;
+    return items[id];
+  }
+  void * updateItem(int id, void * item) {
+    if (id >= (int)items.size()) items.resize(id + 1, 0);
+    items[id] = item;
+    return item;
+  }
 public:
+  /// the table is allocated up front, so it doesn't move while other threads
+  /// (e.g. the GUI) read from it
+  static const int MIN_SLOTS = 32;
+  FrameDataMap() : items(std::max(FrameDataSlotRegistry::size(), (int)MIN_SLOTS), (void *)0) {}
+
+  /// grows the table to hold all slots registered so far. Afterwards, entries
+  /// of different slots can be inserted from different threads at the same time.
+  void reserve() {
+    int n = FrameDataSlotRegistry::size();
+    if (n > (int)items.size()) items.resize(n, 0);
+  }
+
+  //string-labeled access:
   void * get(const string & label) const {
-    map<string,void *>::const_iterator iter = map<string,void *>::find(label);
-    if (iter==map<string,void *>::end()) return 0;
-    return iter->second;
+    return getItem(FrameDataSlotRegistry::find(label));
   }
+  /// stores \p item, unless there already is an entry, which is returned instead
   void * insert(const string & label, void * item) {
-    pair< map<string,void *>::iterator, bool > pair = map<string,void *>::insert ( make_pair(label,item) );
-    if (pair.first==map<string,void *>::end()) return 0;
-    return pair.first->second;
+    return insertItem(FrameDataSlotRegistry::resolve(label), item);
   }
+  /// replaces the entry (without deleting the old one)
   void * update(const string & label, void * item) {
-    erase(label);
-    return insert(label, item);
+    return updateItem(FrameDataSlotRegistry::resolve(label), item);
+  }
+
+  //slot access:
+  template <class T> T * get(const FrameDataSlot<T> & slot) const {
+    return (T *)getItem(slot.getId());
+  }
+  template <class T> T * insert(const FrameDataSlot<T> & slot, T * item) {
+    return (T *)insertItem(slot.getId(), item);
+  }
+  template <class T> T * update(const FrameDataSlot<T> & slot, T * item) {
+    return (T *)updateItem(slot.getId(), item);
   }
 };
 
@@ -83,7 +162,10 @@ public:
   \class   FrameBuffer
   \brief   A RingBuffer consisting of items of type FrameData
   \author  Stefan Zickler, (C) 2008
+
+  The GUI polls it constantly, so it uses the lock-free variant to avoid
+  contention with the capture thread.
 */
-typedef RingBuffer<FrameData> FrameBuffer;
+typedef LockFreeRingBuffer<FrameData> FrameBuffer;
 
 #endif
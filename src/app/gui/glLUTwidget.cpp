@@ -306,6 +306,8 @@ void GLLUTWidget::drawEvent ( QMouseEvent * event )
     //update texture
     slices[state.slice_idx]->selection_update_pending=true;
     _lut->unlock();
+    //show the stroke to the vision thread right away, the derived LUTs follow on release:
+    _lut->publish();
 
     this->redraw();
   }
@@ -251,7 +251,7 @@ void GLWidget::myGLdraw() {
         rb->lockRead();
         int idx=rb->curRead();
         FrameData * frame = rb->getPointer ( idx );
-        VisualizationFrame * vis_frame=(VisualizationFrame *)(frame->map.get("vis_frame"));
+        VisualizationFrame * vis_frame=frame->map.get(slot_vis_frame);
         if (vis_frame!=0 && vis_frame->valid==true && vis_frame->data.getData() != 0 && vis_frame->data.getWidth() >= 1 && vis_frame->data.getHeight() >=1 ) {
           rgbImage & img = vis_frame->data;
           if ( img.getWidth() > 1 && img.getHeight() > 1 ) {
@@ -382,7 +382,7 @@ void GLWidget::saveImage() {
     int idx=rb->curRead();
     FrameData * frame = rb->getPointer ( idx );
 
-    VisualizationFrame * vis_frame=(VisualizationFrame *)(frame->map.get("vis_frame"));
+    VisualizationFrame * vis_frame=frame->map.get(slot_vis_frame);
     if (vis_frame !=0 && vis_frame->valid) {
       temp.copy ( vis_frame->data );
       rb->unlockRead();
@@ -52,6 +52,8 @@ class GLWidget : public QGLWidget, public RealTimeDisplayWidget
   Q_OBJECT
 
 protected:
+  FrameDataSlot<CaptureStats> slot_capture_stats{"capture_stats"};
+  FrameDataSlot<VisualizationFrame> slot_vis_frame{"vis_frame"};
   bool ALLOW_QPAINTER;
   int vpW;
   int vpH;
@@ -77,7 +79,7 @@ protected:
   void mouseMoveEvent ( QMouseEvent * event );
   void paintEvent(QPaintEvent * e);
 
-  RingBuffer<FrameData> * rb_bb;
+  FrameBuffer * rb_bb;
 
 public:
   virtual QSize sizeHint() const {
@@ -86,7 +88,7 @@ public:
     size.setWidth(600);
     return size;
   }
-  virtual void setRingBufferBB(RingBuffer<FrameData> * rb)
+  virtual void setRingBufferBB(FrameBuffer * rb)
   {
     rb_bb=rb;
   }
@@ -147,7 +149,7 @@ public:
       last_frame=rb->getPointer(cur)->number;
 
       FrameData * frame = rb->getPointer(cur);
-      CaptureStats * cstats = (CaptureStats *)frame->map.get("capture_stats");
+      CaptureStats * cstats = frame->map.get(slot_capture_stats);
       if (cstats != 0) {
         stats.capture_stats=(*cstats);
       }
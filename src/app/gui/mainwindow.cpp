@@ -20,12 +20,18 @@
 //========================================================================
 
 #include "mainwindow.h"
+#include <algorithm>
 
 MainWindow::MainWindow(bool start_capture, bool enforce_affinity, int num_cameras)
 {
 
   affinity=0;
   if (enforce_affinity) affinity=new AffinityManager();
+  //the shared worker pool gets the cores left after the capture threads and the gui thread,
+  //so that no pinned worker wraps around onto one of their cores:
+  int reserved_cores = num_cameras + 1;
+  int num_workers = std::max((int)std::thread::hardware_concurrency() - reserved_cores, 0);
+  ThreadPool::configureGlobal(num_workers, affinity, reserved_cores);
   //opt=new GetOpt();
   settings=0;
   setupUi((QMainWindow *)this);
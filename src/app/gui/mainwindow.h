@@ -23,6 +23,7 @@
 #define MAINWINDOW_H
 
 #include "affinity_manager.h"
+#include "thread_pool.h"
 #include <QtGui>
 #include <qmainwindow.h>
 #include "ui_mainwindow.h"
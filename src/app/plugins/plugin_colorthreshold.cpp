@@ -19,108 +19,129 @@
 */
 //========================================================================
 #include "plugin_colorthreshold.h"
-
-static void thresholdImage(RawImage *imagePartIn, Image<raw8> *imagePartOut, YUVLUT * lut, const ImageInterface* mask = nullptr) {
-  if (imagePartIn->getColorFormat() == COLOR_YUV422_UYVY) {
-    CMVisionThreshold::thresholdImageYUV422_UYVY(imagePartOut, imagePartIn, lut, mask);
-  } else if (imagePartIn->getColorFormat() == COLOR_YUV444) {
-    CMVisionThreshold::thresholdImageYUV444(imagePartOut, imagePartIn, lut, mask);
-  } else if (imagePartIn->getColorFormat() == COLOR_RGB8) {
-    auto *rgblut = (RGBLUT *) lut->getDerivedLUT(CSPACE_RGB);
-    if (rgblut == nullptr) {
-      printf("WARNING: No RGB LUT has been defined. You need to create a derived RGB LUT by calling e.g. \"lut_yuv->addDerivedLUT(new RGBLUT(5,5,5,\"\"))\" in the stack constructor!\n");
-    } else {
-      CMVisionThreshold::thresholdImageRGB(imagePartOut, imagePartIn, rgblut, mask);
-    }
-  } else {
-    fprintf(stderr, "ColorThresholding needs YUV422, YUV444, or RGB8 as input image, but found: %s\n",
-            Colors::colorFormatToString(imagePartIn->getColorFormat()).c_str());
-  }
+#include <algorithm>
+#include <sstream>
+
+static void thresholdStripe(int id, int totalThreads, const RawImage *imageIn, const RowSpans *spans,
+                            Image<raw8> *imageOut, YUVLUT * lut, const LUTTable * table) {
+  //split along full rows:
+  int height = imageIn->getHeight();
+  int rowBegin = id * height / totalThreads;
+  int rowEnd = (id + 1) * height / totalThreads;
+  if (rowEnd <= rowBegin) return;
+
+  CMVisionThreshold::thresholdRows(imageOut, imageIn, lut, spans, rowBegin, rowEnd, table);
 }
 
-PluginColorThresholdWorker::PluginColorThresholdWorker(int _id, int _totalThreads, YUVLUT * _lut) : QObject() {
-
-  this->id = _id;
-  this->totalThreads = _totalThreads;
-  this->lut = _lut;
-
-  thread = new QThread();
-  thread->setObjectName("ColorThreshold");
-  moveToThread(thread);
-  connect(this, SIGNAL(startThresholding()), this, SLOT(process()));
-  thread->start();
-}
-
-PluginColorThresholdWorker::~PluginColorThresholdWorker() {
-  thread->quit();
-  thread->deleteLater();
-}
 
+PluginColorThreshold::PluginColorThreshold(FrameBuffer * _buffer, YUVLUT * _lut, ConvexHullImageMask &mask, VarInt * max_runs)
+  : VisionPlugin(_buffer), _image_mask(mask),
+    pyramid_params([this](PyramidParameters & p) { readPyramidParameters(p); }),
+    bayer_pattern([this](BayerLUT::Pattern & p) { applyBayerPattern(p); })
+{
+  lut=_lut;
+  maxRuns=max_runs;
 
-void PluginColorThresholdWorker::process() {
-  RawImage imagePartIn;
-  imagePartIn.setColorFormat(imageIn->getColorFormat());
-  imagePartIn.setHeight(imageIn->getHeight()/totalThreads);
-  imagePartIn.setWidth(imageIn->getWidth());
-  int offsetBytesIn = id * imageIn->getNumBytes() / totalThreads;
-  imagePartIn.setData(imageIn->getData() + offsetBytesIn);
-
-  RawImage maskImagePartIn;
-  maskImagePartIn.setColorFormat(maskImageIn->getColorFormat());
-  maskImagePartIn.setHeight(maskImageIn->getHeight()/totalThreads);
-  maskImagePartIn.setWidth(maskImageIn->getWidth());
-  int maskOffsetBytesIn = id * maskImageIn->getNumBytes() /  totalThreads;
-  maskImagePartIn.setData(maskImageIn->getData() + maskOffsetBytesIn);
-
-  RawImage rawImageOut;
-  rawImageOut.setColorFormat(imageOut->getColorFormat());
-  rawImageOut.setHeight(imageOut->getHeight()/totalThreads);
-  rawImageOut.setWidth(imageOut->getWidth());
-  int offsetBytesOut = id * imageOut->getNumBytes() / totalThreads;
-  rawImageOut.setData(imageOut->getData() + offsetBytesOut);
-  Image<raw8> imagePartOut;
-  imagePartOut.fromRawImage(rawImageOut);
-  
-  thresholdImage(&imagePartIn, &imagePartOut, lut, &maskImagePartIn);
-
-  doneMutex.unlock();
+  settings=new VarList("Color Threshold");
+  numThreads = new VarInt("number of threads", 0, 0, 32);
+  settings->addChild(numThreads);
+  // encode runs directly while thresholding; the label image is then only decoded on demand
+  fuseRunlengthEncoding = new VarBool("fused run length encoding", false);
+  settings->addChild(fuseRunlengthEncoding);
+  // RAW8 frames are thresholded without demosaicing, this is the color layout of the sensor's top-left 2x2 quad
+  bayerPattern = new VarStringEnum("Bayer pattern", "RGGB");
+  bayerPattern->addItem("RGGB"); //in the order of BayerLUT::Pattern
+  bayerPattern->addItem("GRBG");
+  bayerPattern->addItem("GBRG");
+  bayerPattern->addItem("BGGR");
+  settings->addChild(bayerPattern);
+  bayer_pattern.addItem(bayerPattern);
+  bayer_pattern.get();
+
+  // coarse-to-fine search: threshold at full resolution only around the candidates found at 1/factor
+  pyramid = new VarList("Coarse-to-fine search");
+  settings->addChild(pyramid);
+  pyramid->addChild(pyramidFactor = new VarInt("pyramid decimation", 1, 1, 8));
+  pyramid->addChild(pyramidMargin = new VarInt("window margin (px)", 8, 0, 200));
+  pyramid->addChild(pyramidColors = new VarString("candidate colors", "Orange,Yellow,Blue,Pink,Green"));
+  pyramid_params.addRecursive(pyramid);
+
+  coarse_runs = new CMVision::RunList(50000);
+  coarse_regions = new CMVision::RegionList(10000);
+
+  declareReadsVideo();
+  declareReads(slot_roi);
+  declareWrites(slot_threshold);
+  declareWrites(slot_label_image);
+  declareWrites(slot_runlist);
 }
 
-
-void PluginColorThresholdWorker::start() {
-  doneMutex.lock();
-  emit startThresholding();
+void PluginColorThreshold::readPyramidParameters(PyramidParameters & p) {
+  p.factor = pyramidFactor->getInt();
+  p.margin = pyramidMargin->getInt();
+  p.candidate_colors.assign(256, false);
+  std::istringstream names(pyramidColors->getString());
+  std::string name;
+  while (std::getline(names, name, ',')) {
+    name.erase(0, name.find_first_not_of(" \t"));
+    name.erase(name.find_last_not_of(" \t") + 1);
+    if (name.empty()) continue;
+    int id = lut->getChannelID(name);
+    if (id < 0 || id > 255) {
+      printf("WARNING: coarse-to-fine search: color label '%s' is not defined in the LUT\n", name.c_str());
+    } else {
+      p.candidate_colors[id] = true;
+    }
+  }
 }
 
-
-void PluginColorThresholdWorker::wait() {
-  doneMutex.lock();
-  doneMutex.unlock();
+void PluginColorThreshold::applyBayerPattern(BayerLUT::Pattern & p) {
+  p = (BayerLUT::Pattern)std::max(bayerPattern->getIndex(), 0);
+  BayerLUT * bayer_lut = (BayerLUT *)lut->getDerivedLUT(CSPACE_BAYER);
+  if (bayer_lut != nullptr) bayer_lut->setPattern(p);
 }
 
+bool PluginColorThreshold::findCandidateWindows(const RawImage * image, const RowSpans * spans, const PyramidParameters & p,
+                                                const LUTTable * table) {
+  if (!CMVisionThreshold::thresholdDecimated(&coarse_image, image, lut, p.factor, spans, table)) return false;
+  CMVision::RegionProcessing::encodeRuns(&coarse_image, coarse_runs);
+  //candidates that don't fit into the lists would be lost, so the full image is thresholded instead:
+  if (coarse_runs->getUsedRuns() == coarse_runs->getMaxRuns()) {
+    printf("Warning: coarse-to-fine search exceeded current max run size of %d, thresholding the full image\n",
+           coarse_runs->getMaxRuns());
+    return false;
+  }
+  CMVision::RegionProcessing::connectComponents(coarse_runs);
+  CMVision::RegionProcessing::extractRegions(coarse_regions, coarse_runs);
+  if (coarse_regions->getUsedRegions() == coarse_regions->getMaxRegions()) {
+    printf("Warning: coarse-to-fine search exceeded maximum number of %d regions, thresholding the full image\n",
+           coarse_regions->getMaxRegions());
+    return false;
+  }
 
-PluginColorThreshold::PluginColorThreshold(FrameBuffer * _buffer, YUVLUT * _lut, ConvexHullImageMask &mask)
-  : VisionPlugin(_buffer), _image_mask(mask)
-{
-  lut=_lut;
-
-  settings=new VarList("Color Threshold");
-  numThreads = new VarInt("number of threads", 0, 0, 32);
-  settings->addChild(numThreads);
+  //a coarse region spans the full resolution pixels between the samples next to it:
+  windows.clear();
+  const CMVision::Region * regions = coarse_regions->getRegionArrayPointer();
+  for (int i = 0; i < coarse_regions->getUsedRegions(); i++) {
+    const CMVision::Region & r = regions[i];
+    if (!p.candidate_colors[r.color.v]) continue;
+    RowSpans::Window w;
+    w.x0 = (r.x1 - 1) * p.factor + 1 - p.margin;
+    w.y0 = (r.y1 - 1) * p.factor + 1 - p.margin;
+    w.x1 = (r.x2 + 1) * p.factor + p.margin;
+    w.y1 = (r.y2 + 1) * p.factor + p.margin;
+    windows.push_back(w);
+  }
+  pyramid_spans.setWindows(windows, image->getWidth(), image->getHeight(), spans);
+  return true;
 }
 
 
 PluginColorThreshold::~PluginColorThreshold()
 {
-  clearWorkers();
   delete settings;
-}
-
-void PluginColorThreshold::clearWorkers() {
-  for (auto worker : workers) {
-    worker->deleteLater();
-  }
-  workers.clear();
+  delete coarse_runs;
+  delete coarse_regions;
 }
 
 
@@ -130,35 +151,59 @@ ProcessResult PluginColorThreshold::process(FrameData * data, RenderOptions * op
 
   Image<raw8> * img_thresholded;
 
-  if ((img_thresholded=(Image<raw8> *)data->map.get("cmv_threshold")) == nullptr) {
-    img_thresholded=(Image<raw8> *)data->map.insert("cmv_threshold",new Image<raw8>());
+  if ((img_thresholded=data->map.get(slot_threshold)) == nullptr) {
+    img_thresholded=data->map.insert(slot_threshold,new Image<raw8>());
   }
 
   //make sure image is allocated:
   img_thresholded->allocate(data->video.getWidth(),data->video.getHeight());
 
-  if(workers.size() != numThreads->getInt()) {
-    clearWorkers();
-    for(int i=0;i<numThreads->getInt();i++) {
-      auto *worker = new PluginColorThresholdWorker(i, numThreads->getInt(), lut);
-      workers.push_back(worker);
-    }
+  CMVision::LabelImage * labels;
+  if ((labels=data->map.get(slot_label_image)) == nullptr) {
+    labels=data->map.insert(slot_label_image,new CMVision::LabelImage());
   }
 
-  if(workers.empty()) {
-    thresholdImage(&data->video, img_thresholded, lut, &_image_mask.getMask());
-  } else {
-    for (auto worker : workers) {
-      worker->imageIn = &data->video;
-      worker->maskImageIn = &_image_mask.getMask();
-      worker->imageOut = img_thresholded;
-      worker->start();
-    }
+  //only the pixels inside of the mask (or the region of interest) are thresholded, all others are cleared:
+  const RowSpans * spans = nullptr;
+  if (_image_mask.getWidth() == data->video.getWidth() && _image_mask.getRowSpans().getHeight() == data->video.getHeight()) {
+    spans = &_image_mask.getRowSpans();
+  }
+  RegionOfInterest * roi = data->map.get(slot_roi);
+  if (roi != nullptr && !roi->full_frame) {
+    spans = &roi->spans;
+  }
+
+  //all passes over this frame use the same version of the LUT, even if the calibration is edited meanwhile:
+  std::shared_ptr<const LUTTable> table = CMVisionThreshold::pinLUT(lut, data->video.getColorFormat());
 
-    for (auto worker : workers) {
-      worker->wait();
+  std::shared_ptr<const PyramidParameters> pyramid_settings = pyramid_params.get();
+  if (pyramid_settings->factor > 1 && findCandidateWindows(&data->video, spans, *pyramid_settings, table.get())) {
+    spans = &pyramid_spans;
+  }
+
+  if (fuseRunlengthEncoding->getBool()) {
+    //sized like the run length encoder's own list, which it would replace otherwise:
+    CMVision::RunList * runlist = data->map.get(slot_runlist);
+    if (runlist == nullptr || runlist->getMaxRuns() != maxRuns->get()) {
+      delete runlist;
+      runlist = data->map.update(slot_runlist, new CMVision::RunList(maxRuns->getInt()));
+    }
+    if (CMVision::RegionProcessing::thresholdAndEncodeRuns(&data->video, lut, spans, runlist, fused_row, table.get())) {
+      labels->setRuns(img_thresholded, runlist);
+      _image_mask.unlock();
+      return ProcessingOk;
     }
   }
+  labels->setImage(img_thresholded);
+
+  int totalThreads = numThreads->getInt();
+  if(totalThreads <= 0) {
+    CMVisionThreshold::thresholdImage(img_thresholded, &data->video, lut, spans, table.get());
+  } else {
+    ThreadPool::global().parallelFor(totalThreads, [&](int id) {
+      thresholdStripe(id, totalThreads, &data->video, spans, img_thresholded, lut, table.get());
+    });
+  }
 
   _image_mask.unlock();
   return ProcessingOk;
@@ -24,48 +24,63 @@
 #include <visionplugin.h>
 #include "lut3d.h"
 #include "cmvision_threshold.h"
-#include <mutex>
-#include <QThread>
-#include <QObject>
+#include "cmvision_region.h"
 #include "convex_hull_image_mask.h"
+#include "plugin_region_of_interest.h"
+#include "thread_pool.h"
+#include "VarSnapshot.h"
+#include <vector>
 
-class PluginColorThresholdWorker : public QObject {
-Q_OBJECT
-public:
-    PluginColorThresholdWorker(int id, int totalThreads, YUVLUT * lut);
-    ~PluginColorThresholdWorker() override;
-    QThread* thread;
-    int id;
-    int totalThreads;
-    RawImage* imageIn = nullptr;
-    const ImageInterface* maskImageIn = nullptr;
-    Image<raw8>* imageOut = nullptr;
-    YUVLUT * lut;
-    std::mutex doneMutex;
-
-    void start();
-    void wait();
-
-public slots:
-    void process();
-
-signals:
-    void startThresholding();
-
+/// the settings of the coarse-to-fine search, see PluginColorThreshold
+struct PyramidParameters {
+  int factor;
+  int margin;
+  std::vector<bool> candidate_colors; //indexed by label
 };
 
 /**
 	@author Stefan Zickler
+
+  If the pyramid decimation is larger than 1, the image is first thresholded
+  at a reduced resolution and all regions of the candidate colors (i.e. the
+  balls and markers) are found there. Only windows around these are then
+  thresholded at full resolution, so the areas and centroids of the blobs
+  remain exact. Blobs that are smaller than the decimation can be missed.
 */
 class PluginColorThreshold : public VisionPlugin
 {
 protected:
+  FrameDataSlot<Image<raw8> > slot_threshold{"cmv_threshold"};
+  FrameDataSlot<CMVision::LabelImage> slot_label_image{"cmv_label_image"};
+  FrameDataSlot<CMVision::RunList> slot_runlist{"cmv_runlist"};
+  FrameDataSlot<RegionOfInterest> slot_roi{"region_of_interest"};
   YUVLUT * lut;
   ConvexHullImageMask& _image_mask;
   VarList * settings;
   VarInt * numThreads;
+  VarBool * fuseRunlengthEncoding;
+  VarInt * maxRuns; //owned by PluginRunlengthEncode
+  std::vector<raw8> fused_row;
+  VarStringEnum * bayerPattern;
+  VarList * pyramid;
+  VarInt * pyramidFactor;
+  VarInt * pyramidMargin;
+  VarString * pyramidColors;
+
+  VarSnapshot<PyramidParameters> pyramid_params;
+  void readPyramidParameters(PyramidParameters & p);
+  //applied to the derived Bayer LUT when the setting changes, not per frame:
+  VarSnapshot<BayerLUT::Pattern> bayer_pattern;
+  void applyBayerPattern(BayerLUT::Pattern & p);
+  Image<raw8> coarse_image;
+  CMVision::RunList * coarse_runs;
+  CMVision::RegionList * coarse_regions;
+  std::vector<RowSpans::Window> windows;
+  RowSpans pyramid_spans;
+  bool findCandidateWindows(const RawImage * image, const RowSpans * spans, const PyramidParameters & p,
+                            const LUTTable * table);
 public:
-  PluginColorThreshold(FrameBuffer * _buffer, YUVLUT * _lut, ConvexHullImageMask& mask);
+  PluginColorThreshold(FrameBuffer * _buffer, YUVLUT * _lut, ConvexHullImageMask& mask, VarInt * max_runs);
 
     ~PluginColorThreshold() override;
 
@@ -74,10 +89,6 @@ public:
     VarList * getSettings() override;
 
     string getName() override;
-private:
-    std::vector<PluginColorThresholdWorker*> workers;
-
-    void clearWorkers();
 };
 
 #endif
@@ -21,9 +21,12 @@
 #include <list>
 #include "plugin_detect_balls.h"
 
-PluginDetectBalls::PluginDetectBalls ( FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field,PluginDetectBallsSettings * settings )
-    : VisionPlugin ( _buffer ), camera_parameters ( camera_params ), field ( field ) {
+PluginDetectBalls::PluginDetectBalls ( FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field,PluginDetectBallsSettings * settings, CMVision::IntegralHistogram * _label_integral )
+    : VisionPlugin ( _buffer ),
+      params ( [this] ( BallDetectionParameters & p ) { readParameters ( p ); } ),
+      camera_parameters ( camera_params ), field ( field ) {
   _lut=lut;
+  label_integral=_label_integral;
 
   _settings=settings;
   _have_local_settings=false;
@@ -32,8 +35,8 @@ PluginDetectBalls::PluginDetectBalls ( FrameBuffer * _buffer, LUT3D * lut, const
     _have_local_settings=true;
   }
 
-  vnotify.addRecursive(_settings->getSettings());
-  vnotify.addRecursive(field.getSettings());
+  params.addRecursive(_settings->getSettings());
+  params.addRecursive(field.getSettings());
 
 
   //read-out important LUT data:
@@ -47,9 +50,12 @@ PluginDetectBalls::PluginDetectBalls ( FrameBuffer * _buffer, LUT3D * lut, const
   color_id_field = _lut->getChannelID ( "Field Green" );
   if ( color_id_field == -1 ) printf ( "WARNING color label 'Field Green' not defined in LUT!!!\n" );
 
-
-
-
+  //the label image is decoded on first access, so reading it modifies it
+  declareReads ( slot_colorlist );
+  declareWrites ( slot_label_image );
+  declareWrites ( slot_detection_frame );
+  //the integral histogram is shared with the robot detection and builds its tables lazily:
+  declareUsesShared ( label_integral );
 }
 
 
@@ -66,17 +72,56 @@ VarList * PluginDetectBalls::getSettings() {
   }
 }
 
+void PluginDetectBalls::readParameters ( BallDetectionParameters & p ) const {
+  p.color_label = _settings->_color_label->getString();
+  p.max_balls = _settings->_max_balls->getInt();
+  p.min_width = _settings->_ball_min_width->getInt();
+  p.max_width = _settings->_ball_max_width->getInt();
+  p.min_height = _settings->_ball_min_height->getInt();
+  p.max_height = _settings->_ball_max_height->getInt();
+  p.min_area = _settings->_ball_min_area->getInt();
+  p.max_area = _settings->_ball_max_area->getInt();
+  p.field_filter.update ( field );
+
+  p.filter_ball_in_field = _settings->_ball_on_field_filter->getBool();
+  p.filter_ball_on_field_filter_threshold = _settings->_ball_on_field_filter_threshold->getDouble();
+  p.filter_ball_in_goal  = _settings->_ball_in_goal_filter->getBool();
+  p.filter_ball_histogram = _settings->_ball_histogram_enabled->getBool();
+  p.min_greenness = _settings->_ball_histogram_min_greenness->getDouble();
+  p.max_markeryness = _settings->_ball_histogram_max_markeryness->getDouble();
+  p.histogram_integral = _settings->_ball_histogram_integral->getBool();
+
+  //setup values used for the gaussian confidence measurement:
+  p.filter_gauss = _settings->_ball_gauss_enabled->getBool();
+  p.exp_area_min =  _settings->_ball_gauss_min->getInt();
+  p.exp_area_max = _settings->_ball_gauss_max->getInt();
+  p.exp_area_var = sq ( _settings->_ball_gauss_stddev->getDouble() );
+  p.z_height= _settings->_ball_z_height->getDouble();
+
+  p.near_robot_filter = _settings->_ball_too_near_robot_enabled->getBool();
+  p.near_robot_dist_sq = sq(_settings->_ball_too_near_robot_dist->getDouble());
+}
+
 string PluginDetectBalls::getName() {
   return "DetectBalls";
 }
 
-bool PluginDetectBalls::checkHistogram ( const Image<raw8> * image, const CMVision::Region * reg, double min_greenness, double max_markeryness ) {
+bool PluginDetectBalls::checkHistogram ( CMVision::LabelImage * labels, const CMVision::Region * reg, double min_greenness, double max_markeryness, bool use_integral ) {
   static const int PixelRadius = 4;
 
   histogram->clear();
 
-  int num = histogram->addBox ( image, reg->x1 - PixelRadius, reg->y1 - PixelRadius,
-                                reg->x2 + PixelRadius, reg->y2 + PixelRadius );
+  int num;
+  if ( use_integral && label_integral!=0 ) {
+    //only the channels used below are counted:
+    const int channel_ids[] = { color_id_orange, color_id_pink, color_id_yellow, color_id_field };
+    label_integral->setLabels ( labels );
+    num = histogram->addBox ( label_integral, reg->x1 - PixelRadius, reg->y1 - PixelRadius,
+                              reg->x2 + PixelRadius, reg->y2 + PixelRadius, channel_ids, 4 );
+  } else {
+    num = histogram->addBox ( labels->get(), reg->x1 - PixelRadius, reg->y1 - PixelRadius,
+                              reg->x2 + PixelRadius, reg->y2 + PixelRadius );
+  }
 
 
   float pf = ( float ) ( histogram->getChannel ( color_id_pink ) ) / ( float ) ( histogram->getChannel ( color_id_orange ) );
@@ -112,82 +157,68 @@ ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * opt
 
   SSL_DetectionFrame * detection_frame = 0;
 
-  detection_frame= ( SSL_DetectionFrame * ) data->map.get ( "ssl_detection_frame" );
-  if ( detection_frame == 0 ) detection_frame= ( SSL_DetectionFrame * ) data->map.insert ( "ssl_detection_frame",new SSL_DetectionFrame() );
+  detection_frame= data->map.get ( slot_detection_frame );
+  if ( detection_frame == 0 ) detection_frame= data->map.insert ( slot_detection_frame,new SSL_DetectionFrame() );
 
-  int color_id_ball = _lut->getChannelID ( _settings->_color_label->getString() );
+  //all settings of this frame:
+  std::shared_ptr<const BallDetectionParameters> p = params.get();
+
+  int color_id_ball = _lut->getChannelID ( p->color_label );
   if ( color_id_ball == -1 ) {
-    printf ( "Unknown Ball Detection Color Label: '%s'\nAborting Plugin!\n",_settings->_color_label->getString().c_str() );
+    printf ( "Unknown Ball Detection Color Label: '%s'\nAborting Plugin!\n",p->color_label.c_str() );
     return ProcessingFailed;
   }
 
   //delete any previous detection results:
   detection_frame->clear_balls();
 
-  //TODO: add a vartype notifier for better performance.
+  bool filter_ball_histogram = p->filter_ball_histogram;
+  if ( filter_ball_histogram &&
+       ( color_id_pink==-1 || color_id_orange==-1 || color_id_yellow==-1 || color_id_field==-1 ) ) {
+    filter_ball_histogram=false;
+  }
 
   //initialize filter:
-  if (vnotify.hasChanged()) {
-    max_balls = _settings->_max_balls->getInt();
-    filter.setWidth ( _settings->_ball_min_width->getInt(),_settings->_ball_max_width->getInt() );
-    filter.setHeight ( _settings->_ball_min_height->getInt(),_settings->_ball_max_height->getInt() );
-    filter.setArea ( _settings->_ball_min_area->getInt(),_settings->_ball_max_area->getInt() );
-    field_filter.update ( field );
-
-    //copy all vartypes to local variables for faster repeated lookup:
-    filter_ball_in_field = _settings->_ball_on_field_filter->getBool();
-    filter_ball_on_field_filter_threshold = _settings->_ball_on_field_filter_threshold->getDouble();
-    filter_ball_in_goal  = _settings->_ball_in_goal_filter->getBool();
-    filter_ball_histogram = _settings->_ball_histogram_enabled->getBool();
-    if ( filter_ball_histogram ) {
+  if ( p != last_params ) {
+    last_params = p;
+    filter.setWidth ( p->min_width,p->max_width );
+    filter.setHeight ( p->min_height,p->max_height );
+    filter.setArea ( p->min_area,p->max_area );
+
+    if ( p->filter_ball_histogram ) {
       if ( color_id_ball != color_id_orange ) {
         printf ( "Warning: ball histogram check is only configured for orange balls!\n" );
         printf ( "Please disable the histogram check in the Ball Detection Plugin settings\n" );
       }
-      if ( color_id_pink==-1 || color_id_orange==-1 || color_id_yellow==-1 || color_id_field==-1 ) {
+      if ( !filter_ball_histogram ) {
         printf ( "WARNING: some LUT color labels where undefined for the ball detection plugin\n" );
         printf ( "         Disabling histogram check!\n" );
-        filter_ball_histogram=false;
       }
     }
-
-    min_greenness = _settings->_ball_histogram_min_greenness->getDouble();
-    max_markeryness = _settings->_ball_histogram_max_markeryness->getDouble();
-
-    //setup values used for the gaussian confidence measurement:
-    filter_gauss = _settings->_ball_gauss_enabled->getBool();
-    exp_area_min =  _settings->_ball_gauss_min->getInt();
-    exp_area_max = _settings->_ball_gauss_max->getInt();
-    exp_area_var = sq ( _settings->_ball_gauss_stddev->getDouble() );
-    z_height= _settings->_ball_z_height->getDouble();
-
-    near_robot_filter = _settings->_ball_too_near_robot_enabled->getBool();
-    near_robot_dist_sq = sq(_settings->_ball_too_near_robot_dist->getDouble());
   }
 
   const CMVision::Region * reg = 0;
 
   //acquire orange region list from data-map:
   CMVision::ColorRegionList * colorlist;
-  colorlist= ( CMVision::ColorRegionList * ) data->map.get ( "cmv_colorlist" );
+  colorlist= data->map.get ( slot_colorlist );
   if ( colorlist==0 ) {
     printf ( "error in ball detection plugin: no region-lists were found!\n" );
     return ProcessingFailed;
   }
-  reg = colorlist->getRegionList ( color_id_ball ).getInitialElement();
 
-  //acquire color-labeled image from data-map:
-  const Image<raw8> * image = ( Image<raw8> * ) ( data->map.get ( "cmv_threshold" ) );
-  if ( image==0 ) {
+  //acquire color-labeled image from data-map (only decoded once the histogram check needs it):
+  CMVision::LabelImage * labels = data->map.get ( slot_label_image );
+  if ( labels==0 ) {
     printf ( "error in ball detection plugin: no color-thresholded image was found!\n" );
     return ProcessingFailed;
   }
 
   int robots_blue_n=0;
   int robots_yellow_n=0;
-  bool use_near_robot_filter=near_robot_filter;
+  bool use_near_robot_filter=p->near_robot_filter;
   if ( use_near_robot_filter ) {
-    SSL_DetectionFrame * detection_frame = ( SSL_DetectionFrame * ) data->map.get ( "ssl_detection_frame" );
+    SSL_DetectionFrame * detection_frame = data->map.get ( slot_detection_frame );
     if ( detection_frame==0 ) {
       use_near_robot_filter=false;
     } else {
@@ -197,16 +228,17 @@ ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * opt
     }
   }
 
-  if ( max_balls > 0 ) {
+  if ( p->max_balls > 0 ) {
     list<BallDetectResult> result;
-    filter.init ( reg );
+    CameraParameters::FrameProjection projection = camera_parameters.getFrameProjection();
+    filter.init ( colorlist->getRegionList ( color_id_ball ) );
     
     while ( ( reg = filter.getNext() ) != 0 ) {
       float conf = 1.0;
 
-      if ( filter_gauss==true ) {
-        int a = reg->area - bound ( reg->area,exp_area_min,exp_area_max );
-        conf = gaussian ( a / exp_area_var );
+      if ( p->filter_gauss==true ) {
+        int a = reg->area - bound ( reg->area,p->exp_area_min,p->exp_area_max );
+        conf = gaussian ( a / p->exp_area_var );
       }
 
       //TODO: add a plugin for confidence masking... possibly multi-layered.
@@ -216,16 +248,16 @@ ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * opt
       //convert from image to field coordinates:
       vector2d pixel_pos ( reg->cen_x,reg->cen_y );
       vector3d field_pos_3d;
-      camera_parameters.image2field ( field_pos_3d,pixel_pos,z_height );
+      projection.image2field ( field_pos_3d,pixel_pos,p->z_height );
       vector2d field_pos ( field_pos_3d.x,field_pos_3d.y );
 
       //filter points that are outside of the field:
-      if ( filter_ball_in_field==true && field_filter.isInFieldPlusThreshold ( field_pos, max(0.0,filter_ball_on_field_filter_threshold) ) ==false ) {
+      if ( p->filter_ball_in_field==true && p->field_filter.isInFieldPlusThreshold ( field_pos, max(0.0,p->filter_ball_on_field_filter_threshold) ) ==false ) {
         conf = 0.0;
       }
 
       //filter out points that are deep inside the goal-box
-      if ( filter_ball_in_goal==true && field_filter.isFarInGoal ( field_pos ) ==true ) {
+      if ( p->filter_ball_in_goal==true && p->field_filter.isFarInGoal ( field_pos ) ==true ) {
         conf = 0.0;
       }
 
@@ -249,8 +281,8 @@ ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * opt
               const SSL_DetectionRobot & robot = robots->Get(r);
               if (robot.confidence() > 0.0) {
                 vector3d field_on_bot_pos_3d;
-                camera_parameters.image2field ( field_on_bot_pos_3d, pixel_pos, robot.height());
-                if ((sq((double)(robot.x())-(double)(field_on_bot_pos_3d.x)) + sq((double)(robot.y())-(double)(field_on_bot_pos_3d.y))) < near_robot_dist_sq) {
+                projection.image2field ( field_on_bot_pos_3d, pixel_pos, robot.height());
+                if ((sq((double)(robot.x())-(double)(field_on_bot_pos_3d.x)) + sq((double)(robot.y())-(double)(field_on_bot_pos_3d.y))) < p->near_robot_dist_sq) {
                   conf = 0.0;
                   break;
                 }
@@ -262,7 +294,7 @@ ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * opt
       }
 
       // histogram check if enabled
-      if ( filter_ball_histogram && conf > 0.0 && checkHistogram ( image, reg, min_greenness, max_markeryness ) ==false ) {
+      if ( filter_ball_histogram && conf > 0.0 && checkHistogram ( labels, reg, p->min_greenness, p->max_markeryness, p->histogram_integral ) ==false ) {
         conf = 0.0;
       }
 
@@ -279,7 +311,7 @@ ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * opt
     int num_ball = 0;
     list<BallDetectResult>::reverse_iterator it;
     for(it=result.rbegin(); it!=result.rend(); it++) {
-      if(++num_ball > max_balls)
+      if(++num_ball > p->max_balls)
         break;
 
       //update result:
@@ -289,7 +321,7 @@ ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * opt
 
       vector2d pixel_pos ( it->reg->cen_x,it->reg->cen_y );
       vector3d field_pos_3d;
-      camera_parameters.image2field ( field_pos_3d,pixel_pos,z_height );
+      projection.image2field ( field_pos_3d,pixel_pos,p->z_height );
 
       ball->set_area ( it->reg->area );
       ball->set_x ( field_pos_3d.x );
@@ -28,7 +28,7 @@
 #include "field_filter.h"
 #include "cmvision_histogram.h"
 #include "vis_util.h"
-#include "VarNotifier.h"
+#include "VarSnapshot.h"
 #include "lut3d.h"
 /**
 	@author Author Name
@@ -64,6 +64,7 @@ protected:
     VarBool   * _ball_histogram_enabled;
     VarDouble * _ball_histogram_min_greenness;
     VarDouble * _ball_histogram_max_markeryness;
+    VarBool   * _ball_histogram_integral;
   VarList   * _filter_geometry;
     VarBool   * _ball_on_field_filter;
     VarDouble * _ball_on_field_filter_threshold;
@@ -101,6 +102,7 @@ public:
     _filter_histogram->addChild(_ball_histogram_enabled = new VarBool("Enable Filter",true));
     _filter_histogram->addChild(_ball_histogram_min_greenness = new VarDouble("Min Greenness",0.5));
     _filter_histogram->addChild(_ball_histogram_max_markeryness = new VarDouble("Max Markeryness",2.0));
+    _filter_histogram->addChild(_ball_histogram_integral = new VarBool("Use Integral Image",false));
 
   _settings->addChild(_filter_geometry = new VarList("Geometry Filters"));
     _filter_geometry->addChild(_ball_on_field_filter = new VarBool("Ball-In-Field Filter",true));
@@ -114,19 +116,23 @@ public:
 
 };
 
-class PluginDetectBalls : public VisionPlugin
-{
-protected:
-  //-----------------------------
-  //local copies of the vartypes tree for better performance
-  //these are updated automatically if a change is reported by vartypes
-  VarNotifier vnotify;
+/// the settings of PluginDetectBalls, as used for one frame
+struct BallDetectionParameters {
+  string color_label;
+  int max_balls;
+  int min_width;
+  int max_width;
+  int min_height;
+  int max_height;
+  int min_area;
+  int max_area;
   bool filter_ball_in_field;
   double filter_ball_on_field_filter_threshold;
   bool filter_ball_in_goal;
   bool filter_ball_histogram;
   double min_greenness;
   double max_markeryness;
+  bool histogram_integral;
   bool filter_gauss;
   int exp_area_min;
   int exp_area_max;
@@ -134,13 +140,21 @@ protected:
   double z_height;
   bool near_robot_filter;
   double near_robot_dist_sq;
-  int max_balls;
-  //-----------------------------
-  
-  
-  
-  
-  
+  FieldFilter field_filter;
+};
+
+class PluginDetectBalls : public VisionPlugin
+{
+protected:
+  FrameDataSlot<SSL_DetectionFrame> slot_detection_frame{"ssl_detection_frame"};
+  FrameDataSlot<CMVision::ColorRegionList> slot_colorlist{"cmv_colorlist"};
+  FrameDataSlot<CMVision::LabelImage> slot_label_image{"cmv_label_image"};
+  //local copy of the vartypes tree for better performance:
+  VarSnapshot<BallDetectionParameters> params;
+  std::shared_ptr<const BallDetectionParameters> last_params;
+
+  void readParameters(BallDetectionParameters & p) const;
+
   LUT3D * _lut;
   PluginDetectBallsSettings * _settings; 
   bool _have_local_settings;
@@ -150,18 +164,17 @@ protected:
   int color_id_field;
 
   CMVision::Histogram * histogram;
+  CMVision::IntegralHistogram * label_integral;
 
   CMVision::RegionFilter filter;
 
   const CameraParameters& camera_parameters;
   const RoboCupField& field;
 
-  FieldFilter field_filter;
-
-  bool checkHistogram(const Image<raw8> * image, const CMVision::Region * reg, double min_greenness=0.5, double max_markeryness=2.0);
+  bool checkHistogram(CMVision::LabelImage * labels, const CMVision::Region * reg, double min_greenness=0.5, double max_markeryness=2.0, bool use_integral=false);
 
 public:
-    PluginDetectBalls(FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field, PluginDetectBallsSettings * _settings=0);
+    PluginDetectBalls(FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field, PluginDetectBallsSettings * _settings=0, CMVision::IntegralHistogram * _label_integral=0);
 
     ~PluginDetectBalls();
 
@@ -20,7 +20,7 @@
 //========================================================================
 #include "plugin_detect_robots.h"
 
-PluginDetectRobots::PluginDetectRobots(FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field, CMPattern::TeamSelector * _global_team_selector_blue, CMPattern::TeamSelector * _global_team_selector_yellow, CMPattern::TeamDetectorSettings * _global_team_settings)
+PluginDetectRobots::PluginDetectRobots(FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field, CMPattern::TeamSelector * _global_team_selector_blue, CMPattern::TeamSelector * _global_team_selector_yellow, CMPattern::TeamDetectorSettings * _global_team_settings, CMVision::IntegralHistogram * label_integral)
  : VisionPlugin(_buffer), camera_parameters(camera_params), field(field)
 {
   _lut=lut;
@@ -45,14 +45,21 @@ PluginDetectRobots::PluginDetectRobots(FrameBuffer * _buffer, LUT3D * lut, const
   global_team_selector_yellow=_global_team_selector_yellow;
   global_team_detector_settings=_global_team_settings;
 
-  team_detector_blue=new CMPattern::TeamDetector(_lut,camera_params,field);
-  team_detector_yellow=new CMPattern::TeamDetector(_lut,camera_params,field);
+  team_detector_blue=new CMPattern::TeamDetector(_lut,camera_params,field,label_integral);
+  team_detector_yellow=new CMPattern::TeamDetector(_lut,camera_params,field,label_integral);
 
   _settings=new VarList("Robot Detection");
   _notifier.addRecursive(_settings);
   connect(_global_team_selector_blue,SIGNAL(signalTeamDataChanged()),&_notifier,SLOT(changeSlotOtherChange()));
   connect(_global_team_selector_yellow,SIGNAL(signalTeamDataChanged()),&_notifier,SLOT(changeSlotOtherChange()));
   connect(_global_team_settings,SIGNAL(signalTeamDataChanged()),&_notifier,SLOT(changeSlotOtherChange()));
+
+  //the label image is decoded on first access, so reading it modifies it
+  declareReads(slot_colorlist);
+  declareWrites(slot_label_image);
+  declareWrites(slot_detection_frame);
+  //the integral histogram is shared with the ball detection and builds its tables lazily:
+  declareUsesShared(label_integral);
 }
 
 PluginDetectRobots::~PluginDetectRobots()
@@ -91,20 +98,20 @@ ProcessResult PluginDetectRobots::process(FrameData * data, RenderOptions * opti
 
   SSL_DetectionFrame * detection_frame = 0;
 
-  detection_frame=(SSL_DetectionFrame *)data->map.get("ssl_detection_frame");
-  if (detection_frame == 0) detection_frame=(SSL_DetectionFrame *)data->map.insert("ssl_detection_frame",new SSL_DetectionFrame());
+  detection_frame=data->map.get(slot_detection_frame);
+  if (detection_frame == 0) detection_frame=data->map.insert(slot_detection_frame,new SSL_DetectionFrame());
 
   //acquire orange region list from data-map:
   CMVision::ColorRegionList * colorlist;
-  colorlist=(CMVision::ColorRegionList *)data->map.get("cmv_colorlist");
+  colorlist=data->map.get(slot_colorlist);
   if (colorlist==0) {
     printf("error in robot detection plugin: no region-lists were found!\n");
     return ProcessingFailed;
   }
 
-  //acquire color-labeled image from data-map:
-  const Image<raw8> * image = (Image<raw8> *)(data->map.get("cmv_threshold"));
-  if (image==0) {
+  //acquire color-labeled image from data-map (only decoded once a histogram check needs it):
+  CMVision::LabelImage * labels = data->map.get(slot_label_image);
+  if (labels==0) {
     printf("error in robot detection plugin: no color-thresholded image was found!\n");
     return ProcessingFailed;
   }
@@ -142,7 +149,7 @@ ProcessResult PluginDetectRobots::process(FrameData * data, RenderOptions * opti
         detector->init(global_team_detector_settings->getRobotPattern(), team);
       }
 
-      detector->update(robotlist, color_id,  num_robots, image, colorlist, reg_tree);
+      detector->update(robotlist, color_id,  num_robots, labels, colorlist, reg_tree);
     } else {
       _notifier.changeSlotOtherChange();
     }
@@ -23,6 +23,7 @@
 
 #include <visionplugin.h>
 #include "cmvision_region.h"
+#include "cmvision_region_tree.h"
 #include "messages_robocup_ssl_detection.pb.h"
 #include "camera_calibration.h"
 #include "field_filter.h"
@@ -38,6 +39,9 @@
 class PluginDetectRobots : public VisionPlugin
 {
 protected:
+  FrameDataSlot<SSL_DetectionFrame> slot_detection_frame{"ssl_detection_frame"};
+  FrameDataSlot<CMVision::ColorRegionList> slot_colorlist{"cmv_colorlist"};
+  FrameDataSlot<CMVision::LabelImage> slot_label_image{"cmv_label_image"};
   VarNotifier _notifier;
   LUT3D * _lut;
   VarList * _settings;
@@ -69,7 +73,7 @@ protected:
 protected slots:
     void teamDataChange();
 public:
-    PluginDetectRobots(FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field, CMPattern::TeamSelector * _global_team_selector_blue, CMPattern::TeamSelector * _global_team_selector_yellow, CMPattern::TeamDetectorSettings * global_team_settings);
+    PluginDetectRobots(FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field, CMPattern::TeamSelector * _global_team_selector_blue, CMPattern::TeamSelector * _global_team_selector_yellow, CMPattern::TeamDetectorSettings * global_team_settings, CMVision::IntegralHistogram * label_integral=0);
 
     ~PluginDetectRobots();
 
@@ -14,7 +14,6 @@
 //========================================================================
 
 #include "plugin_distribute.h"
-#include <opencv2/opencv.hpp>
 
 PluginDistribute::PluginDistribute(FrameBuffer *_buffer, vector<CaptureSplitter *> captureSplitters)
     : VisionPlugin(_buffer),
@@ -27,6 +26,9 @@ PluginDistribute::PluginDistribute(FrameBuffer *_buffer, vector<CaptureSplitter
   _settings->addChild(_v_enabled);
   _settings->addChild(_v_image);
   _settings->addChild(_v_greyscale);
+
+  declareReadsVideo();
+  declareWrites(slot_vis_frame);
 }
 
 PluginDistribute::~PluginDistribute() = default;
@@ -47,9 +49,10 @@ void PluginDistribute::drawCameraImage(FrameData *data, VisualizationFrame *vis_
         vis_frame->data.getData(),
         data->video.getWidth(), data->video.getHeight());
   } else if (source_format==COLOR_RAW8) {
-    cv::Mat src(data->video.getHeight(), data->video.getWidth(), CV_8UC1, data->video.getData());
-    cv::Mat dst(data->video.getHeight(), data->video.getWidth(), CV_8UC3, vis_frame->data.getData());
-    cvtColor(src, dst, cv::COLOR_BayerBG2RGB);
+    Conversions::bayer2rgb(
+        data->video.getData(),
+        vis_frame->data.getData(),
+        data->video.getWidth(), data->video.getHeight());
   } else {
     // blank it:
     vis_frame->data.fillBlack();
@@ -82,11 +85,9 @@ ProcessResult PluginDistribute::process(FrameData *data, RenderOptions *options)
     captureSplitter->waitUntilFrameProcessed();
   }
 
-  VisualizationFrame *vis_frame =
-      reinterpret_cast<VisualizationFrame *>(data->map.get("vis_frame"));
+  VisualizationFrame *vis_frame = data->map.get(slot_vis_frame);
   if (vis_frame == nullptr) {
-    vis_frame = reinterpret_cast<VisualizationFrame *>(
-        data->map.insert("vis_frame", new VisualizationFrame()));
+    vis_frame = data->map.insert(slot_vis_frame, new VisualizationFrame());
   }
 
   if (_v_enabled->getBool()) {
@@ -23,6 +23,7 @@
 
 class PluginDistribute : public VisionPlugin {
 protected:
+  FrameDataSlot<VisualizationFrame> slot_vis_frame{"vis_frame"};
   VarList *_settings;
   VarBool *_v_enabled;
   VarBool *_v_image;
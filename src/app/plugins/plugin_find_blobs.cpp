@@ -19,6 +19,8 @@
 */
 //========================================================================
 #include "plugin_find_blobs.h"
+#include "thread_pool.h"
+#include <vector>
 
 PluginFindBlobs::PluginFindBlobs(FrameBuffer * _buffer, YUVLUT * _lut)
  : VisionPlugin(_buffer)
@@ -29,7 +31,20 @@ PluginFindBlobs::PluginFindBlobs(FrameBuffer * _buffer, YUVLUT * _lut)
   _settings->addChild(_v_min_blob_area=new VarInt("min_blob_area", 5));
   _settings->addChild(_v_enable=new VarBool("enable", true));
   _settings->addChild(v_max_regions=new VarInt("max regions", 50000, 10000, 1000000));
-
+  _settings->addChild(v_num_threads=new VarInt("number of threads", 0, 0, 64));
+  _settings->addChild(v_storage=new VarDouble("run and region data (KiB/frame)", 0.0));
+  v_storage->addFlags(VARTYPE_FLAG_READONLY | VARTYPE_FLAG_NOSTORE);
+
+  regtable=nullptr;
+  storage_compact=false;
+  storage_bytes=0.0;
+  storage_frames=0;
+
+  //connecting the components rewrites the parents (and links) of the runs in place:
+  declareWrites(slot_runlist);
+  declareWrites(slot_runtable);
+  declareWrites(slot_reglist);
+  declareWrites(slot_colorlist);
 }
 
 
@@ -39,6 +54,45 @@ PluginFindBlobs::~PluginFindBlobs()
   delete _v_min_blob_area;
   delete _v_enable;
   delete v_max_regions;
+  delete v_num_threads;
+  delete v_storage;
+  delete regtable;
+}
+
+static int lastRow(CMVision::RunList * runlist) {
+  return runlist->getRunArrayPointer()[runlist->getUsedRuns() - 1].y;
+}
+
+static int lastRow(CMVision::RunTable * runtable) {
+  return runtable->getY()[runtable->getUsedRuns() - 1];
+}
+
+template <class RUNS>
+static void connectComponentsParallel(RUNS * runlist, int num_threads, std::vector<int> & stripe_begin, std::vector<int> & merged) {
+  int num = runlist->getUsedRuns();
+  if (num_threads < 2 || num == 0) {
+    CMVision::RegionProcessing::connectComponents(runlist);
+    return;
+  }
+
+  //split the run list into stripes of complete rows:
+  int rows = lastRow(runlist) + 1;
+  stripe_begin.resize(num_threads + 1);
+  for (int k = 0; k < num_threads; k++) {
+    stripe_begin[k] = CMVision::RegionProcessing::findRowStart(runlist, (k * rows) / num_threads);
+  }
+  stripe_begin[num_threads] = num;
+
+  ThreadPool & pool = ThreadPool::global();
+  pool.parallelFor(num_threads, [&](int k) {
+    CMVision::RegionProcessing::connectComponentStripe(runlist, stripe_begin[k], stripe_begin[k + 1]);
+  });
+
+  CMVision::RegionProcessing::mergeComponentStripes(runlist, stripe_begin.data(), num_threads, merged);
+
+  pool.parallelFor(num_threads, [&](int k) {
+    CMVision::RegionProcessing::compressComponentStripe(runlist, stripe_begin[k], stripe_begin[k + 1]);
+  });
 }
 
 
@@ -47,29 +101,47 @@ ProcessResult PluginFindBlobs::process(FrameData * data, RenderOptions * options
   (void)options;
 
 
-  CMVision::RegionList * reglist = (CMVision::RegionList *) data->map.get("cmv_reglist");
+  CMVision::RegionList * reglist = data->map.get(slot_reglist);
   if (reglist == nullptr || reglist->getMaxRegions() != v_max_regions->getInt()) {
     delete reglist;
-    reglist = (CMVision::RegionList *) data->map.update("cmv_reglist", new CMVision::RegionList(v_max_regions->getInt()));
+    reglist = data->map.update(slot_reglist, new CMVision::RegionList(v_max_regions->getInt()));
   }
 
-  CMVision::ColorRegionList * colorlist = (CMVision::ColorRegionList *) data->map.get("cmv_colorlist");
+  CMVision::ColorRegionList * colorlist = data->map.get(slot_colorlist);
   if (colorlist == nullptr) {
-    colorlist = (CMVision::ColorRegionList *) data->map.insert("cmv_colorlist", new CMVision::ColorRegionList(lut->getChannelCount()));
+    colorlist = data->map.insert(slot_colorlist, new CMVision::ColorRegionList(lut->getChannelCount()));
   }
 
-  CMVision::RunList * runlist = (CMVision::RunList *) data->map.get("cmv_runlist");
+  CMVision::RunList * runlist = data->map.get(slot_runlist);
   if (runlist == nullptr) {
     printf("Blob finder: no runlength-encoded input list was found!\n");
     return ProcessingFailed;
   }
 
+  //the compact layout is used whenever the run length encoder filled the run table:
+  CMVision::RunTable * runtable = data->map.get(slot_runtable);
+  bool compact = runtable != nullptr && runtable->getUsedRuns() > 0;
+
   if (_v_enable->getBool()) {
-    //Connect the components of the runlength map:
-    CMVision::RegionProcessing::connectComponents(runlist);
-  
-    //Extract Regions from runlength map:
-    CMVision::RegionProcessing::extractRegions(reglist, runlist);
+    if (compact) {
+      if (regtable == nullptr || regtable->getMaxRegions() != reglist->getMaxRegions()) {
+        delete regtable;
+        regtable = new CMVision::RegionTable(reglist->getMaxRegions());
+      }
+      connectComponentsParallel(runtable, v_num_threads->getInt(), stripe_begin, merged_roots);
+      CMVision::RegionProcessing::extractRegions(regtable, runtable);
+      regtable->toRegionList(reglist);
+      updateStorageStatistics(true, (double)runtable->getUsedRuns() * CMVision::RunTable::getBytesPerRun() +
+                                    (double)regtable->getUsedRegions() * sizeof(CMVision::CompactRegion));
+    } else {
+      //Connect the components of the runlength map:
+      connectComponentsParallel(runlist, v_num_threads->getInt(), stripe_begin, merged_roots);
+
+      //Extract Regions from runlength map:
+      CMVision::RegionProcessing::extractRegions(reglist, runlist);
+      updateStorageStatistics(false, (double)runlist->getUsedRuns() * sizeof(CMVision::Run) +
+                                     (double)reglist->getUsedRegions() * sizeof(CMVision::Region));
+    }
   
     if (reglist->getUsedRegions() == reglist->getMaxRegions()) {
       printf("Warning: FindBlobs: extract regions exceeded maximum number of %d regions\n",reglist->getMaxRegions());
@@ -96,6 +168,17 @@ ProcessResult PluginFindBlobs::process(FrameData * data, RenderOptions * options
 
 }
 
+void PluginFindBlobs::updateStorageStatistics(bool compact, double bytes) {
+  if (compact != storage_compact) {
+    storage_compact = compact;
+    storage_bytes = 0.0;
+    storage_frames = 0;
+  }
+  storage_bytes += bytes;
+  storage_frames++;
+  v_storage->setDouble(storage_bytes / storage_frames / 1024.0);
+}
+
 VarList * PluginFindBlobs::getSettings() {
   return _settings;
 }
@@ -30,12 +30,28 @@
 class PluginFindBlobs : public VisionPlugin
 {
 protected:
+  FrameDataSlot<CMVision::RegionList> slot_reglist{"cmv_reglist"};
+  FrameDataSlot<CMVision::ColorRegionList> slot_colorlist{"cmv_colorlist"};
+  FrameDataSlot<CMVision::RunList> slot_runlist{"cmv_runlist"};
+  FrameDataSlot<CMVision::RunTable> slot_runtable{"cmv_runtable"};
   YUVLUT * lut;
+  CMVision::RegionTable * regtable;
+  //scratch space of the parallel component connection, reused across frames:
+  std::vector<int> stripe_begin;
+  std::vector<int> merged_roots;
 
   VarList * _settings;
   VarInt * _v_min_blob_area;
   VarBool * _v_enable;
   VarInt * v_max_regions;
+  VarInt * v_num_threads;
+  VarDouble * v_storage;
+
+  //run and region storage streamed through per frame, averaged since the layout last changed:
+  bool storage_compact;
+  double storage_bytes;
+  long long storage_frames;
+  void updateStorageStatistics(bool compact, double bytes);
 public:
     PluginFindBlobs(FrameBuffer * _buffer, YUVLUT * _lut);
 
@@ -58,6 +58,10 @@ PluginLegacyPublishGeometry::PluginLegacyPublishGeometry(
   _pub_auto->addChild(_pub_auto_enable=new VarBool("Enable",true));
   _pub_auto->addChild(_pub_auto_interval=new VarDouble("Interval (seconds)",3.0));
   last_t=0;
+  //process() only reads the frame time, which is exempt (see declareNoFrameData()),
+  //and sends after the detection frames of the same server:
+  declareNoFrameData();
+  declareUsesShared(_ds_udp_server_old);
   connect(_pub,SIGNAL(signalTriggered()),this,SLOT(slotPublishTriggered()));
 }
 
@@ -28,7 +28,12 @@ PluginLegacySSLNetworkOutput::PluginLegacySSLNetworkOutput(
     VisionPlugin(_fb),
     _camera_params(camera_params),
     _field(field),
-    _ds_udp_server_old(ds_udp_server_old) {}
+    _ds_udp_server_old(ds_udp_server_old) {
+  //the capture time and frame number are stored in the detection frame
+  declareWrites(slot_detection_frame);
+  //keeps the packets on the server in the order of the stack:
+  declareUsesShared(_ds_udp_server_old);
+}
 
 PluginLegacySSLNetworkOutput::~PluginLegacySSLNetworkOutput() {}
 
@@ -71,7 +76,7 @@ ProcessResult PluginLegacySSLNetworkOutput::process(
 
   SSL_DetectionFrame * detection_frame = 0;
 
-  detection_frame=(SSL_DetectionFrame *)data->map.get("ssl_detection_frame");
+  detection_frame=data->map.get(slot_detection_frame);
   if (detection_frame != 0) {
     detection_frame->set_t_capture(data->time);
     detection_frame->set_frame_number(data->number);
@@ -31,6 +31,7 @@
 class PluginLegacySSLNetworkOutput : public VisionPlugin
 {
 protected:
+ FrameDataSlot<SSL_DetectionFrame> slot_detection_frame{"ssl_detection_frame"};
  const CameraParameters& _camera_params;
  const RoboCupField& _field;
  // UDP Server for Double-Sized field, old protobuf format.
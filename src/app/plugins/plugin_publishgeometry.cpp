@@ -31,6 +31,10 @@ PluginPublishGeometry::PluginPublishGeometry(FrameBuffer * fb, RoboCupSSLServer
   _pub_auto->addChild(_pub_auto_enable=new VarBool("Enable",true));
   _pub_auto->addChild(_pub_auto_interval=new VarDouble("Interval (seconds)",3.0));
   last_t=0;
+  //process() only reads the frame time, which is exempt (see declareNoFrameData()),
+  //and sends after the detection frames of the same server:
+  declareNoFrameData();
+  declareUsesShared(_server);
   connect(_pub,SIGNAL(signalTriggered()),this,SLOT(slotPublishTriggered()));
 }
 
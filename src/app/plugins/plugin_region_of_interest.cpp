@@ -0,0 +1,228 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    plugin_region_of_interest.cpp
+  \brief   C++ Implementation: PluginRegionOfInterest
+*/
+//========================================================================
+#include "plugin_region_of_interest.h"
+#include <algorithm>
+#include <cmath>
+
+PluginRegionOfInterest::PluginRegionOfInterest(FrameBuffer * _buffer, const CameraParameters & camera_params,
+                                               ConvexHullImageMask & mask)
+  : VisionPlugin(_buffer),
+    camera_parameters(camera_params),
+    _image_mask(mask),
+    params([this](RegionOfInterestParameters & p) { readParameters(p); })
+{
+  settings = new VarList("Region of Interest");
+  settings->addChild(v_enabled = new VarBool("enabled", false));
+  settings->addChild(v_full_scan_interval = new VarInt("full scan interval (frames)", 10, 1, 10000));
+  settings->addChild(v_max_ball_speed = new VarDouble("max ball speed (m/s)", 8.0, 0.0));
+  settings->addChild(v_max_robot_speed = new VarDouble("max robot speed (m/s)", 4.0, 0.0));
+  settings->addChild(v_margin = new VarDouble("margin (mm)", 50.0, 0.0));
+  settings->addChild(v_ball_radius = new VarDouble("ball radius (mm)", 21.5, 0.0));
+  settings->addChild(v_robot_radius = new VarDouble("robot radius (mm)", 90.0, 0.0));
+  settings->addChild(v_robot_height = new VarDouble("robot height (mm)", 150.0, 0.0));
+
+  settings->addChild(v_statistics = new VarList("Statistics"));
+  v_statistics->addChild(v_processed_pixels = new VarDouble("processed pixels (%)", 100.0));
+  v_statistics->addChild(v_full_scan_objects = new VarInt("objects in full scans", 0));
+  v_statistics->addChild(v_missed_objects = new VarInt("objects missed in between", 0));
+  v_statistics->addFlags(VARTYPE_FLAG_NOSTORE);
+  v_processed_pixels->addFlags(VARTYPE_FLAG_READONLY);
+  v_full_scan_objects->addFlags(VARTYPE_FLAG_READONLY);
+  v_missed_objects->addFlags(VARTYPE_FLAG_READONLY);
+
+  params.addItem(v_enabled);
+  params.addItem(v_full_scan_interval);
+  params.addItem(v_max_ball_speed);
+  params.addItem(v_max_robot_speed);
+  params.addItem(v_margin);
+  params.addItem(v_ball_radius);
+  params.addItem(v_robot_radius);
+  params.addItem(v_robot_height);
+
+  //the detections of the previous frame are not accessed on the current one
+  declareReadsVideo();
+  declareWrites(slot_roi);
+}
+
+PluginRegionOfInterest::~PluginRegionOfInterest()
+{
+  delete settings;
+}
+
+void PluginRegionOfInterest::readParameters(RegionOfInterestParameters & p) {
+  p.enabled = v_enabled->getBool();
+  p.full_scan_interval = std::max(v_full_scan_interval->getInt(), 1);
+  p.max_ball_speed = v_max_ball_speed->getDouble() * 1000.0;
+  p.max_robot_speed = v_max_robot_speed->getDouble() * 1000.0;
+  p.margin = v_margin->getDouble();
+  p.ball_radius = v_ball_radius->getDouble();
+  p.robot_radius = v_robot_radius->getDouble();
+  p.robot_height = v_robot_height->getDouble();
+}
+
+VarList * PluginRegionOfInterest::getSettings() {
+  return settings;
+}
+
+string PluginRegionOfInterest::getName() {
+  return "Region of Interest";
+}
+
+static int countObjects(const SSL_DetectionFrame & detection) {
+  return detection.balls_size() + detection.robots_yellow_size() + detection.robots_blue_size();
+}
+
+static bool insideWindows(const vector<RegionOfInterest::Window> & windows, double x, double y) {
+  for (const auto & w : windows) {
+    if (x >= w.x0 && x < w.x1 && y >= w.y0 && y < w.y1) return true;
+  }
+  return false;
+}
+
+void PluginRegionOfInterest::addWindow(RegionOfInterest * roi, double x, double y, double z_min, double z_max,
+                                       double radius, int width, int height) {
+  //the bounding box of the image of a vertical box around the object:
+  double x0 = width, y0 = height, x1 = 0.0, y1 = 0.0;
+  for (int i = 0; i < 8; i++) {
+    GVector::vector3d<double> p_f(x + ((i & 1) ? radius : -radius),
+                                  y + ((i & 2) ? radius : -radius),
+                                  (i & 4) ? z_max : z_min);
+    GVector::vector2d<double> p_i;
+    camera_parameters.field2image(p_f, p_i);
+    x0 = std::min(x0, p_i.x);
+    y0 = std::min(y0, p_i.y);
+    x1 = std::max(x1, p_i.x);
+    y1 = std::max(y1, p_i.y);
+  }
+  RegionOfInterest::Window w;
+  w.x0 = std::max((int)floor(x0), 0);
+  w.y0 = std::max((int)floor(y0), 0);
+  w.x1 = std::min((int)ceil(x1) + 1, width);
+  w.y1 = std::min((int)ceil(y1) + 1, height);
+  if (w.x1 > w.x0 && w.y1 > w.y0) roi->windows.push_back(w);
+}
+
+void PluginRegionOfInterest::buildSpans(RegionOfInterest * roi, int width, int height) {
+  _image_mask.lock();
+  const RowSpans & mask = _image_mask.getRowSpans();
+  bool use_mask = _image_mask.getWidth() == width && mask.getHeight() == height;
+  roi->spans.setWindows(roi->windows, width, height, use_mask ? &mask : nullptr);
+  _image_mask.unlock();
+}
+
+void PluginRegionOfInterest::evaluateFullScan(const SSL_DetectionFrame & detection) {
+  full_scan_count = countObjects(detection);
+  if (!have_reference) return;
+  full_scan_objects += full_scan_count;
+  for (const auto & ball : detection.balls()) {
+    if (!insideWindows(reference_windows, ball.pixel_x(), ball.pixel_y())) missed_objects++;
+  }
+  for (const auto & robot : detection.robots_yellow()) {
+    if (!insideWindows(reference_windows, robot.pixel_x(), robot.pixel_y())) missed_objects++;
+  }
+  for (const auto & robot : detection.robots_blue()) {
+    if (!insideWindows(reference_windows, robot.pixel_x(), robot.pixel_y())) missed_objects++;
+  }
+}
+
+void PluginRegionOfInterest::updateStatistics() {
+  if (total_pixels > 0) v_processed_pixels->setDouble(100.0 * processed_pixels / total_pixels);
+  v_full_scan_objects->setInt(full_scan_objects);
+  v_missed_objects->setInt(missed_objects);
+}
+
+ProcessResult PluginRegionOfInterest::process(FrameData * data, RenderOptions * options) {
+  (void)options;
+  RegionOfInterest * roi = data->map.get(slot_roi);
+  if (roi == nullptr) roi = data->map.insert(slot_roi, new RegionOfInterest());
+  roi->full_frame = true;
+  roi->windows.clear();
+
+  std::shared_ptr<const RegionOfInterestParameters> p = params.get();
+  if (!p->enabled) {
+    last_full_scan = -1;
+    last_evaluated = -1;
+    full_scan_count = 0;
+    last_was_roi = false;
+    last_windows.clear();
+    return ProcessingOk;
+  }
+
+  int width = data->video.getWidth();
+  int height = data->video.getHeight();
+  //the detections of another image size don't apply. The size is remembered here, as the
+  //video of completed frames may already be released (e.g. with zero-copy capture):
+  if (width != last_width || height != last_height) {
+    last_full_scan = -1;
+    last_was_roi = false;
+    last_windows.clear();
+    last_width = width;
+    last_height = height;
+  }
+
+  //the most recently completed frame. While pipelined, this is the one before the previous frame.
+  //Only frames since the last full scan are used, which all have the current size:
+  FrameData * prev = buffer->getPointer(buffer->prevWrite());
+  const SSL_DetectionFrame * detection = nullptr;
+  if (prev != data && last_full_scan >= 0 && prev->number >= last_full_scan && prev->number < data->number) {
+    const RegionOfInterest * prev_roi = prev->map.get(slot_roi);
+    detection = prev->map.get(slot_detection_frame);
+    if (prev_roi != nullptr && detection != nullptr && prev_roi->full_frame && prev->number != last_evaluated) {
+      evaluateFullScan(*detection);
+      last_evaluated = prev->number;
+      updateStatistics();
+    }
+  }
+
+  bool full_scan = detection == nullptr ||
+                   data->number - last_full_scan >= p->full_scan_interval ||
+                   countObjects(*detection) < full_scan_count; //lost track of an object
+
+  if (!full_scan) {
+    double dt = std::max(data->time - prev->time, 0.0);
+    double ball_radius = p->ball_radius + p->margin + p->max_ball_speed * dt;
+    double robot_radius = p->robot_radius + p->margin + p->max_robot_speed * dt;
+    for (const auto & ball : detection->balls()) {
+      double z = ball.has_z() ? ball.z() : 0.0;
+      addWindow(roi, ball.x(), ball.y(), z, z + 2.0 * p->ball_radius, ball_radius, width, height);
+    }
+    for (const auto & robot : detection->robots_yellow()) {
+      addWindow(roi, robot.x(), robot.y(), 0.0, p->robot_height, robot_radius, width, height);
+    }
+    for (const auto & robot : detection->robots_blue()) {
+      addWindow(roi, robot.x(), robot.y(), 0.0, p->robot_height, robot_radius, width, height);
+    }
+    buildSpans(roi, width, height);
+    roi->full_frame = false;
+    last_windows = roi->windows;
+    processed_pixels += roi->spans.getNumPixels();
+  } else {
+    //misses can only be attributed to the windows if the previous frame was restricted to them:
+    have_reference = last_was_roi;
+    reference_windows.swap(last_windows);
+    last_windows.clear();
+    last_full_scan = data->number;
+    processed_pixels += (long long)width * height;
+  }
+  total_pixels += (long long)width * height;
+  last_was_roi = !full_scan;
+
+  return ProcessingOk;
+}
@@ -0,0 +1,132 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    plugin_region_of_interest.h
+  \brief   C++ Interface: PluginRegionOfInterest
+*/
+//========================================================================
+#ifndef PLUGIN_REGION_OF_INTEREST_H
+#define PLUGIN_REGION_OF_INTEREST_H
+
+#include <visionplugin.h>
+#include <memory>
+#include <vector>
+#include "messages_robocup_ssl_detection.pb.h"
+#include "camera_calibration.h"
+#include "convex_hull_image_mask.h"
+#include "row_spans.h"
+#include "VarSnapshot.h"
+
+/*!
+  \class   RegionOfInterest
+  \brief   The pixels of a frame that the segmentation has to look at
+*/
+class RegionOfInterest {
+public:
+  typedef RowSpans::Window Window;
+
+  /// whether the whole (masked) image is processed, otherwise only the spans
+  bool full_frame = true;
+  RowSpans spans;
+  vector<Window> windows;
+};
+
+/// the settings of PluginRegionOfInterest, read once per frame
+struct RegionOfInterestParameters {
+  bool enabled;
+  int full_scan_interval;
+  double max_ball_speed;  //mm/s
+  double max_robot_speed; //mm/s
+  double margin;
+  double ball_radius;
+  double robot_radius;
+  double robot_height;
+};
+
+/*!
+  \class   PluginRegionOfInterest
+  \brief   Restricts the segmentation to windows around the tracked objects
+
+  At high frame rates, nearly all of each frame is unchanged field. If
+  enabled, this plugin places a window around every ball and robot that
+  was detected in the most recently completed frame of the FrameBuffer.
+  Each window is large enough to contain the object if it moved at up to
+  the configured maximum speed since then, so tracked objects are only lost
+  if they are faster than that.
+  The thresholding (and thus the run length encoding and blob finding) then
+  only processes these windows. Objects that newly enter the image are
+  found by a full frame scan, which is done every "full scan interval"
+  frames, and as soon as fewer objects are detected than in the last full
+  scan. New objects are thus found with a delay of at most that interval.
+
+  The objects that a full scan finds outside of the windows of the
+  preceding frame are counted in the settings tree, as a measure of the
+  detections that are missed in between.
+*/
+class PluginRegionOfInterest : public VisionPlugin
+{
+protected:
+  FrameDataSlot<RegionOfInterest> slot_roi{"region_of_interest"};
+  FrameDataSlot<SSL_DetectionFrame> slot_detection_frame{"ssl_detection_frame"};
+  const CameraParameters & camera_parameters;
+  ConvexHullImageMask & _image_mask;
+
+  VarList * settings;
+  VarBool * v_enabled;
+  VarInt * v_full_scan_interval;
+  VarDouble * v_max_ball_speed;
+  VarDouble * v_max_robot_speed;
+  VarDouble * v_margin;
+  VarDouble * v_ball_radius;
+  VarDouble * v_robot_radius;
+  VarDouble * v_robot_height;
+  VarList * v_statistics;
+  VarDouble * v_processed_pixels;
+  VarInt * v_full_scan_objects;
+  VarInt * v_missed_objects;
+
+  VarSnapshot<RegionOfInterestParameters> params;
+  void readParameters(RegionOfInterestParameters & p);
+
+  long long last_full_scan = -1;     //number of the last frame that was fully scanned
+  int last_width = 0;                //image size of the last processed frame
+  int last_height = 0;
+  long long last_evaluated = -1;     //number of the last completed frame that was looked at
+  int full_scan_count = 0;           //objects found by the last evaluated full scan
+  bool last_was_roi = false;         //whether the last frame was restricted to windows
+  vector<RegionOfInterest::Window> last_windows; //windows of the last frame that was restricted to windows
+  bool have_reference = false;       //whether the last full scan directly followed a restricted frame
+  vector<RegionOfInterest::Window> reference_windows; //the windows of that frame
+  long long processed_pixels = 0;
+  long long total_pixels = 0;
+  int full_scan_objects = 0;
+  int missed_objects = 0;
+
+  void addWindow(RegionOfInterest * roi, double x, double y, double z_min, double z_max, double radius,
+                 int width, int height);
+  void evaluateFullScan(const SSL_DetectionFrame & detection);
+  void buildSpans(RegionOfInterest * roi, int width, int height);
+  void updateStatistics();
+
+public:
+  PluginRegionOfInterest(FrameBuffer * _buffer, const CameraParameters & camera_params, ConvexHullImageMask & mask);
+  ~PluginRegionOfInterest() override;
+
+  ProcessResult process(FrameData * data, RenderOptions * options) override;
+  VarList * getSettings() override;
+  string getName() override;
+};
+
+#endif
@@ -19,6 +19,7 @@
 */
 //========================================================================
 #include "plugin_runlength_encode.h"
+#include "thread_pool.h"
 
 PluginRunlengthEncode::PluginRunlengthEncode(FrameBuffer * _buffer)
  : VisionPlugin(_buffer)
@@ -26,6 +27,15 @@ PluginRunlengthEncode::PluginRunlengthEncode(FrameBuffer * _buffer)
   settings=new VarList("Run length encode");
   v_max_runs = new VarInt("max runs", 50000, 10000, 1000000);
   settings->addChild(v_max_runs);
+  v_num_threads = new VarInt("number of threads", 0, 0, 64);
+  settings->addChild(v_num_threads);
+  v_compact = new VarBool("compact run layout", false);
+  settings->addChild(v_compact);
+
+  declareReads(slot_threshold);
+  declareWrites(slot_label_image);
+  declareWrites(slot_runlist);
+  declareWrites(slot_runtable);
 }
 
 
@@ -33,6 +43,36 @@ PluginRunlengthEncode::~PluginRunlengthEncode()
 {
   delete settings;
   delete v_max_runs;
+  delete v_num_threads;
+  delete v_compact;
+  for (auto stripe : stripes) {
+    delete stripe;
+  }
+}
+
+void PluginRunlengthEncode::encodeRunsParallel(Image<raw8> * img, CMVision::RunList * runlist, int num_threads) {
+  if (num_threads < 2) {
+    CMVision::RegionProcessing::encodeRuns(img, runlist);
+    return;
+  }
+
+  //every stripe gets its own list, large enough to never truncate earlier than the sequential encoder:
+  for (unsigned int k = 0; k < stripes.size(); k++) {
+    if (stripes[k]->getMaxRuns() != runlist->getMaxRuns()) {
+      delete stripes[k];
+      stripes[k] = new CMVision::RunList(runlist->getMaxRuns());
+    }
+  }
+  while ((int)stripes.size() < num_threads) {
+    stripes.push_back(new CMVision::RunList(runlist->getMaxRuns()));
+  }
+
+  int rows = img->getHeight();
+  ThreadPool::global().parallelFor(num_threads, [&](int k) {
+    CMVision::RegionProcessing::encodeRunStripe(img, (k * rows) / num_threads, ((k + 1) * rows) / num_threads, stripes[k]);
+  });
+
+  CMVision::RegionProcessing::concatenateRunStripes(runlist, stripes.data(), num_threads);
 }
 
 
@@ -40,20 +80,54 @@ PluginRunlengthEncode::~PluginRunlengthEncode()
 ProcessResult PluginRunlengthEncode::process(FrameData * data, RenderOptions * options) {
   (void)options;
 
-  CMVision::RunList * runlist = (CMVision::RunList *) data->map.get("cmv_runlist");
+  Image<raw8> * img_thresholded = data->map.get(slot_threshold);
+  if (img_thresholded == nullptr) {
+    printf("Runlength encoder: no thresholded input image found!\n");
+    return ProcessingFailed;
+  }
+
+  CMVision::LabelImage * labels = data->map.get(slot_label_image);
+  CMVision::RunList * runlist = data->map.get(slot_runlist);
   if (runlist == nullptr || runlist->getMaxRuns() != v_max_runs->get()) {
+    if (labels != nullptr && runlist != nullptr && labels->getEncodedRuns() == runlist) {
+      //the list is about to be replaced, so recover the fused labels from it first:
+      labels->get();
+      labels->setImage(img_thresholded);
+    }
     delete runlist;
-    runlist = (CMVision::RunList *) data->map.update("cmv_runlist", new CMVision::RunList(v_max_runs->getInt()));
+    runlist = data->map.update(slot_runlist, new CMVision::RunList(v_max_runs->getInt()));
   }
 
-  Image<raw8> * img_thresholded = (Image<raw8> *) data->map.get("cmv_threshold");
-  if (img_thresholded == nullptr) {
-    printf("Runlength encoder: no thresholded input image found!\n");
-    return ProcessingFailed;
+  //The blob finder uses the run table instead of the run list whenever it holds runs:
+  CMVision::RunTable * runtable = data->map.get(slot_runtable);
+  bool fused = labels != nullptr && labels->getEncodedRuns() == runlist;
+  if (v_compact->getBool()) {
+    if (runtable == nullptr || runtable->getMaxRuns() != v_max_runs->get()) {
+      delete runtable;
+      runtable = data->map.update(slot_runtable, new CMVision::RunTable(v_max_runs->getInt()));
+    }
+    if (fused) {
+      //the run list still serves to decode the label image
+      runtable->fromRunList(runlist);
+    } else {
+      runlist->setUsedRuns(0);
+      if (!CMVision::RegionProcessing::encodeRuns(img_thresholded, runtable)) {
+        return ProcessingFailed;
+      }
+    }
+    if (runtable->getUsedRuns() == runtable->getMaxRuns()) {
+      printf("Warning: runlength encoder exceeded current max run size of %d\n",runtable->getMaxRuns());
+    }
+    return ProcessingOk;
+  }
+  if (runtable != nullptr) {
+    runtable->setUsedRuns(0);
   }
 
-  //Runlength Encode the image:
-  CMVision::RegionProcessing::encodeRuns(img_thresholded, runlist);
+  //Runlength Encode the image, unless the color thresholding already did so:
+  if (!fused) {
+    encodeRunsParallel(img_thresholded, runlist, v_num_threads->getInt());
+  }
   if (runlist->getUsedRuns() == runlist->getMaxRuns()) {
     printf("Warning: runlength encoder exceeded current max run size of %d\n",runlist->getMaxRuns());
   }
@@ -66,6 +140,10 @@ VarList * PluginRunlengthEncode::getSettings() {
   return settings;
 }
 
+VarInt * PluginRunlengthEncode::getMaxRuns() {
+  return v_max_runs;
+}
+
 string PluginRunlengthEncode::getName() {
   return "RunlengthEncode";
 }
@@ -24,6 +24,7 @@
 #include <visionplugin.h>
 #include "cmvision_region.h"
 #include "timer.h"
+#include <vector>
 
 /**
 	@author Stefan Zickler
@@ -31,8 +32,16 @@
 class PluginRunlengthEncode : public VisionPlugin
 {
 protected:
+  FrameDataSlot<Image<raw8> > slot_threshold{"cmv_threshold"};
+  FrameDataSlot<CMVision::LabelImage> slot_label_image{"cmv_label_image"};
+  FrameDataSlot<CMVision::RunList> slot_runlist{"cmv_runlist"};
+  FrameDataSlot<CMVision::RunTable> slot_runtable{"cmv_runtable"};
   VarList * settings;
   VarInt * v_max_runs;
+  VarInt * v_num_threads;
+  VarBool * v_compact;
+  std::vector<CMVision::RunList *> stripes;
+  void encodeRunsParallel(Image<raw8> * img, CMVision::RunList * runlist, int num_threads);
 public:
     explicit PluginRunlengthEncode(FrameBuffer * _buffer);
 
@@ -42,6 +51,9 @@ public:
 
     VarList * getSettings() override;
 
+    //the size of the run list, also used by the fused encoding of PluginColorThreshold:
+    VarInt * getMaxRuns();
+
     string getName() override;
 };
 
@@ -24,6 +24,10 @@ PluginSSLNetworkOutput::PluginSSLNetworkOutput(FrameBuffer * _fb, RoboCupSSLServ
  : VisionPlugin(_fb), _camera_params(camera_params), _field(field)
 {
   _udp_server=udp_server;
+  //the capture time and frame number are stored in the detection frame
+  declareWrites(slot_detection_frame);
+  //keeps the packets on the server in the order of the stack:
+  declareUsesShared(_udp_server);
 }
 
 PluginSSLNetworkOutput::~PluginSSLNetworkOutput()
@@ -39,7 +43,7 @@ ProcessResult PluginSSLNetworkOutput::process(FrameData * data, RenderOptions *
 
   SSL_DetectionFrame * detection_frame = 0;
 
-  detection_frame=(SSL_DetectionFrame *)data->map.get("ssl_detection_frame");
+  detection_frame=data->map.get(slot_detection_frame);
   if (detection_frame != 0) {
     detection_frame->set_t_capture(data->time);
     detection_frame->set_frame_number(data->number);
@@ -33,6 +33,7 @@
 class PluginSSLNetworkOutput : public VisionPlugin
 {
 protected:
+ FrameDataSlot<SSL_DetectionFrame> slot_detection_frame{"ssl_detection_frame"};
  const CameraParameters& _camera_params;
  const RoboCupField& _field;
  RoboCupSSLServer * _udp_server;
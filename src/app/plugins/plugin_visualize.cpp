@@ -20,7 +20,6 @@
 //========================================================================
 #include "plugin_visualize.h"
 #include <sobel.h>
-#include <opencv2/opencv.hpp>
 #include "convex_hull.h"
 #include <mutex>
 
@@ -61,6 +60,12 @@ PluginVisualize::PluginVisualize(
   _threshold_lut=0;
   edge_image = 0;
   temp_grey_image = 0;
+
+  //the label image is decoded on first access, so reading it modifies it
+  declareReadsVideo();
+  declareReads(slot_colorlist);
+  declareWrites(slot_label_image);
+  declareWrites(slot_vis_frame);
 }
 
 
@@ -91,9 +96,10 @@ void PluginVisualize::DrawCameraImage(
         reinterpret_cast<unsigned char*>(vis_frame->data.getData()),
         data->video.getWidth(), data->video.getHeight());
   } else if (source_format==COLOR_RAW8) {
-    cv::Mat src(data->video.getWidth(), data->video.getHeight(), CV_8UC1, data->video.getData());
-    cv::Mat dst(data->video.getWidth(), data->video.getHeight(), CV_8UC3, vis_frame->data.getData());
-    cvtColor(src, dst, cv::COLOR_BayerBG2BGR);
+    Conversions::bayer2rgb(
+        data->video.getData(),
+        reinterpret_cast<unsigned char*>(vis_frame->data.getData()),
+        data->video.getWidth(), data->video.getHeight());
   } else {
     //blank it:
     vis_frame->data.fillBlack();
@@ -119,13 +125,13 @@ void PluginVisualize::DrawCameraImage(
 void PluginVisualize::DrawThresholdedImage(
     FrameData* data, VisualizationFrame* vis_frame) {
   if (_threshold_lut != 0) {
-    Image<raw8>* img_thresholded =
-        reinterpret_cast<Image<raw8>*>(data->map.get("cmv_threshold"));
+    CMVision::LabelImage* labels = data->map.get(slot_label_image);
+    const Image<raw8>* img_thresholded = (labels != 0) ? labels->get() : 0;
     if (img_thresholded != 0) {
       int n = vis_frame->data.getNumPixels();
       if (img_thresholded->getNumPixels() == n) {
         rgb * vis_ptr = vis_frame->data.getPixelData();
-        raw8 * seg_ptr = img_thresholded->getPixelData();
+        const raw8 * seg_ptr = img_thresholded->getPixelData();
         for (int i = 0; i < n; i++) {
           if (seg_ptr[i].getIntensity() != 0) {
             vis_ptr[i] = _threshold_lut->getChannel(
@@ -139,9 +145,7 @@ void PluginVisualize::DrawThresholdedImage(
 
 void PluginVisualize::DrawBlobs(
     FrameData* data, VisualizationFrame* vis_frame) {
-  CMVision::ColorRegionList* colorlist =
-      reinterpret_cast<CMVision::ColorRegionList*>(
-          data->map.get("cmv_colorlist"));
+  CMVision::ColorRegionList* colorlist = data->map.get(slot_colorlist);
   if (colorlist != 0) {
     CMVision::RegionLinkedList * regionlist;
     regionlist = colorlist->getColorRegionArrayPointer();
@@ -389,11 +393,9 @@ ProcessResult PluginVisualize::process(
     FrameData* data, RenderOptions* options) {
   if (data == 0) return ProcessingFailed;
 
-  VisualizationFrame* vis_frame =
-      reinterpret_cast<VisualizationFrame*>(data->map.get("vis_frame"));
+  VisualizationFrame* vis_frame = data->map.get(slot_vis_frame);
   if (vis_frame == 0) {
-    vis_frame = reinterpret_cast<VisualizationFrame*>(
-        data->map.insert("vis_frame",new VisualizationFrame()));
+    vis_frame = data->map.insert(slot_vis_frame, new VisualizationFrame());
   }
 
   if (_v_enabled->getBool()) {
@@ -54,6 +54,9 @@ class VisualizationFrame {
 class PluginVisualize : public VisionPlugin
 {
 protected:
+  FrameDataSlot<VisualizationFrame> slot_vis_frame{"vis_frame"};
+  FrameDataSlot<CMVision::LabelImage> slot_label_image{"cmv_label_image"};
+  FrameDataSlot<CMVision::ColorRegionList> slot_colorlist{"cmv_colorlist"};
   VarList * _settings;
   VarBool * _v_enabled;
   VarBool * _v_image;
@@ -21,12 +21,15 @@
 
 #include "visionplugin.h"
 
+const int VisionPlugin::VIDEO_DEPENDENCY;
+
 VisionPlugin::VisionPlugin(FrameBuffer * _buffer)
 {
   buffer=_buffer;
   enabled=true;
   shared=false;
   visualize=true;
+  dependencies_declared=false;
   setTimeProcessing(0.0);
   setTimePostProcessing(0.0);
 }
@@ -76,6 +79,43 @@ void VisionPlugin::setSharedAmongStacks(bool enable) {
   shared=enable;
 }
 
+void VisionPlugin::declareReadsVideo() {
+  dependencies_declared=true;
+  dependency_reads.push_back(VIDEO_DEPENDENCY);
+}
+
+void VisionPlugin::declareWritesVideo() {
+  dependencies_declared=true;
+  dependency_writes.push_back(VIDEO_DEPENDENCY);
+}
+
+void VisionPlugin::declareNoFrameData() {
+  dependencies_declared=true;
+}
+
+void VisionPlugin::declareUsesShared(const void * object) {
+  dependencies_declared=true;
+  dependency_shared.push_back(object);
+}
+
+template <class T>
+static bool intersects(const vector<T> & a, const vector<T> & b) {
+  for (const T & x : a) {
+    for (const T & y : b) {
+      if (x == y) return true;
+    }
+  }
+  return false;
+}
+
+bool VisionPlugin::conflictsWith(const VisionPlugin * other) const {
+  if (other == this || !dependencies_declared || !other->dependencies_declared) return true;
+  return intersects(dependency_writes, other->dependency_writes) ||
+         intersects(dependency_writes, other->dependency_reads) ||
+         intersects(dependency_reads, other->dependency_writes) ||
+         intersects(dependency_shared, other->dependency_shared);
+}
+
 void VisionPlugin::displayLoopEvent(bool frame_changed, RenderOptions * opts) {
   (void)frame_changed;
   (void)opts;
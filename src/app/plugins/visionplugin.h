@@ -26,6 +26,7 @@
 #include <QMutex>
 #include <QObject>
 #include <string>
+#include <vector>
 
 #include "VarTypes.h"
 #include "framedata.h"
@@ -58,7 +59,39 @@ protected:
     FrameBuffer * buffer;
     double time_proc;
     double time_post;
+
+    /// the FrameData entries that process() accesses, see declareReads()
+    bool dependencies_declared;
+    vector<int> dependency_reads;
+    vector<int> dependency_writes;
+    vector<const void *> dependency_shared;
+
+    /// declares that process() reads the entry of \p slot. Plugins that declare
+    /// their accesses may be run concurrently with other plugins of the stack
+    /// that don't write what they read, and don't access what they write.
+    /// Plugins without any declarations are always run on their own.
+    template <class T> void declareReads(const FrameDataSlot<T> & slot) {
+      dependencies_declared = true;
+      dependency_reads.push_back(slot.getId());
+    }
+    /// declares that process() writes (or otherwise modifies) the entry of \p slot
+    template <class T> void declareWrites(const FrameDataSlot<T> & slot) {
+      dependencies_declared = true;
+      dependency_writes.push_back(slot.getId());
+    }
+    /// same for the FrameData::video image
+    void declareReadsVideo();
+    void declareWritesVideo();
+    /// declares that process() doesn't access the FrameData at all (apart from
+    /// its number and time, which don't change while the frame is processed)
+    void declareNoFrameData();
+    /// declares that process() uses \p object, which is shared with other plugins
+    /// outside of the FrameData (e.g. a network server). Plugins that use the same
+    /// object are run in the order of the stack.
+    void declareUsesShared(const void * object);
 public:
+    /// the id that stands for FrameData::video among the declared entries
+    static const int VIDEO_DEPENDENCY = -1;
 
 
     VisionPlugin(FrameBuffer * _buffer);
@@ -93,6 +126,10 @@ public:
     virtual bool isSharedAmongStacks() const;
     virtual void setSharedAmongStacks(bool enable);
 
+    /// whether process() of this plugin may not run at the same time as that of
+    /// \p other, on the same frame. True unless both declared their accesses.
+    bool conflictsWith(const VisionPlugin * other) const;
+
     /// this function will be called about many times/s on your plugin
     /// in most cases you might want to only trigger a render if frame_changed==true
     /// which should occur with the same frequency as your camera input
@@ -156,6 +193,8 @@ public:
     virtual void mouseMoveEvent ( QMouseEvent * event, pixelloc loc );
     virtual void wheelEvent ( QWheelEvent * event, pixelloc loc );
 
+    /// durations of the last process(...) and postProcess(...) calls in seconds,
+    /// these are set by the parent-stack
     void setTimeProcessing(double val);
     void setTimePostProcessing(double val);
     double getTimeProcessing();
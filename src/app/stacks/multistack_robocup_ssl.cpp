@@ -96,7 +96,9 @@ MultiStackRoboCupSSL::MultiStackRoboCupSSL(RenderOptions *_opts, int num_normal_
     //      update the plugin_colorcalib.cpp code to safely reallocate and copy their
     //      data instead of assuming that format and size is uniform across
     //      cameras -- added when LUTs became aware of other cameras (Zavesky, 2/16)
-    threads[i]->setFrameBuffer(new FrameBuffer(3));
+    //with pipelined processing, the two extra stages each hold a frame, and the
+    //reader and the most recently completed frame need bins of their own:
+    threads[i]->setFrameBuffer(new FrameBuffer(6));
     threads[i]->setStack(
         new StackRoboCupSSL(
             _opts,threads[i]->getFrameBuffer(),
@@ -48,11 +48,13 @@ StackRoboCupSSL::StackRoboCupSSL(
   lut_yuv = new YUVLUT(4,6,6,cam_settings_filename + "-lut-yuv.xml");
   lut_yuv->loadRoboCupChannels(LUTChannelMode_Numeric);
   lut_yuv->addDerivedLUT(new RGBLUT(5,5,5,""));
+  lut_yuv->addDerivedLUT(new BayerLUT(BayerLUT::PATTERN_RGGB,5,5,5,""));
   settings->addChild(lut_yuv->getSettings());
 
   camera_parameters = new CameraParameters(_camera_id, global_field);
   _image_mask = new ConvexHullImageMask(cam_settings_filename + "-mask.xml");
   settings->addChild(_image_mask->getSettings());
+  label_integral = new CMVision::IntegralHistogram();
 
   _global_plugin_publish_geometry->addCameraParameters(camera_parameters);
   _legacy_plugin_publish_geometry->addCameraParameters(camera_parameters);
@@ -68,15 +70,25 @@ StackRoboCupSSL::StackRoboCupSSL(
 
   stack.push_back(new PluginCameraCalibration(_fb,*camera_parameters, *global_field));
 
-  stack.push_back(new PluginColorThreshold(_fb,lut_yuv, *_image_mask));
+  // pipelined processing: segmentation and blob finding
+  beginPipelineStage();
 
-  stack.push_back(new PluginRunlengthEncode(_fb));
+  stack.push_back(new PluginRegionOfInterest(_fb, *camera_parameters, *_image_mask));
+
+  auto *pluginRunlengthEncode = new PluginRunlengthEncode(_fb);
+
+  stack.push_back(new PluginColorThreshold(_fb,lut_yuv, *_image_mask, pluginRunlengthEncode->getMaxRuns()));
+
+  stack.push_back(pluginRunlengthEncode);
 
   stack.push_back(new PluginFindBlobs(_fb,lut_yuv));
 
-  stack.push_back(new PluginDetectRobots(_fb,lut_yuv,*camera_parameters,*global_field,global_team_selector_blue,global_team_selector_yellow, global_team_settings));
+  // pipelined processing: detection and output
+  beginPipelineStage();
+
+  stack.push_back(new PluginDetectRobots(_fb,lut_yuv,*camera_parameters,*global_field,global_team_selector_blue,global_team_selector_yellow, global_team_settings, label_integral));
 
-  stack.push_back(new PluginDetectBalls(_fb,lut_yuv,*camera_parameters,*global_field,global_ball_settings));
+  stack.push_back(new PluginDetectBalls(_fb,lut_yuv,*camera_parameters,*global_field,global_ball_settings,label_integral));
 
   stack.push_back(new PluginAutoColorCalibration(_fb,lut_yuv, (LUTWidget*) pluginColorCalibration->getControlWidget()));
 
@@ -102,8 +114,18 @@ StackRoboCupSSL::StackRoboCupSSL(
 string StackRoboCupSSL::getSettingsFileName() {
   return _cam_settings_filename;
 }
+CameraParameters * StackRoboCupSSL::getCameraParameters() const {
+  return camera_parameters;
+}
+YUVLUT * StackRoboCupSSL::getLUT() const {
+  return lut_yuv;
+}
+ConvexHullImageMask * StackRoboCupSSL::getImageMask() const {
+  return _image_mask;
+}
 StackRoboCupSSL::~StackRoboCupSSL() {
   delete lut_yuv;
   delete camera_parameters;
+  delete label_integral;
 }
 
@@ -29,6 +29,7 @@
 #include "plugin_colorcalib.h"
 #include "plugin_cameracalib.h"
 #include "plugin_visualize.h"
+#include "plugin_region_of_interest.h"
 #include "plugin_colorthreshold.h"
 #include "plugin_runlength_encode.h"
 #include "plugin_find_blobs.h"
@@ -61,6 +62,8 @@ class StackRoboCupSSL : public VisionStack {
   CameraParameters* camera_parameters;
   RoboCupField * global_field;
   ConvexHullImageMask *_image_mask;
+  //shared by the histogram checks of the ball and robot detection, which run one frame at a time:
+  CMVision::IntegralHistogram * label_integral;
   PluginDetectBallsSettings * global_ball_settings;
   CMPattern::TeamDetectorSettings * global_team_settings;
   CMPattern::TeamSelector * global_team_selector_blue;
@@ -84,6 +87,9 @@ class StackRoboCupSSL : public VisionStack {
                   RoboCupSSLServer* ds_udp_server_old,
                   string cam_settings_filename);
   virtual string getSettingsFileName();
+  CameraParameters * getCameraParameters() const;
+  YUVLUT * getLUT() const;
+  ConvexHullImageMask * getImageMask() const;
   virtual ~StackRoboCupSSL();
 };
 
@@ -19,60 +19,229 @@
 */
 //========================================================================
 #include "visionstack.h"
-#include <iomanip>
-#include <iostream>
-#include <chrono>
+#include "thread_pool.h"
+#include <algorithm>
 
 VisionStack::VisionStack(RenderOptions * _opts) {
   opts=_opts;
   settings=new VarList("Global");
-  // timings should only be printed on demand for a short period of time by temporally activating this flag
+  // prints the latency percentiles once per statistics update while enabled
   _v_print_timings = new VarBool("print stack timings", false);
   settings->addChild(_v_print_timings);
+  // overlap the processing of consecutive frames, see beginPipelineStage()
+  _v_pipelined = new VarBool("pipelined processing", false);
+  settings->addChild(_v_pipelined);
+  // run plugins that don't share any FrameData entries at the same time, see getSchedule()
+  _v_parallel_plugins = new VarBool("parallel plugins", false);
+  settings->addChild(_v_parallel_plugins);
+  _v_latency = new VarList("Latency");
+  _v_latency->addFlags(VARTYPE_FLAG_NOSTORE);
+  settings->addChild(_v_latency);
+  frame_latency = nullptr;
 }
 
 VisionStack::~VisionStack() {
+  stopPipeline();
   delete settings;
+  for (auto l : plugin_latency) delete l;
+  delete frame_latency;
+}
+
+void VisionStack::initLatencyStatistics() {
+  //the plugins are only known once the derived stack is constructed:
+  std::call_once(latency_once, [this] {
+    for (auto p : stack) {
+      plugin_latency.push_back(new LatencyStatistics(p->getName()));
+      _v_latency->addChild(plugin_latency.back()->getSettings());
+    }
+    frame_latency = new LatencyStatistics("All");
+    _v_latency->addChild(frame_latency->getSettings());
+  });
 }
 
 VarList * VisionStack::getSettings() {
+  initLatencyStatistics();
   return settings;
 }
 
-void VisionStack::process(FrameData * data) {
-  if(_v_print_timings->getBool()) {
-    auto totalStart = std::chrono::steady_clock::now();
-    for (auto p : stack) {
-      p->lock();
-      auto start = std::chrono::steady_clock::now();
-      p->process(data,opts);
-      auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
-      std::cout << std::setw(23) << std::left << p->getName()
-                << std::setw(5) << std::right << duration.count() << " μs" << std::endl;
-      p->unlock();
+const VisionStack::Schedule & VisionStack::getSchedule(unsigned int first, unsigned int last) {
+  std::lock_guard<std::mutex> lock(schedule_mutex);
+  auto iter = schedules.find(std::make_pair(first,last));
+  if (iter != schedules.end()) return iter->second;
+
+  //each plugin goes one level after the last plugin before it that it conflicts with,
+  //so conflicting plugins still run in the order of the stack:
+  Schedule & schedule = schedules[std::make_pair(first,last)];
+  vector<unsigned int> level(last - first, 0);
+  for (unsigned int j=first;j<last;j++) {
+    for (unsigned int i=first;i<j;i++) {
+      if (stack[j]->conflictsWith(stack[i])) level[j - first] = std::max(level[j - first], level[i - first] + 1);
     }
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - totalStart);
-    std::cout << std::setw(23) << std::left << "All"
-              << std::setw(5) << std::right << duration.count() << " μs" << std::endl << std::endl;
-  } else {
-    for (auto p : stack) {
-      p->lock();
-      p->process(data,opts);
-      p->unlock();
+    if (level[j - first] >= schedule.size()) schedule.resize(level[j - first] + 1);
+    schedule[level[j - first]].push_back(j);
+  }
+  return schedule;
+}
+
+void VisionStack::processPlugin(unsigned int i, FrameData * data) {
+  VisionPlugin * p=stack[i];
+  p->lock();
+  auto start = std::chrono::steady_clock::now();
+  p->process(data,opts);
+  auto duration = std::chrono::steady_clock::now() - start;
+  p->setTimeProcessing(std::chrono::duration<double>(duration).count());
+  plugin_latency[i]->histogram.record(duration);
+  p->unlock();
+}
+
+void VisionStack::processRange(unsigned int first, unsigned int last, FrameData * data) {
+  if (!_v_parallel_plugins->getBool()) {
+    for (unsigned int i=first;i<last;i++) processPlugin(i,data);
+    return;
+  }
+
+  //concurrent plugins may insert new entries, which must not grow the table:
+  data->map.reserve();
+  for (const auto & level : getSchedule(first,last)) {
+    if (level.size() == 1) {
+      processPlugin(level[0],data);
+    } else {
+      ThreadPool::global().parallelFor(level.size(), [&](int k) { processPlugin(level[k],data); });
     }
   }
 }
 
+void VisionStack::process(FrameData * data) {
+  initLatencyStatistics();
+  auto start = std::chrono::steady_clock::now();
+  processRange(0,stack.size(),data);
+  frame_latency->histogram.record(std::chrono::steady_clock::now() - start);
+}
+
 void VisionStack::postProcess(FrameData * data) {
   for (auto p : stack) {
     p->lock();
+    auto start = std::chrono::steady_clock::now();
     p->postProcess(data,opts);
+    p->setTimePostProcessing(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
     p->unlock();
   }
 }
 
 void VisionStack::updateTimingStatistics() {
+  initLatencyStatistics();
+  for (auto l : plugin_latency) l->update();
+  frame_latency->update();
+  if (_v_print_timings->getBool()) {
+    LatencyStatistics::print(getLatencyStatistics());
+  }
+}
+
+vector<LatencyStatistics *> VisionStack::getLatencyStatistics() {
+  initLatencyStatistics();
+  vector<LatencyStatistics *> res = plugin_latency;
+  res.push_back(frame_latency);
+  return res;
+}
 
+void VisionStack::beginPipelineStage() {
+  stage_begin.push_back(stack.size());
+}
+
+bool VisionStack::isPipelined() const {
+  return _v_pipelined->getBool() && !stage_begin.empty();
+}
+
+void VisionStack::processPipelined(FrameData * data, const std::function<void(FrameData *)> & done) {
+  if (stages.size() != stage_begin.size()) {
+    stopPipeline();
+    for (unsigned int i=0;i<stage_begin.size();i++) {
+      PipelineStage * stage = new PipelineStage();
+      stage->first = stage_begin[i];
+      stage->last = (i + 1 < stage_begin.size()) ? stage_begin[i + 1] : stack.size();
+      stages.push_back(stage);
+    }
+    for (unsigned int i=0;i<stages.size();i++) {
+      stages[i]->thread = std::thread(&VisionStack::runStage, this, i);
+    }
+  }
+
+  initLatencyStatistics();
+  auto start = std::chrono::steady_clock::now();
+  processRange(0,stage_begin[0],data);
+  handOff(0,data,done,start);
+}
+
+void VisionStack::handOff(unsigned int stage, FrameData * data, const std::function<void(FrameData *)> & done,
+                          std::chrono::steady_clock::time_point start) {
+  PipelineStage * s = stages[stage];
+  std::unique_lock<std::mutex> lock(s->mutex);
+  //wait for the previous frame to leave this stage:
+  s->cond.wait(lock, [s] { return s->frame == nullptr; });
+  s->frame = data;
+  s->done = done;
+  s->start = start;
+  s->cond.notify_all();
+}
+
+void VisionStack::runStage(unsigned int stage) {
+  PipelineStage * s = stages[stage];
+  bool is_last = (stage + 1 == stages.size());
+  while (true) {
+    FrameData * data;
+    std::function<void(FrameData *)> done;
+    std::chrono::steady_clock::time_point start;
+    {
+      std::unique_lock<std::mutex> lock(s->mutex);
+      s->cond.wait(lock, [s] { return s->frame != nullptr || s->quit; });
+      if (s->frame == nullptr) return;
+      data = s->frame;
+      done = s->done;
+      start = s->start;
+    }
+
+    processRange(s->first,s->last,data);
+    if (is_last) {
+      frame_latency->histogram.record(std::chrono::steady_clock::now() - start);
+      postProcess(data);
+      done(data);
+    } else {
+      handOff(stage + 1,data,done,start);
+    }
+
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->frame = nullptr;
+    s->cond.notify_all();
+  }
+}
+
+bool VisionStack::isInPipeline(const FrameData * data) {
+  for (auto s : stages) {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    if (s->frame == data) return true;
+  }
+  return false;
+}
+
+void VisionStack::waitForPipeline() {
+  for (auto s : stages) {
+    std::unique_lock<std::mutex> lock(s->mutex);
+    s->cond.wait(lock, [s] { return s->frame == nullptr; });
+  }
+}
+
+void VisionStack::stopPipeline() {
+  waitForPipeline();
+  for (auto s : stages) {
+    {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->quit = true;
+    }
+    s->cond.notify_all();
+    s->thread.join();
+    delete s;
+  }
+  stages.clear();
 }
 
 void VisionStack::keyPressEvent ( QKeyEvent * event ) {
@@ -24,6 +24,14 @@
 #include "visionplugin.h"
 #include "framedata.h"
 #include "timer.h"
+#include "latency_histogram.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 using namespace std;
 
 /*!
@@ -36,6 +44,48 @@ protected:
   RenderOptions * opts;
   VarList * settings;
   VarBool * _v_print_timings;
+  VarBool * _v_pipelined;
+  VarBool * _v_parallel_plugins;
+  VarList * _v_latency;
+
+  /// latency of each plugin, in the order of the stack, and of all of them together
+  vector<LatencyStatistics *> plugin_latency;
+  LatencyStatistics * frame_latency;
+  std::once_flag latency_once;
+  void initLatencyStatistics();
+
+  /// a pipeline stage after the first one, running on its own thread
+  struct PipelineStage {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned int first;
+    unsigned int last;
+    FrameData * frame = nullptr; //the frame in this stage, nullptr if idle
+    std::chrono::steady_clock::time_point start; //when the frame entered the pipeline
+    std::function<void(FrameData *)> done;
+    bool quit = false;
+  };
+  vector<unsigned int> stage_begin;
+  vector<PipelineStage *> stages;
+
+  /// the plugins [first,last) grouped into levels. The plugins of a level don't
+  /// conflict with each other, and each one only conflicts with plugins of
+  /// earlier levels, see VisionPlugin::conflictsWith()
+  typedef vector<vector<unsigned int> > Schedule;
+  std::mutex schedule_mutex;
+  std::map<std::pair<unsigned int, unsigned int>, Schedule> schedules;
+  const Schedule & getSchedule(unsigned int first, unsigned int last);
+
+  void processPlugin(unsigned int i, FrameData * data);
+  void processRange(unsigned int first, unsigned int last, FrameData * data);
+  void handOff(unsigned int stage, FrameData * data, const std::function<void(FrameData *)> & done,
+               std::chrono::steady_clock::time_point start);
+  void runStage(unsigned int stage);
+  void stopPipeline();
+
+  /// starts a new pipeline stage with the next plugin that is added to the stack
+  void beginPipelineStage();
 public:
     VisionStack(RenderOptions * _opts);
     virtual ~VisionStack();
@@ -45,7 +95,28 @@ public:
 
     void process(FrameData * data);
     void postProcess(FrameData * data);
+
+    /// publishes the latencies since the last call to the settings tree,
+    /// should be called periodically (e.g. once per second)
     void updateTimingStatistics();
+    /// the latencies as of the last updateTimingStatistics()
+    vector<LatencyStatistics *> getLatencyStatistics();
+
+    /// whether frames should be processed with processPipelined()
+    bool isPipelined() const;
+
+    /// runs the first stage on the calling thread and hands the frame on to the
+    /// next stage as soon as that one is idle. The last stage also runs all
+    /// postProcess() functions and then calls \p done.
+    /// Each stage only works on one frame at a time, so the plugins still see
+    /// the frames one by one and in order.
+    void processPipelined(FrameData * data, const std::function<void(FrameData *)> & done);
+
+    /// whether \p data is still being processed by one of the pipeline stages
+    bool isInPipeline(const FrameData * data);
+
+    /// blocks until all frames have left the pipeline
+    void waitForPipeline();
 
     virtual void keyPressEvent ( QKeyEvent * event );
     virtual void mousePressEvent ( QMouseEvent * event, pixelloc loc );
@@ -0,0 +1,823 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    main.cpp
+  \brief   vision-bench: replays recorded frames through the vision stacks
+           without a GUI and reports the throughput and plugin latencies.
+*/
+//========================================================================
+
+#include <QApplication>
+#include <QString>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+#include "qgetopt.h"
+#include "VarXML.h"
+#include "capture_thread.h"
+#include "multistacks.h"
+#include "renderoptions.h"
+#include "thread_pool.h"
+#include "latency_histogram.h"
+#include "ringbuffer.h"
+#include "lockfree_ringbuffer.h"
+#include "cmvision_region_tree.h"
+#include "conversions.h"
+#include "simd_dispatch.h"
+
+//counts every heap allocation, for the allocation check (-g):
+static std::atomic<long long> allocation_count(0);
+
+void * operator new(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  void * p = malloc(size > 0 ? size : 1);
+  if (p == 0) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void * p) noexcept {
+  free(p);
+}
+
+void operator delete(void * p, size_t) noexcept {
+  free(p);
+}
+
+struct BenchResult {
+  long long frames = 0;
+  double seconds = 0.0;
+};
+
+static VarType * findPath(VarType * root, const vector<string> & path) {
+  VarType * v = root;
+  for (unsigned int i = 0; i < path.size() && v != 0; i++) {
+    v = v->findChild(path[i]);
+  }
+  if (v == 0) {
+    fprintf(stderr, "vision-bench: setting '%s' not found\n", path.back().c_str());
+  }
+  return v;
+}
+
+static VarType * findPluginSetting(VisionStack * stack, const string & plugin, const vector<string> & path) {
+  for (auto p : stack->stack) {
+    if (p->getName() == plugin && p->getSettings() != 0) return findPath(p->getSettings(), path);
+  }
+  fprintf(stderr, "vision-bench: plugin '%s' not found\n", plugin.c_str());
+  return 0;
+}
+
+/// feeds \p num_frames frames of the thread's capture module through its stack
+/// as fast as possible, with the same steps as CaptureThread::run()
+static void runCamera(CaptureThread * thread, long long num_frames, bool zero_copy, BenchResult * result) {
+  CaptureInterface * capture = thread->getCapture();
+  VisionStack * stack = thread->getStack();
+  FrameBuffer * rb = thread->getFrameBuffer();
+
+  auto start = std::chrono::steady_clock::now();
+  long long n;
+  for (n = 0; n < num_frames; n++) {
+    int idx = rb->curWrite();
+    FrameData * d = rb->getPointer(idx);
+    RawImage pic_raw = capture->getFrame();
+    if (!CaptureThread::captureFrame(capture, pic_raw, d, stack, zero_copy)) {
+      fprintf(stderr, "vision-bench: unable to convert frame %lld\n", n);
+      capture->releaseFrame();
+      break;
+    }
+    d->number = n;
+    CaptureThread::processFrame(stack, rb, idx, []() {});
+    capture->releaseFrame();
+  }
+  stack->waitForPipeline();
+
+  result->frames = n;
+  result->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// runs the marker queries of the robot detection on a synthetic crowded frame with
+/// \p num_robots robots (a center and four markers each) and as many clutter blobs,
+/// once with the NKDTree and once with the RegionGrid. Returns false if they disagree.
+static bool benchRegionQueries(int num_robots, int num_frames) {
+  const float query_dist = 20.0f;
+  const int max_detections = 16;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> x_dist(0.0f, 1280.0f);
+  std::uniform_real_distribution<float> y_dist(0.0f, 1024.0f);
+  std::uniform_real_distribution<float> angle_dist(0.0f, 6.2831853f);
+
+  vector<CMVision::Region> regions;
+  vector<int> centers;
+  for (int i = 0; i < num_robots; i++) {
+    CMVision::Region r = CMVision::Region();
+    r.cen_x = x_dist(rng);
+    r.cen_y = y_dist(rng);
+    centers.push_back(regions.size());
+    regions.push_back(r);
+    float a = angle_dist(rng);
+    for (int k = 0; k < 4; k++) {
+      CMVision::Region m = r;
+      m.cen_x += 9.0f * cos(a + k * 1.5707963f);
+      m.cen_y += 9.0f * sin(a + k * 1.5707963f);
+      regions.push_back(m);
+    }
+    CMVision::Region clutter = CMVision::Region();
+    clutter.cen_x = x_dist(rng);
+    clutter.cen_y = y_dist(rng);
+    regions.push_back(clutter);
+  }
+
+  CMVision::RegionTree tree;
+  vector<vector<std::pair<double, CMVision::Region *> > > results[2];
+  double seconds[2];
+  for (int use_grid = 0; use_grid < 2; use_grid++) {
+    tree.setUseGrid(use_grid != 0, query_dist);
+    results[use_grid].resize(centers.size());
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < num_frames; f++) {
+      tree.clear();
+      for (auto & r : regions) tree.add(&r);
+      tree.build();
+      for (unsigned int c = 0; c < centers.size(); c++) {
+        auto & hits = results[use_grid][c];
+        hits.clear();
+        double d;
+        CMVision::Region * reg;
+        tree.startQuery(regions[centers[c]], query_dist);
+        while ((reg = tree.getNextNearest(d)) != 0 && (int)hits.size() < max_detections) {
+          hits.push_back(std::make_pair(d, reg));
+        }
+        tree.endQuery();
+      }
+    }
+    seconds[use_grid] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  //regions at the same distance may come in a different order:
+  for (int i = 0; i < 2; i++) {
+    for (auto & hits : results[i]) std::sort(hits.begin(), hits.end());
+  }
+  bool same = results[0] == results[1];
+  printf("Marker queries for %d robots, %d regions: NKDTree %.1f us/frame, grid %.1f us/frame, results %s\n",
+         num_robots, (int)regions.size(), seconds[0] / num_frames * 1e6, seconds[1] / num_frames * 1e6,
+         same ? "identical" : "DIFFERENT");
+  return same;
+}
+
+/// runs the full image conversions on a synthetic 1280x1024 frame \p num_frames times
+/// with each instruction set up to the current level (see -l). Returns false if any of them differs from
+/// the scalar version.
+static bool benchConversions(int num_frames) {
+  const int width = 1280;
+  const int height = 1024;
+  const int n = width * height;
+  std::mt19937 rng(1);
+  vector<unsigned char> input(3 * n);
+  for (auto & b : input) b = rng();
+
+  typedef void (*Conversion)(unsigned char *, unsigned char *, int, int);
+  struct Kernel {
+    const char * name;
+    Conversion convert;
+    int output_bytes;
+  };
+  const Kernel kernels[] = {
+    { "uyvy2rgb", Conversions::uyvy2rgb, 3 * n },
+    { "yuyv2rgb", Conversions::yuyv2rgb, 3 * n },
+    { "rgb2uyvy", Conversions::rgb2uyvy, 2 * n },
+    { "rgb2yuyv", Conversions::rgb2yuyv, 2 * n },
+    { "y2rgb", Conversions::y2rgb, 3 * n },
+    { "bgr2rgb", Conversions::bgr2rgb, 3 * n },
+    { "bayer2rgb", [](unsigned char * src, unsigned char * dest, int w, int h) {
+        Conversions::bayer2rgb(src, dest, w, h);
+      }, 3 * n },
+  };
+  SimdDispatch::SimdLevel max_level = SimdDispatch::getLevel();
+  bool all_same = true;
+  for (const Kernel & k : kernels) {
+    vector<unsigned char> reference;
+    printf("%-10s", k.name);
+    for (int level = SimdDispatch::SIMD_NONE; level <= max_level; level++) {
+      SimdDispatch::setLevel((SimdDispatch::SimdLevel)level);
+      vector<unsigned char> output(k.output_bytes);
+      auto start = std::chrono::steady_clock::now();
+      for (int f = 0; f < num_frames; f++) {
+        k.convert(input.data(), output.data(), width, height);
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      bool same = true;
+      if (level == SimdDispatch::SIMD_NONE) {
+        reference.swap(output);
+      } else {
+        same = output == reference;
+        all_same = all_same && same;
+      }
+      printf("  %s %.2f ms%s", SimdDispatch::getLevelName((SimdDispatch::SimdLevel)level), seconds / num_frames * 1e3, same ? "" : " (DIFFERENT)");
+    }
+    printf("\n");
+  }
+  SimdDispatch::setLevel(max_level);
+  printf("Results %s\n", all_same ? "identical" : "DIFFERENT");
+  return all_same;
+}
+
+/// splits a synthetic 1280x1024 frame into one band per hardware thread and sums
+/// each band \p num_frames times, once dispatched through a ThreadPool and once
+/// by spawning a thread per band for every frame, and prints the per-frame latencies.
+/// Returns false if the two disagree on the sums.
+static bool benchThreadDispatch(int num_frames) {
+  const int width = 1280;
+  const int height = 1024;
+  std::mt19937 rng(1);
+  vector<unsigned char> image(width * height);
+  for (auto & b : image) b = rng();
+
+  //at least one worker, so that there is something to dispatch:
+  ThreadPool pool(std::max((int)std::thread::hardware_concurrency() - 1, 1));
+  int num_bands = pool.getNumWorkers() + 1;
+  vector<long long> sums(num_bands);
+  auto sumBand = [&](int band) {
+    long long sum = 0;
+    int end = height * (band + 1) / num_bands * width;
+    for (int i = height * band / num_bands * width; i < end; i++) sum += image[i];
+    sums[band] = sum;
+  };
+
+  const char * names[2] = { "thread pool", "spawned threads" };
+  long long totals[2];
+  for (int spawn = 0; spawn < 2; spawn++) {
+    LatencyHistogram latencies;
+    totals[spawn] = 0;
+    for (int f = 0; f < num_frames; f++) {
+      auto start = std::chrono::steady_clock::now();
+      if (spawn) {
+        vector<std::thread> threads;
+        for (int band = 1; band < num_bands; band++) threads.emplace_back(sumBand, band);
+        sumBand(0);
+        for (auto & t : threads) t.join();
+      } else {
+        pool.parallelFor(num_bands, sumBand);
+      }
+      latencies.record(std::chrono::steady_clock::now() - start);
+      for (long long sum : sums) totals[spawn] += sum;
+    }
+    LatencyHistogram::Summary s = latencies.summarize();
+    printf("%-16s %d bands: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           names[spawn], num_bands, s.p50, s.p99, s.max);
+  }
+  bool same = totals[0] == totals[1];
+  printf("Results %s\n", same ? "identical" : "DIFFERENT");
+  return same;
+}
+
+/// one writer moves through \p buffer \p num_writes times, while \p num_readers
+/// threads keep skipping to its most recent bin, like the displays of a capture
+/// thread's FrameBuffer. Prints the latency of the writer's nextWrite() and the read rate.
+template <class Buffer>
+static void benchRingBuffer(const char * name, Buffer & buffer, int num_readers, int num_writes) {
+  LatencyHistogram write_latencies;
+  std::atomic<bool> done(false);
+  std::atomic<long long> reads(0);
+  vector<std::thread> readers;
+  for (int r = 0; r < num_readers; r++) {
+    readers.emplace_back([&]() {
+      long long n = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        buffer.nextRead(true);
+        n++;
+      }
+      reads += n;
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_writes; i++) {
+    auto t = std::chrono::steady_clock::now();
+    int idx = buffer.nextWrite(true);
+    write_latencies.record(std::chrono::steady_clock::now() - t);
+    *buffer.getPointer(idx) = i;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  done = true;
+  for (auto & t : readers) t.join();
+
+  LatencyHistogram::Summary s = write_latencies.summarize();
+  printf("%-10s %d readers: nextWrite p50 %.3f us, p99 %.3f us, max %.1f us, %.1f M reads/s\n",
+         name, num_readers, s.p50, s.p99, s.max, seconds > 0.0 ? reads / seconds * 1e-6 : 0.0);
+}
+
+/// projects \p num_pixels random pixels of every camera with the projection grid and
+/// with CameraParameters::image2fieldExact(), at the field, the ball and the maximum
+/// robot height, and prints the largest deviation. Returns false if there is no grid.
+static bool benchProjection(MultiStackRoboCupSSL * multi_stack, int num_cameras, double ball_height, int num_pixels) {
+  const double max_robot_height = 150.0;
+  const double heights[3] = { 0.0, ball_height, max_robot_height };
+  bool ok = true;
+  for (int i = 0; i < num_cameras; i++) {
+    StackRoboCupSSL * stack = dynamic_cast<StackRoboCupSSL *>(multi_stack->threads[i]->getStack());
+    if (stack == 0) continue;
+    const CameraParameters * params = stack->getCameraParameters();
+    int width = params->additional_calibration_information->imageWidth->getInt();
+    int height = params->additional_calibration_information->imageHeight->getInt();
+
+    //the grid is built in the background:
+    CameraParameters::FrameProjection projection = params->getFrameProjection();
+    for (int wait = 0; wait < 500 && !projection.hasGrid(); wait++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      projection = params->getFrameProjection();
+    }
+    if (!projection.hasGrid()) {
+      fprintf(stderr, "vision-bench: no projection grid for camera %d\n", i);
+      ok = false;
+      continue;
+    }
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> x_dist(0.0, width);
+    std::uniform_real_distribution<double> y_dist(0.0, height);
+    printf("Camera %d, %dx%d:", i, width, height);
+    for (double z : heights) {
+      double max_deviation = 0.0;
+      for (int n = 0; n < num_pixels; n++) {
+        GVector::vector2d<double> pixel(x_dist(rng), y_dist(rng));
+        GVector::vector3d<double> approximated, exact;
+        projection.image2field(approximated, pixel, z);
+        params->image2fieldExact(exact, pixel, z);
+        max_deviation = std::max(max_deviation, (approximated - exact).length());
+      }
+      printf("  z=%.0f mm: max deviation %.3f mm", z, max_deviation);
+    }
+    printf("\n");
+  }
+  return ok;
+}
+
+/// runs the robot detection of camera \p thread \p num_frames more times on the
+/// frame it processed last, i.e. in steady state, and counts its heap allocations.
+/// Returns false if there are any.
+static bool checkRobotAllocations(CaptureThread * thread, int camera, long long num_frames) {
+  VisionPlugin * plugin = 0;
+  for (auto p : thread->getStack()->stack) {
+    if (p->getName() == "DetectRobots") plugin = p;
+  }
+  if (plugin == 0) {
+    fprintf(stderr, "vision-bench: plugin 'DetectRobots' not found\n");
+    return false;
+  }
+  FrameBuffer * rb = thread->getFrameBuffer();
+  FrameData * d = rb->getPointer(rb->prevWrite());
+  //the other threads are done, so all allocations are the plugin's:
+  long long before = allocation_count.load();
+  for (long long n = 0; n < num_frames; n++) plugin->process(d, 0);
+  long long allocations = allocation_count.load() - before;
+  printf("Camera %d: robot detection made %lld allocations in %lld frames\n", camera, allocations, num_frames);
+  return allocations == 0;
+}
+
+/// frames on which the alternative segmentation paths differed from the reference, see checkEquivalence()
+struct EquivalenceCounts {
+  long long frames = 0;
+  long long skipped = 0; //the run or region list of the reference was full
+  long long simd = 0;
+  long long fused = 0;
+  long long striped = 0;
+  long long compact = 0;
+};
+
+static bool sameRuns(CMVision::RunList * a, CMVision::RunList * b, bool compare_parents) {
+  if (a->getUsedRuns() != b->getUsedRuns()) return false;
+  const CMVision::Run * ra = a->getRunArrayPointer();
+  const CMVision::Run * rb = b->getRunArrayPointer();
+  for (int i = 0; i < a->getUsedRuns(); i++) {
+    if (ra[i].x != rb[i].x || ra[i].y != rb[i].y || ra[i].width != rb[i].width || ra[i].color.v != rb[i].color.v ||
+        (compare_parents && ra[i].parent != rb[i].parent)) return false;
+  }
+  return true;
+}
+
+static bool sameRegions(const CMVision::RegionList * a, const CMVision::RegionList * b) {
+  if (a->getUsedRegions() != b->getUsedRegions()) return false;
+  const CMVision::Region * ra = a->getRegionArrayPointer();
+  const CMVision::Region * rb = b->getRegionArrayPointer();
+  for (int i = 0; i < a->getUsedRegions(); i++) {
+    if (ra[i].color.v != rb[i].color.v || ra[i].x1 != rb[i].x1 || ra[i].y1 != rb[i].y1 || ra[i].x2 != rb[i].x2 ||
+        ra[i].y2 != rb[i].y2 || ra[i].cen_x != rb[i].cen_x || ra[i].cen_y != rb[i].cen_y || ra[i].area != rb[i].area ||
+        ra[i].run_start != rb[i].run_start) return false;
+  }
+  return true;
+}
+
+/// segments \p video with the sequential reference path (scalar thresholding, run list,
+/// connectComponents, extractRegions) and with each alternative that claims to give the
+/// same result: every SIMD level up to the current one (see -l), the fused thresholding
+/// and run length encoding, the stripe-parallel encoding and component connection with
+/// \p num_stripes stripes (run one after the other), and the compact run and region layout.
+/// Each alternative that differs is counted in \p counts.
+static void checkEquivalence(const RawImage * video, YUVLUT * lut, const RowSpans * spans, int max_runs,
+                             int max_regions, int num_stripes, EquivalenceCounts & counts) {
+  int width = video->getWidth();
+  int height = video->getHeight();
+  counts.frames++;
+
+  SimdDispatch::SimdLevel max_level = SimdDispatch::getLevel();
+  Image<raw8> reference, labels;
+  reference.allocate(width, height);
+  labels.allocate(width, height);
+  SimdDispatch::setLevel(SimdDispatch::SIMD_NONE);
+  bool ok = CMVisionThreshold::thresholdImage(&reference, video, lut, spans);
+  for (int level = SimdDispatch::SIMD_SSE41; ok && level <= max_level; level++) {
+    SimdDispatch::setLevel((SimdDispatch::SimdLevel)level);
+    CMVisionThreshold::thresholdImage(&labels, video, lut, spans);
+    if (memcmp(labels.getData(), reference.getData(), reference.getNumBytes()) != 0) {
+      counts.simd++;
+      break;
+    }
+  }
+  SimdDispatch::setLevel(max_level);
+  if (!ok) {
+    counts.skipped++;
+    return;
+  }
+
+  CMVision::RunList runs(max_runs);
+  CMVision::RegionProcessing::encodeRuns(&reference, &runs);
+  if (runs.getUsedRuns() == max_runs) {
+    counts.skipped++;
+    return;
+  }
+
+  CMVision::RunList fused(max_runs);
+  std::vector<raw8> row;
+  if (!CMVision::RegionProcessing::thresholdAndEncodeRuns(video, lut, spans, &fused, row) ||
+      !sameRuns(&runs, &fused, true)) counts.fused++;
+
+  //the stripes are processed one after the other, the result doesn't depend on the threads:
+  vector<std::unique_ptr<CMVision::RunList> > stripe_lists;
+  vector<CMVision::RunList *> stripes;
+  for (int k = 0; k < num_stripes; k++) {
+    stripe_lists.emplace_back(new CMVision::RunList(max_runs));
+    stripes.push_back(stripe_lists.back().get());
+    CMVision::RegionProcessing::encodeRunStripe(&reference, (k * height) / num_stripes, ((k + 1) * height) / num_stripes,
+                                                stripes[k]);
+  }
+  CMVision::RunList striped(max_runs);
+  CMVision::RegionProcessing::concatenateRunStripes(&striped, stripes.data(), num_stripes);
+  bool striped_same = sameRuns(&runs, &striped, true);
+
+  CMVision::RegionProcessing::connectComponents(&runs);
+  if (striped_same && runs.getUsedRuns() > 0) {
+    int rows = striped.getRunArrayPointer()[striped.getUsedRuns() - 1].y + 1;
+    vector<int> stripe_begin(num_stripes + 1);
+    vector<int> merged;
+    for (int k = 0; k < num_stripes; k++) {
+      stripe_begin[k] = CMVision::RegionProcessing::findRowStart(&striped, (k * rows) / num_stripes);
+    }
+    stripe_begin[num_stripes] = striped.getUsedRuns();
+    for (int k = 0; k < num_stripes; k++) {
+      CMVision::RegionProcessing::connectComponentStripe(&striped, stripe_begin[k], stripe_begin[k + 1]);
+    }
+    CMVision::RegionProcessing::mergeComponentStripes(&striped, stripe_begin.data(), num_stripes, merged);
+    for (int k = 0; k < num_stripes; k++) {
+      CMVision::RegionProcessing::compressComponentStripe(&striped, stripe_begin[k], stripe_begin[k + 1]);
+    }
+    striped_same = sameRuns(&runs, &striped, true);
+  }
+  if (!striped_same) counts.striped++;
+
+  CMVision::RegionList regions(max_regions);
+  CMVision::RegionProcessing::extractRegions(&regions, &runs);
+  if (regions.getUsedRegions() == max_regions) {
+    counts.skipped++;
+    return;
+  }
+  CMVision::RunTable table(max_runs);
+  CMVision::RegionTable region_table(max_regions);
+  CMVision::RegionList compact(max_regions);
+  bool compact_same = CMVision::RegionProcessing::encodeRuns(&reference, &table);
+  if (compact_same) {
+    CMVision::RegionProcessing::connectComponents(&table);
+    CMVision::RegionProcessing::extractRegions(&region_table, &table);
+    region_table.toRegionList(&compact);
+    compact_same = sameRegions(&regions, &compact);
+  }
+  if (!compact_same) counts.compact++;
+}
+
+/// runs checkEquivalence() on the next \p num_frames frames of camera \p thread, with the
+/// LUT, image mask and list sizes of its stack. Returns false on any difference.
+static bool checkCameraEquivalence(CaptureThread * thread, int camera, long long num_frames) {
+  StackRoboCupSSL * stack = dynamic_cast<StackRoboCupSSL *>(thread->getStack());
+  if (stack == 0) return false;
+  int max_runs = 50000;
+  int max_regions = 50000;
+  VarType * v_max_runs = findPluginSetting(stack, "RunlengthEncode", {"max runs"});
+  if (v_max_runs != 0) max_runs = atoi(v_max_runs->getString().c_str());
+  VarType * v_max_regions = findPluginSetting(stack, "FindBlobs", {"max regions"});
+  if (v_max_regions != 0) max_regions = atoi(v_max_regions->getString().c_str());
+
+  CaptureInterface * capture = thread->getCapture();
+  RawImage video;
+  EquivalenceCounts counts;
+  for (long long n = 0; n < num_frames; n++) {
+    RawImage pic_raw = capture->getFrame();
+    bool ok = capture->copyAndConvertFrame(pic_raw, video);
+    capture->releaseFrame();
+    if (!ok) {
+      fprintf(stderr, "vision-bench: unable to convert frame %lld\n", n);
+      video.clear();
+      return false;
+    }
+    //a copy of the mask's spans, as the check takes a while:
+    ConvexHullImageMask * mask = stack->getImageMask();
+    RowSpans spans;
+    mask->lock();
+    bool use_mask = mask->getWidth() == video.getWidth() && mask->getRowSpans().getHeight() == video.getHeight();
+    if (use_mask) spans = mask->getRowSpans();
+    mask->unlock();
+    checkEquivalence(&video, stack->getLUT(), use_mask ? &spans : 0, max_runs, max_regions, 4, counts);
+  }
+  video.clear();
+  printf("Camera %d: %lld frames, %lld skipped. Differences: SIMD thresholding %lld, fused encoding %lld, "
+         "striped components %lld, compact layout %lld\n", camera, counts.frames, counts.skipped,
+         counts.simd, counts.fused, counts.striped, counts.compact);
+  return counts.simd + counts.fused + counts.striped + counts.compact == 0;
+}
+
+int main(int argc, char *argv[])
+{
+#if QT_VERSION >= 0x050000
+  //some plugins create their widgets up front, which needs a (virtual) display:
+  if (qgetenv("QT_QPA_PLATFORM").isEmpty()) qputenv("QT_QPA_PLATFORM", "offscreen");
+#endif
+  QApplication app(argc, argv);
+
+  GetOpt opts(argc, argv);
+  bool help=false;
+  bool pipelined=false;
+  bool zero_copy=false;
+  bool compact_runs=false;
+  bool conversions=false;
+  bool streaming=false;
+  bool dispatch=false;
+  bool projection=false;
+  bool allocations=false;
+  bool equivalence=false;
+  QString camera_count;
+  QString frame_count;
+  QString settings_file;
+  QString image_dir;
+  QString export_file;
+  QString query_robots;
+  QString ring_readers;
+  QString simd_level;
+  int ecode=0;
+  opts.addSwitch("help",&help);
+  opts.addShortOptSwitch( 'p',QString("Pipelined Processing"),&pipelined, false);
+  opts.addShortOptSwitch( 'z',QString("Zero-Copy Capture"),&zero_copy, false);
+  opts.addShortOptSwitch( 'm',QString("Compact Run Layout"),&compact_runs, false);
+  opts.addShortOptSwitch( 'k',QString("Conversion Kernels"),&conversions, false);
+  opts.addShortOptSwitch( 'f',QString("Stream Files"),&streaming, false);
+  opts.addShortOptSwitch( 't',QString("Thread Dispatch"),&dispatch, false);
+  opts.addShortOptSwitch( 'a',QString("Projection Accuracy"),&projection, false);
+  opts.addShortOptSwitch( 'g',QString("Allocation Check"),&allocations, false);
+  opts.addShortOptSwitch( 'e',QString("Equivalence Check"),&equivalence, false);
+  opts.addOptionalOption( 'c',QString("Camera Count"),&camera_count, QString("1"));
+  opts.addOptionalOption( 'n',QString("Frame Count"),&frame_count, QString("1000"));
+  opts.addOptionalOption( 's',QString("Settings File"),&settings_file, QString("settings.xml"));
+  opts.addOptionalOption( 'd',QString("Image Directory"),&image_dir, QString(""));
+  opts.addOptionalOption( 'o',QString("Timing Export File"),&export_file, QString(""));
+  opts.addOptionalOption( 'q',QString("Region Query Robots"),&query_robots, QString(""));
+  opts.addOptionalOption( 'r',QString("Ring Buffer Readers"),&ring_readers, QString(""));
+  opts.addOptionalOption( 'l',QString("SIMD Level"),&simd_level, QString(""));
+  if (!opts.parse()) {
+    fprintf(stderr,"Invalid command line parameters!\n");
+    help=true;
+    ecode=1;
+  }
+
+  bool count_ok = false;
+  int num_cameras = camera_count.toInt(&count_ok);
+  if (!count_ok || num_cameras < 1) {
+    fprintf(stderr,"Invalid number of cameras!\n");
+    help=true;
+    ecode=1;
+  }
+  long long num_frames = frame_count.toLongLong(&count_ok);
+  if (!count_ok || num_frames < 1) {
+    fprintf(stderr,"Invalid number of frames!\n");
+    help=true;
+    ecode=1;
+  }
+  if (!simd_level.isEmpty()) {
+    bool level_ok = false;
+    for (int level = SimdDispatch::SIMD_NONE; level <= SimdDispatch::SIMD_AVX2; level++) {
+      if (simd_level.compare(SimdDispatch::getLevelName((SimdDispatch::SimdLevel)level), Qt::CaseInsensitive) == 0) {
+        SimdDispatch::SimdLevel in_use = SimdDispatch::setLevel((SimdDispatch::SimdLevel)level);
+        if (in_use != level) {
+          fprintf(stderr,"%s is not supported, using %s\n", simd_level.toUtf8().constData(), SimdDispatch::getLevelName(in_use));
+        }
+        level_ok = true;
+      }
+    }
+    if (!level_ok) {
+      fprintf(stderr,"Invalid SIMD level!\n");
+      help=true;
+      ecode=1;
+    }
+  }
+
+  if (help) {
+    printf("vision-bench command line options:\n");
+    printf(" -c <n>     Number of cameras, processed in parallel (default: 1)\n");
+    printf(" -n <n>     Number of frames per camera (default: 1000)\n");
+    printf(" -s <file>  Settings file with the calibration and capture settings (default: settings.xml)\n");
+    printf(" -d <dir>   Directory of the images (png, jpg, bmp or raw dumps) for all cameras\n");
+    printf("            (default: the directory of 'Read from files' in the settings)\n");
+    printf(" -o <file>  Append the latencies to this file (.json: JSON lines, otherwise CSV)\n");
+    printf(" -p         Pipelined processing\n");
+    printf(" -z         Zero-copy capture\n");
+    printf(" -m         Compact (structure-of-arrays) run and region layout\n");
+    printf(" -f         Stream the images from disk instead of loading all of them first\n");
+    printf(" -l <name>  Limit the thresholding and conversion kernels to scalar, SSE4.1 or AVX2\n");
+    printf("            (default: the best one the CPU supports)\n");
+    printf(" -g         After the run, run the robot detection -n more times on the last frame\n");
+    printf("            and fail if it allocates memory\n");
+    printf(" -q <n>     Only compare the marker queries of the NKDTree and the region grid\n");
+    printf("            on synthetic frames crowded with <n> robots, for -n frames\n");
+    printf(" -k         Only compare the SIMD color conversions up to -l against the scalar\n");
+    printf("            versions on a synthetic 1280x1024 frame, for -n frames\n");
+    printf(" -r <n>     Only compare the lock-free ring buffer against the mutex one, with\n");
+    printf("            one writer doing -n writes against <n> polling readers\n");
+    printf(" -t         Only compare the dispatch latency of the thread pool against spawning\n");
+    printf("            threads for every frame, for -n frames\n");
+    printf(" -e         Only check that the fused, striped, compact and SIMD segmentation give\n");
+    printf("            the same results as the reference path on -n replayed frames per camera\n");
+    printf(" -a         Only compare the projection grid of each camera against the exact\n");
+    printf("            projection of the calibration in the settings, for -n random pixels\n");
+    printf(" --help     Show this help\n");
+    printf("The LUTs and masks are read from robocup-ssl-cam-<id>-lut-yuv.xml and -mask.xml.\n");
+    printf("Detections are serialized, but not sent, as the network output is not opened.\n");
+    exit(ecode);
+  }
+
+  if (!query_robots.isEmpty()) {
+    int num_robots = query_robots.toInt(&count_ok);
+    if (!count_ok || num_robots < 1) {
+      fprintf(stderr,"Invalid number of robots!\n");
+      exit(1);
+    }
+    exit(benchRegionQueries(num_robots, num_frames) ? 0 : 1);
+  }
+
+  if (conversions) {
+    exit(benchConversions(num_frames) ? 0 : 1);
+  }
+
+  if (!ring_readers.isEmpty()) {
+    int num_readers = ring_readers.toInt(&count_ok);
+    if (!count_ok || num_readers < 0) {
+      fprintf(stderr,"Invalid number of readers!\n");
+      exit(1);
+    }
+    RingBuffer<int> locked(4);
+    LockFreeRingBuffer<int> lockfree(4);
+    benchRingBuffer("mutex", locked, num_readers, num_frames);
+    benchRingBuffer("lock-free", lockfree, num_readers, num_frames);
+    exit(0);
+  }
+
+  if (dispatch) {
+    exit(benchThreadDispatch(num_frames) ? 0 : 1);
+  }
+
+  //the camera threads help out with their own parallel work, so the pool gets the rest:
+  ThreadPool::configureGlobal(std::max((int)std::thread::hardware_concurrency() - num_cameras, 0), 0, 0);
+
+  //build the same settings tree as the GUI, so the settings file applies as is:
+  RenderOptions * render_opts = new RenderOptions();
+  MultiStackRoboCupSSL * multi_stack = new MultiStackRoboCupSSL(render_opts, num_cameras);
+  VarList * root = new VarList("Vision System");
+  VarExternal * stackvar;
+  root->addChild(stackvar = new VarExternal((multi_stack->getSettingsFileName() + ".xml").c_str(),multi_stack->getName()));
+  stackvar->addChild(multi_stack->getSettings());
+  for (unsigned int i=0;i<multi_stack->threads.size();i++) {
+    VisionStack * s = multi_stack->threads[i]->getStack();
+    VarList * threadvar = new VarList("Thread " + QString::number(i).toStdString());
+    threadvar->addChild(s->getSettings());
+    threadvar->addChild(multi_stack->threads[i]->getSettings());
+    for (auto p : s->stack) {
+      if (p->getSettings() == 0) continue;
+      if (!p->isSharedAmongStacks()) {
+        threadvar->addChild(p->getSettings());
+      } else if (i==0) {
+        stackvar->addChild(p->getSettings());
+      }
+    }
+    stackvar->addChild(threadvar);
+  }
+  vector<VarType *> world;
+  world.push_back(root);
+  world=VarXML::read( world,settings_file.toStdString());
+
+  if (projection) {
+    double ball_height = 30.0;
+    VarType * v_ball_height = findPluginSetting(multi_stack->threads[0]->getStack(), "DetectBalls",
+                                                {"Ball Properties", "Ball Z-Height"});
+    if (v_ball_height != 0) ball_height = atof(v_ball_height->getString().c_str());
+    exit(benchProjection(multi_stack, num_cameras, ball_height, num_frames) ? 0 : 1);
+  }
+
+  for (int i=0;i<num_cameras;i++) {
+    CaptureThread * thread = multi_stack->threads[i];
+    VarType * module = findPath(thread->getSettings(), {"Capture Control", "Capture Module"});
+    if (module != 0) module->setString("Read from files");
+    if (!image_dir.isEmpty()) {
+      VarType * dir = findPath(thread->getSettings(), {"Read from files", "Capture Settings", "directory"});
+      if (dir != 0) dir->setString(image_dir.toStdString());
+    }
+    if (streaming) {
+      VarType * v_streaming = findPath(thread->getSettings(), {"Read from files", "Capture Settings", "streaming"});
+      if (v_streaming != 0) v_streaming->setString("true");
+    }
+    if (pipelined) {
+      VarType * v_pipelined = findPath(thread->getStack()->getSettings(), {"pipelined processing"});
+      if (v_pipelined != 0) v_pipelined->setString("true");
+    }
+    if (compact_runs) {
+      VarType * v_compact = findPluginSetting(thread->getStack(), "RunlengthEncode", {"compact run layout"});
+      if (v_compact != 0) v_compact->setString("true");
+    }
+    if (!thread->init()) {
+      fprintf(stderr,"vision-bench: unable to start capturing from files for camera %d\n", i);
+      exit(1);
+    }
+  }
+
+  if (equivalence) {
+    bool same = true;
+    for (int i=0;i<num_cameras;i++) {
+      same = checkCameraEquivalence(multi_stack->threads[i], i, num_frames) && same;
+      multi_stack->threads[i]->stop();
+    }
+    exit(same ? 0 : 1);
+  }
+
+  vector<BenchResult> results(num_cameras);
+  vector<std::thread> cameras;
+  for (int i=0;i<num_cameras;i++) {
+    cameras.emplace_back(runCamera, multi_stack->threads[i], num_frames, zero_copy, &results[i]);
+  }
+  for (auto & t : cameras) t.join();
+
+  long long total_frames = 0;
+  double max_seconds = 0.0;
+  for (int i=0;i<num_cameras;i++) {
+    VisionStack * s = multi_stack->threads[i]->getStack();
+    //one statistics window covering the whole run:
+    s->updateTimingStatistics();
+    printf("Camera %d: %lld frames in %.3f s, %.1f fps\n", i, results[i].frames, results[i].seconds,
+           results[i].seconds > 0.0 ? results[i].frames / results[i].seconds : 0.0);
+    LatencyStatistics::print(s->getLatencyStatistics());
+    VarType * v_storage = findPluginSetting(s, "FindBlobs", {"run and region data (KiB/frame)"});
+    if (v_storage != 0) printf("Run and region data: %s KiB/frame\n", v_storage->getString().c_str());
+    if (!export_file.isEmpty()) {
+      LatencyStatistics::exportTo(export_file.toStdString(), "camera " + std::to_string(i),
+                                  GetTimeSec(), s->getLatencyStatistics());
+    }
+    total_frames += results[i].frames;
+    if (results[i].seconds > max_seconds) max_seconds = results[i].seconds;
+  }
+  printf("All cameras: %lld frames in %.3f s, %.1f fps\n", total_frames, max_seconds,
+         max_seconds > 0.0 ? total_frames / max_seconds : 0.0);
+
+  bool allocations_ok = true;
+  if (allocations) {
+    for (int i=0;i<num_cameras;i++) {
+      allocations_ok = checkRobotAllocations(multi_stack->threads[i], i, num_frames) && allocations_ok;
+    }
+  }
+
+  for (int i=0;i<num_cameras;i++) multi_stack->threads[i]->stop();
+  return allocations_ok ? 0 : 1;
+}
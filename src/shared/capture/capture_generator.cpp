@@ -103,13 +103,25 @@ bool CaptureGenerator::copyAndConvertFrame ( const RawImage & src, RawImage & ta
   return true;
 }
 
+bool CaptureGenerator::borrowFrame ( const RawImage & src, RawImage & target )
+{
+  mutex.lock();
+  ColorFormat output_fmt = Colors::stringToColorFormat ( v_colorout->getSelection().c_str() );
+  bool res = ( src.getData() != 0 && output_fmt == src.getColorFormat() );
+  if ( res ) {
+    target.borrow ( src );
+  }
+  mutex.unlock();
+  return res;
+}
+
 RawImage CaptureGenerator::getFrame()
 {
   mutex.lock();
   limit.waitForNextFrame();
   result.setColorFormat ( COLOR_RGB8 );
   result.setTime ( GetTimeSec() );
-  result.allocate ( COLOR_RGB8,v_width->getInt(),v_height->getInt() );
+  result.ensure_allocation ( COLOR_RGB8,v_width->getInt(),v_height->getInt() );
   rgbImage img;
   img.fromRawImage(result);
 
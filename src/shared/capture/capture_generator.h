@@ -72,6 +72,7 @@ public:
   void cleanup();
 
   virtual bool copyAndConvertFrame(const RawImage & src, RawImage & target);
+  virtual bool borrowFrame(const RawImage & src, RawImage & target);
   virtual string getCaptureMethodName() const;
 };
 
@@ -22,7 +22,7 @@
 #include "capture_spinnaker.h"
 #include <memory>
 #include <iostream>
-#include <opencv2/opencv.hpp>
+#include "conversions.h"
 
 CaptureSpinnaker::CaptureSpinnaker(VarList * _settings,int default_camera_id, QObject * parent) : QObject(parent), CaptureInterface(_settings)
 {
@@ -364,9 +364,8 @@ bool CaptureSpinnaker::copyAndConvertFrame(const RawImage & src, RawImage & targ
     target = src;
   } else if(src_color == COLOR_RAW8 && out_color == COLOR_RGB8) {
     target.ensure_allocation(out_color, src.getWidth(), src.getHeight());
-    cv::Mat srcMat(src.getHeight(), src.getWidth(), CV_8UC1, src.getData());
-    cv::Mat dstMat(target.getHeight(), target.getWidth(), CV_8UC3, target.getData());
-    cvtColor(srcMat, dstMat, cv::COLOR_BayerBG2RGB);
+    //the camera is set to BayerRG8
+    Conversions::bayer2rgb(src.getData(), target.getData(), src.getWidth(), src.getHeight());
   } else {
     fprintf(stderr, "Invalid conversion from %s to %s\n",
             v_capture_mode->getSelection().c_str(), v_convert_to_mode->getSelection().c_str());
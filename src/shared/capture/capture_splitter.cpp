@@ -15,7 +15,8 @@
 
 #include "capture_splitter.h"
 #include <algorithm>
-#include <opencv2/opencv.hpp>
+#include <iostream>
+#include "conversions.h"
 
 CaptureSplitter::CaptureSplitter(VarList * _settings, int default_camera_id, QObject * parent) : QObject(parent), CaptureInterface(_settings)
 {
@@ -149,9 +150,7 @@ bool CaptureSplitter::copyAndConvertFrame(const RawImage &src, RawImage &target)
 
   if(image_buffer->getColorFormat() == ColorFormat::COLOR_RAW8)
   {
-    cv::Mat srcMat(height, width, CV_8UC1, data_buf);
-    cv::Mat dstMat(height, width, CV_8UC3, target.getData());
-    cvtColor(srcMat, dstMat, cv::COLOR_BayerBG2RGB);
+    Conversions::bayer2rgb(data_buf, target.getData(), width, height);
   }
   else if(target.getColorFormat() == ColorFormat::COLOR_RGB8)
   {
@@ -21,7 +21,12 @@
 //========================================================================
 
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <cctype>
+#include <chrono>
 #include "capturefromfile.h"
 #include "image_io.h"
 #include "conversions.h"
@@ -34,6 +39,16 @@ CaptureFromFile::CaptureFromFile(VarList * _settings, int default_camera_id, QOb
 {
   currentImageIndex = 0;
   is_capturing=false;
+  streaming=false;
+  queue_capacity=1;
+  stop_decoder=false;
+  decoder_failed=false;
+  has_current=false;
+  recorded_timing=false;
+  playback_started=false;
+  playback_start=0.0;
+  playback_first_time=0.0;
+  last_recorded_time=0.0;
 
   settings->addChild(conversion_settings = new VarList("Conversion Settings"));
   settings->addChild(capture_settings = new VarList("Capture Settings"));
@@ -51,6 +66,12 @@ CaptureFromFile::CaptureFromFile(VarList * _settings, int default_camera_id, QOb
   ostringstream convert;
   convert << "test-data/cam" << default_camera_id;
   capture_settings->addChild(v_cap_dir = new VarString("directory", convert.str()));
+  //decode the images while playing instead of loading all of them up front:
+  capture_settings->addChild(v_streaming = new VarBool("streaming", false));
+  capture_settings->addChild(v_decode_ahead = new VarInt("decode-ahead frames", 8, 1, 1000));
+  capture_settings->addChild(v_playback = new VarStringEnum("playback", "as fast as possible"));
+  v_playback->addItem("as fast as possible");
+  v_playback->addItem("recorded timestamps");
     
   // Valid file endings
   validImageFileEndings.push_back("PNG");
@@ -62,6 +83,8 @@ CaptureFromFile::CaptureFromFile(VarList * _settings, int default_camera_id, QOb
 
 CaptureFromFile::~CaptureFromFile()
 {
+  stopStreaming();
+  clearImages();
 }
 
 bool CaptureFromFile::stopCapture() 
@@ -74,36 +97,150 @@ void CaptureFromFile::cleanup()
 {
   mutex.lock();
   is_capturing=false;
+  stopStreaming();
   mutex.unlock();
 }
 
+bool CaptureFromFile::listImageFiles()
+{
+  imgs_to_load.clear();
+  image_times.clear();
+  // Acquire a list of file names
+  DIR *dp;
+  struct dirent *dirp;
+  if((v_cap_dir->getString() == "") || ((dp  = opendir(v_cap_dir->getString().c_str())) == 0)) 
+  {
+    fprintf(stderr,"Failed to open directory %s \n", v_cap_dir->getString().c_str());
+    return false;
+  }  
+  while ((dirp = readdir(dp))) 
+  {
+    if (strcmp(dirp->d_name,".") != 0 && strcmp(dirp->d_name,"..") != 0) 
+    {
+      if(isImageFileName(std::string(dirp->d_name)))
+        imgs_to_load.push_back(v_cap_dir->getString() + "/" + std::string(dirp->d_name));
+      else
+        fprintf(stderr,"Not a valid image file: %s \n", dirp->d_name);
+    }
+  }
+  closedir(dp);
+  std::sort(imgs_to_load.begin(), imgs_to_load.end());
+  for (const auto& fileName : imgs_to_load) {
+    image_times.push_back(getFileTime(fileName));
+  }
+  return !imgs_to_load.empty();
+}
+
+double CaptureFromFile::getFileTime(const std::string & fileName)
+{
+  struct stat st{};
+  if (stat(fileName.c_str(), &st) != 0) return 0.0;
+#ifdef __APPLE__
+  return (double) st.st_mtimespec.tv_sec + st.st_mtimespec.tv_nsec*(1.0E-9);
+#else
+  return (double) st.st_mtim.tv_sec + st.st_mtim.tv_nsec*(1.0E-9);
+#endif
+}
+
+bool CaptureFromFile::loadImage(const std::string & fileName, RawImage & img, MappedFile & mapping)
+{
+  if(getFileExtension(fileName) == "RAW")
+  {
+    int width(v_raw_width->get());
+    int height(v_raw_height->get());
+    if(width <= 0 || height <= 0)
+    {
+      std::cout << "Could not read image. Dimensions must be positive." << std::endl;
+      return false;
+    }
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+      std::cout << "Could not read file: " << fileName << std::endl;
+      return false;
+    }
+    struct stat st{};
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t) width*height)
+    {
+      std::cerr << "Image " << fileName << " is too small!" << std::endl;
+      close(fd);
+      return false;
+    }
+    //private and writable, so nothing written to the frame can reach the file:
+    size_t length = (size_t) width*height;
+    void * address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(address == MAP_FAILED)
+    {
+      std::cout << "Could not map file: " << fileName << std::endl;
+      return false;
+    }
+    //read ahead, so the pages are in memory when the frame is processed:
+    madvise(address, length, MADV_WILLNEED);
+    img.clear();
+    img.setColorFormat(ColorFormat::COLOR_RAW8);
+    img.setWidth(width);
+    img.setHeight(height);
+    //the mapping owns the data, so no RawImage ever frees it:
+    img.setData(static_cast<unsigned char *>(address), false);
+    mapping.address = address;
+    mapping.length = length;
+  }
+  else
+  {
+    // read image to default OpenCV image format (BGR8)
+    cv::Mat srcImg = imread(fileName, cv::IMREAD_COLOR);
+    if(srcImg.empty() || !srcImg.isContinuous())
+    {
+      std::cout << "Could not read file: " << fileName << std::endl;
+      return false;
+    }
+    img.ensure_allocation(ColorFormat::COLOR_RGB8, srcImg.cols, srcImg.rows);
+    // convert to default ssl-vision format (RGB8)
+    Conversions::bgr2rgb(srcImg.data, img.getData(), img.getWidth(), img.getHeight());
+  }
+  return true;
+}
+
+void CaptureFromFile::unmapFile(MappedFile & mapping)
+{
+  if(mapping.address != nullptr) munmap(mapping.address, mapping.length);
+  mapping = MappedFile();
+}
+
+void CaptureFromFile::clearImages()
+{
+  for (auto & img : images) img.clear();
+  images.clear();
+  for (auto & mapping : mapped_files) unmapFile(mapping);
+  mapped_files.clear();
+}
+
 bool CaptureFromFile::startCapture()
 {
   mutex.lock();
-  if(images.size() == 0)
+  recorded_timing = v_playback->getSelection() == "recorded timestamps";
+  playback_started = false;
+  streaming = v_streaming->getBool();
+  if(streaming)
   {
-    // Acquire a list of file names
-    DIR *dp;
-    struct dirent *dirp;
-    if((v_cap_dir->getString() == "") || ((dp  = opendir(v_cap_dir->getString().c_str())) == 0)) 
+    stopStreaming();
+    //the preloaded images would defeat the point of streaming:
+    clearImages();
+    if(!listImageFiles())
     {
-      fprintf(stderr,"Failed to open directory %s \n", v_cap_dir->getString().c_str());
       mutex.unlock();
       is_capturing=false;
       return false;
-    }  
-    while ((dirp = readdir(dp))) 
-    {
-      if (strcmp(dirp->d_name,".") != 0 && strcmp(dirp->d_name,"..") != 0) 
-      {
-        if(isImageFileName(std::string(dirp->d_name)))
-          imgs_to_load.push_back(v_cap_dir->getString() + "/" + std::string(dirp->d_name));
-        else
-          fprintf(stderr,"Not a valid image file: %s \n", dirp->d_name);
-      }
     }
-    closedir(dp);
-    if(imgs_to_load.size() == 0)
+    queue_capacity = static_cast<unsigned int>(std::max(v_decode_ahead->getInt(), 1));
+    stop_decoder = false;
+    decoder_failed = false;
+    decoder = std::thread(&CaptureFromFile::decodeLoop, this);
+  }
+  else if(images.size() == 0)
+  {
+    if(!listImageFiles())
     {
       mutex.unlock();
       is_capturing=false;
@@ -111,50 +248,18 @@ bool CaptureFromFile::startCapture()
     }
   
     // Read images to buffer in memory:
-    imgs_to_load.sort();
-    for (const auto& currentImage : imgs_to_load) {
-      int width(v_raw_width->get());
-      int height(v_raw_height->get());
-      if(getFileExtension(currentImage) == "RAW")
-      {
-        if(width <= 0 || height <= 0)
-        {
-          std::cout << "Could not read image. Dimensions must be positive." << std::endl;
-          continue;
-        }
-        std::ifstream file(currentImage, std::ios::binary );
-        if(!file)
-        {
-          std::cout << "Could not read file: " << currentImage << std::endl;
-          continue;
-        }
-        vector<char> buffer((istreambuf_iterator<char>(file)), (istreambuf_iterator<char>()));
-
-        if((int) buffer.size() < width*height)
-        {
-          std::cerr << "Image " << currentImage << " is too small!" << std::endl;
-          continue;
-        }
-
-        RawImage raw_img;
-        raw_img.allocate(ColorFormat::COLOR_RAW8, width, height);
-        memcpy(raw_img.getData(), buffer.data(), static_cast<size_t>(raw_img.getNumBytes()));
-
-        images.push_back(raw_img);
-      }
-      else
-      {
-        // read image to default OpenCV image format (BGR8)
-        cv::Mat srcImg = imread(currentImage, cv::IMREAD_COLOR);
-        RawImage img;
-        img.allocate(ColorFormat::COLOR_RGB8, srcImg.cols, srcImg.rows);
-        cv::Mat dstImg(img.getHeight(), img.getWidth(), CV_8UC3, img.getData());
-        // convert to default ssl-vision format (RGB8)
-        cvtColor(srcImg, dstImg, cv::COLOR_BGR2RGB);
-        images.push_back(img);
-      }
+    std::vector<double> times;
+    for (unsigned int i = 0; i < imgs_to_load.size(); i++) {
+      const auto& currentImage = imgs_to_load[i];
+      RawImage img;
+      MappedFile mapping;
+      if(!loadImage(currentImage, img, mapping)) continue;
+      images.push_back(img);
+      times.push_back(image_times[i]);
+      if(mapping.address != nullptr) mapped_files.push_back(mapping);
       fprintf (stderr, "Loaded %s \n", currentImage.c_str());
     }
+    image_times.swap(times);
     currentImageIndex = 0;
   }
   is_capturing=true;  
@@ -163,6 +268,105 @@ bool CaptureFromFile::startCapture()
   return true;
 }
 
+void CaptureFromFile::decodeLoop()
+{
+  size_t next = 0;
+  size_t failures = 0;
+  while (true) {
+    StreamedFrame frame;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      queue_not_full.wait(lock, [this] { return stop_decoder || queue.size() < queue_capacity; });
+      if (stop_decoder) return;
+      if (!free_buffers.empty()) {
+        frame.image = free_buffers.back();
+        free_buffers.pop_back();
+      }
+    }
+    const std::string & fileName = imgs_to_load[next];
+    frame.recorded_time = image_times[next];
+    next = (next + 1) % imgs_to_load.size();
+    bool ok = loadImage(fileName, frame.image, frame.mapping);
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (!ok) {
+      if (frame.mapping.address == nullptr && frame.image.getData() != nullptr) free_buffers.push_back(frame.image);
+      //give up once none of the files can be read:
+      if (++failures >= imgs_to_load.size()) {
+        decoder_failed = true;
+        queue_not_empty.notify_all();
+        return;
+      }
+      continue;
+    }
+    failures = 0;
+    queue.push_back(frame);
+    queue_not_empty.notify_one();
+  }
+}
+
+bool CaptureFromFile::takeStreamedFrame(RawImage & img, double & recorded_time)
+{
+  std::unique_lock<std::mutex> lock(queue_mutex);
+  //the frame of a getFrame() without releaseFrame() is not needed anymore:
+  if (has_current) {
+    recycleStreamedFrame(current);
+    has_current = false;
+  }
+  queue_not_empty.wait(lock, [this] { return stop_decoder || decoder_failed || !queue.empty(); });
+  if (stop_decoder || queue.empty()) return false;
+  current = queue.front();
+  queue.pop_front();
+  has_current = true;
+  queue_not_full.notify_one();
+  img = current.image;
+  recorded_time = current.recorded_time;
+  return true;
+}
+
+void CaptureFromFile::recycleStreamedFrame(StreamedFrame & frame)
+{
+  if (frame.mapping.address != nullptr) {
+    unmapFile(frame.mapping);
+  } else if (frame.image.getData() != nullptr) {
+    free_buffers.push_back(frame.image);
+  }
+  frame = StreamedFrame();
+}
+
+void CaptureFromFile::stopStreaming()
+{
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    stop_decoder = true;
+    queue_not_full.notify_all();
+    queue_not_empty.notify_all();
+  }
+  if (decoder.joinable()) decoder.join();
+  std::lock_guard<std::mutex> lock(queue_mutex);
+  for (auto & frame : queue) recycleStreamedFrame(frame);
+  queue.clear();
+  if (has_current) {
+    recycleStreamedFrame(current);
+    has_current = false;
+  }
+  for (auto & img : free_buffers) img.clear();
+  free_buffers.clear();
+}
+
+double CaptureFromFile::getPlaybackTime(double recorded_time, double now)
+{
+  //restart the clock on the first frame, when the recording loops, and after gaps
+  //of more than a second (e.g. between two recordings in the same directory):
+  if (!playback_started || recorded_time < last_recorded_time || recorded_time - last_recorded_time > 1.0) {
+    playback_started = true;
+    playback_start = now;
+    playback_first_time = recorded_time;
+  }
+  last_recorded_time = recorded_time;
+  return playback_start + (recorded_time - playback_first_time);
+}
+
 std::string CaptureFromFile::getFileExtension(const std::string &fileName)
 {
   // Get ending and turn it to uppercase:
@@ -206,19 +410,18 @@ bool CaptureFromFile::copyAndConvertFrame(const RawImage & src, RawImage & targe
   }
   else if(src_fmt == COLOR_RAW8 && output_fmt == COLOR_RGB8)
   {
-      cv::Mat srcMat(src.getHeight(), src.getWidth(), CV_8UC1, src.getData());
-      cv::Mat dstMat(target.getHeight(), target.getWidth(), CV_8UC3, target.getData());
-      cvtColor(srcMat, dstMat, cv::COLOR_BayerRG2BGR);
+      Conversions::bayer2rgb(src.getData(), target.getData(), src.getWidth(), src.getHeight());
   }
 #ifndef NO_DC1394_CONVERSIONS
   else if(src_fmt == COLOR_RAW8 && output_fmt == COLOR_YUV422_UYVY)
   {
     // note: this an inefficient double conversion and should only be used for testing!
-    cv::Mat srcMat(src.getHeight(), src.getWidth(), CV_8UC1, src.getData());
-    cv::Mat dstMat(target.getHeight(), target.getWidth(), CV_8UC3);
-    cvtColor(srcMat, dstMat, cv::COLOR_BayerRG2BGR);
-    dc1394_convert_to_YUV422(dstMat.data, target.getData(), src.getWidth(), src.getHeight(),
+    RawImage rgb_img;
+    rgb_img.allocate(COLOR_RGB8, src.getWidth(), src.getHeight());
+    Conversions::bayer2rgb(src.getData(), rgb_img.getData(), src.getWidth(), src.getHeight());
+    dc1394_convert_to_YUV422(rgb_img.getData(), target.getData(), src.getWidth(), src.getHeight(),
                              DC1394_BYTE_ORDER_UYVY, DC1394_COLOR_CODING_RGB8, 8);
+    rgb_img.clear();
   }
   else if (src_fmt == COLOR_RGB8 && output_fmt == COLOR_YUV422_UYVY)
   {
@@ -245,12 +448,42 @@ bool CaptureFromFile::copyAndConvertFrame(const RawImage & src, RawImage & targe
   return true;
 }
 
+bool CaptureFromFile::borrowFrame(const RawImage & src, RawImage & target)
+{
+  //the frame stays valid until releaseFrame(), but only lend it if no conversion is needed:
+  mutex.lock();
+  ColorFormat output_fmt = Colors::stringToColorFormat(v_colorout->getSelection().c_str());
+  bool res = (src.getData() != nullptr && output_fmt == src.getColorFormat());
+  if (res) {
+    target.borrow(src);
+  }
+  mutex.unlock();
+  return res;
+}
+
 RawImage CaptureFromFile::getFrame()
 {
    mutex.lock();
 
   RawImage result;
-  if(images.empty())
+  double recorded_time = 0.0;
+  bool have_frame = false;
+  if(streaming)
+  {
+    //waiting for the decoder must not block stopCapture():
+    mutex.unlock();
+    have_frame = takeStreamedFrame(result, recorded_time);
+    mutex.lock();
+  }
+  else if(!images.empty())
+  {
+    result = images[currentImageIndex];
+    recorded_time = image_times[currentImageIndex];
+    currentImageIndex = static_cast<unsigned int>((currentImageIndex + 1) % images.size());
+    have_frame = true;
+  }
+
+  if(!have_frame)
   {
     fprintf (stderr, "CaptureFromFile Error, no images available");
     is_capturing=false;
@@ -258,22 +491,38 @@ RawImage CaptureFromFile::getFrame()
     result.setWidth(640);
     result.setHeight(480);
     result.setTime(0.0);
-  } else {
-    result = images[currentImageIndex];
-    currentImageIndex = static_cast<unsigned int>((currentImageIndex + 1) % images.size());
-
-    timeval tv{};
-    gettimeofday(&tv, nullptr);
-    result.setTime((double) tv.tv_sec + tv.tv_usec*(1.0E-6));
+    mutex.unlock();
+    return result;
   }
 
+  timeval tv{};
+  gettimeofday(&tv, nullptr);
+  double now = (double) tv.tv_sec + tv.tv_usec*(1.0E-6);
+  double due = recorded_timing ? getPlaybackTime(recorded_time, now) : now;
   mutex.unlock();
+
+  if(due > now)
+  {
+    std::this_thread::sleep_for(std::chrono::duration<double>(due - now));
+    gettimeofday(&tv, nullptr);
+    now = (double) tv.tv_sec + tv.tv_usec*(1.0E-6);
+  }
+  result.setTime(now);
   return result;
 }
 
 void CaptureFromFile::releaseFrame() 
 {
   mutex.lock();
+  if(streaming)
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if(has_current)
+    {
+      recycleStreamedFrame(current);
+      has_current = false;
+    }
+  }
   mutex.unlock();
 }
 
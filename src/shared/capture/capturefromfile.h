@@ -26,8 +26,12 @@
 #include "captureinterface.h"
 #include <dirent.h>
 #include <string>
-#include <list>
+#include <vector>
+#include <deque>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "VarTypes.h"
 
   #include <QMutex>
@@ -54,17 +58,68 @@ protected:
 
   //capture variables:
   VarString * v_cap_dir;
+  VarBool * v_streaming;
+  VarInt * v_decode_ahead;
+  VarStringEnum * v_playback;
   VarList * capture_settings;
   VarList * conversion_settings;
 
-  std::list<std::string> imgs_to_load;
+  /// a .RAW file mapped into memory, the data of an image that refers to it
+  struct MappedFile {
+    void * address = nullptr;
+    size_t length = 0;
+  };
+
+  std::vector<std::string> imgs_to_load;
+  std::vector<double> image_times;   //modification times of the files, i.e. when they were recorded
   std::vector<RawImage> images;
+  std::vector<MappedFile> mapped_files;
   unsigned int currentImageIndex;
-  
+
+  //streaming: a background thread decodes up to v_decode_ahead frames ahead
+  struct StreamedFrame {
+    RawImage image;
+    MappedFile mapping;
+    double recorded_time = 0.0;
+  };
+  bool streaming;
+  std::thread decoder;
+  std::mutex queue_mutex;
+  std::condition_variable queue_not_full;
+  std::condition_variable queue_not_empty;
+  std::deque<StreamedFrame> queue;
+  std::vector<RawImage> free_buffers;   //decoded images that are no longer used, for reuse
+  unsigned int queue_capacity;
+  bool stop_decoder;
+  bool decoder_failed;
+  StreamedFrame current;
+  bool has_current;
+
+  //playback at the recorded times:
+  bool recorded_timing;
+  bool playback_started;
+  double playback_start;
+  double playback_first_time;
+  double last_recorded_time;
+
   bool isImageFileName(const std::string& fileName);
   std::string getFileExtension(const std::string &fileName);
   std::vector<std::string> validImageFileEndings;
-  
+
+  bool listImageFiles();
+  /// decodes \p fileName into \p img, reusing its buffer if possible.
+  /// .RAW files are mapped into memory instead, see \p mapping.
+  bool loadImage(const std::string & fileName, RawImage & img, MappedFile & mapping);
+  static void unmapFile(MappedFile & mapping);
+  static double getFileTime(const std::string & fileName);
+  void clearImages();
+  void decodeLoop();
+  bool takeStreamedFrame(RawImage & img, double & recorded_time);
+  void recycleStreamedFrame(StreamedFrame & frame);
+  void stopStreaming();
+  /// the wall clock time at which the frame recorded at \p recorded_time is due
+  double getPlaybackTime(double recorded_time, double now);
+
 public:
   CaptureFromFile(VarList * _settings, int default_camera_id, QObject * parent=0);
   void mvc_connect(VarList * group);
@@ -80,6 +135,7 @@ public:
   void cleanup();
 
   virtual bool copyAndConvertFrame(const RawImage & src, RawImage & target);
+  virtual bool borrowFrame(const RawImage & src, RawImage & target);
   virtual string getCaptureMethodName() const;
 };
 
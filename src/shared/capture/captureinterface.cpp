@@ -51,3 +51,9 @@ bool CaptureInterface::copyAndConvertFrame(const RawImage & src, RawImage & targ
   memcpy(target.getData(),src.getData(),src.getNumBytes());
   return true;
 }
+
+bool CaptureInterface::borrowFrame(const RawImage & src, RawImage & target) {
+  (void)src;
+  (void)target;
+  return false;
+}
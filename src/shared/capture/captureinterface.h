@@ -102,6 +102,19 @@ public:
     /// already allocated, and then memcpy the data as-is.
     virtual bool     copyAndConvertFrame(const RawImage & src, RawImage & target);
 
+    /// Zero-copy alternative to copyAndConvertFrame():
+    /// If the captured frame can be used as-is (e.g. no conversion is
+    /// required), this lets \c target borrow the buffer of \c src
+    /// (see RawImage::borrow()) and returns true. The caller owns nothing:
+    /// the borrowed buffer is only valid until releaseFrame() is called,
+    /// so the caller has to call RawImage::releaseBorrowed() on \c target
+    /// before that, and must not write to it.
+    ///
+    /// Returns false if borrowing is not possible, in which case
+    /// copyAndConvertFrame() has to be used. This is what the default
+    /// implementation does.
+    virtual bool     borrowFrame(const RawImage & src, RawImage & target);
+
     /// Return a string describing your capture method
     /// e.g. DC1394B, or GigEVision, or V4LCapture, or USBCam,...
     virtual string   getCaptureMethodName() const = 0;
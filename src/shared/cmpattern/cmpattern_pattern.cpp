@@ -384,7 +384,7 @@ void MultiPatternModel::recheckColorsUsed() {
   }
 }
 
-bool MultiPatternModel::findPattern(PatternDetectionResult & result, Marker * markers,int num_markers, const PatternFitParameters & fit_params,const CameraParameters& camera_params) const {
+bool MultiPatternModel::findPattern(PatternDetectionResult & result, Marker * markers,int num_markers, const PatternFitParameters & fit_params,const CameraParameters::FrameProjection& projection) const {
   if(markers==0 || num_markers<0) return(false);
 
   int best_idx = -1;
@@ -429,7 +429,7 @@ bool MultiPatternModel::findPattern(PatternDetectionResult & result, Marker * ma
     for(int i=0; i<num_markers; i++){
       vector2d marker_img_center(markers[i].reg->cen_x,markers[i].reg->cen_y);
       vector3d marker_center3d;
-      camera_params.image2field(marker_center3d,marker_img_center,markers[i].height);
+      projection.image2field(marker_center3d,marker_img_center,markers[i].height);
       markers[i].loc.set(marker_center3d.x,marker_center3d.y);
     }
 
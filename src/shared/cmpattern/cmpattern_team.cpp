@@ -86,10 +86,12 @@ RobotPattern::RobotPattern(VarList * team_root)
       _other_markers_max_area = _other_markers_filter->findChildOrReplace(new VarInt("Max Area (sq-pixels)",600));
       _other_markers_max_detections = _other_markers_filter->findChildOrReplace(new VarInt("Max Num Markers To Detect", 16));
       _other_markers_max_query_distance = _other_markers_filter->findChildOrReplace(new VarDouble("Max Query Distance", 20.0));
+      _other_markers_grid = _other_markers_filter->findChildOrReplace(new VarBool("Use Region Grid", false));
 
     _histogram_settings = _settings->findChildOrReplace(new VarList("Histogram Settings"));
       _histogram_enable = _histogram_settings->findChildOrReplace(new VarBool("Enable",true));
       _histogram_pixel_scan_radius = _histogram_settings->findChildOrReplace(new VarInt("Scan Radius (pixels)",16));
+      _histogram_integral = _histogram_settings->findChildOrReplace(new VarBool("Use Integral Image",false));
       _histogram_min_markeryness = _histogram_settings->findChildOrReplace(new VarDouble("Min Markeryness",0.3));
       _histogram_max_markeryness = _histogram_settings->findChildOrReplace(new VarDouble("Max Markeryness",12.0));
       _histogram_min_field_greenness = _histogram_settings->findChildOrReplace(new VarDouble("Min Field-Greenness",0.0,0.0,1.0));
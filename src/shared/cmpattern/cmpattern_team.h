@@ -94,10 +94,12 @@ protected:
       VarInt * _other_markers_max_area;
       VarInt * _other_markers_max_detections;
       VarDouble * _other_markers_max_query_distance;
+      VarBool * _other_markers_grid;
 
     VarList * _histogram_settings;
       VarBool * _histogram_enable;
       VarInt * _histogram_pixel_scan_radius;
+      VarBool * _histogram_integral;
       VarDouble * _histogram_min_markeryness;
       VarDouble * _histogram_max_markeryness;
       VarDouble * _histogram_min_field_greenness;
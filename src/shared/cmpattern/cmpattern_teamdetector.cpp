@@ -58,11 +58,12 @@ Team * TeamDetectorSettings::getTeam(int idx) const {
   return (team_vector[idx]);
 }
 
-TeamDetector::TeamDetector(LUT3D * lut3d, const CameraParameters& camera_params, const RoboCupField& field) : _camera_params(camera_params), _field(field) {
+TeamDetector::TeamDetector(LUT3D * lut3d, const CameraParameters& camera_params, const RoboCupField& field, CMVision::IntegralHistogram * label_integral) : _camera_params(camera_params), _field(field) {
   _robotPattern=0;
   _lut3d=lut3d;
 
   histogram=0;
+  _label_integral=label_integral;
 
   color_id_cyan = _lut3d->getChannelID("Cyan");
   if (color_id_cyan == -1) printf("WARNING color label 'Cyan' not defined in LUT!!!\n");
@@ -115,6 +116,7 @@ void TeamDetector::init(RobotPattern * robotPattern, Team * team)
 
   _other_markers_max_detections=_robotPattern->_other_markers_max_detections->getInt();
   _other_markers_max_query_distance=_robotPattern->_other_markers_max_query_distance->getDouble();
+  _other_markers_grid=_robotPattern->_other_markers_grid->getBool();
 
   filter_team.setWidth(_robotPattern->_center_marker_min_width->getInt(),robotPattern->_center_marker_max_width->getInt());
   filter_team.setHeight(_robotPattern->_center_marker_min_height->getInt(),robotPattern->_center_marker_max_height->getInt());
@@ -126,6 +128,7 @@ void TeamDetector::init(RobotPattern * robotPattern, Team * team)
 
   _histogram_enable=_robotPattern->_histogram_enable->getBool();
   _histogram_pixel_scan_radius=_robotPattern->_histogram_pixel_scan_radius->getInt();
+  _histogram_integral=_robotPattern->_histogram_integral->getBool();
 
   _histogram_markeryness.set(_robotPattern->_histogram_min_markeryness->getDouble(),_robotPattern->_histogram_max_markeryness->getDouble());
   _histogram_field_greenness.set(_robotPattern->_histogram_min_field_greenness->getDouble(),_robotPattern->_histogram_max_field_greenness->getDouble());
@@ -178,15 +181,17 @@ TeamDetector::~TeamDetector()
   if (histogram !=0) delete histogram;
 }
 
-void TeamDetector::update(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, int max_robots, const Image<raw8> * image, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree) {
+void TeamDetector::update(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, int max_robots, CMVision::LabelImage * labels, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree) {
   color_id_team=team_color_id;
   _max_robots=max_robots;
   robots->Clear();
+  candidates.clear();
+  _projection=_camera_params.getFrameProjection();
 
   if (_unique_patterns) {
-    findRobotsByModel(robots,team_color_id,image,colorlist,reg_tree);
+    findRobotsByModel(robots,team_color_id,labels,colorlist,reg_tree);
   } else {
-    findRobotsByTeamMarkerOnly(robots,team_color_id,image,colorlist);
+    findRobotsByTeamMarkerOnly(robots,team_color_id,labels,colorlist);
   }
 
 }
@@ -195,24 +200,23 @@ void TeamDetector::update(::google::protobuf::RepeatedPtrField< ::SSL_DetectionR
 
 
 
-void TeamDetector::findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, const Image<raw8> * image, CMVision::ColorRegionList * colorlist)
+void TeamDetector::findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, CMVision::LabelImage * labels, CMVision::ColorRegionList * colorlist)
 {
-  filter_team.init( colorlist->getRegionList(team_color_id).getInitialElement() );
+  filter_team.init( colorlist->getRegionList(team_color_id) );
 
   //TODO: change these to update on demand:
   //local variables
   const CMVision::Region * reg=0;
-  SSL_DetectionRobot * robot=0;
   while((reg = filter_team.getNext()) != 0) {
     vector2d reg_img_center(reg->cen_x,reg->cen_y);
     vector3d reg_center3d;
-    _camera_params.image2field(reg_center3d,reg_img_center,_robot_height);
+    _projection.image2field(reg_center3d,reg_img_center,_robot_height);
     vector2d reg_center(reg_center3d.x,reg_center3d.y);
 
     //TODO: add confidence masking:
     //float conf = det.mask.get(reg->cen_x,reg->cen_y);
     double conf=1.0;
-    if (field_filter.isInFieldOrPlayableBoundary(reg_center) &&  ((_histogram_enable==false) || checkHistogram(reg,image)==true)) {
+    if (field_filter.isInFieldOrPlayableBoundary(reg_center) &&  ((_histogram_enable==false) || checkHistogram(reg,labels)==true)) {
       double area = getRegionArea(reg,_robot_height);
       double area_err = fabs(area - _center_marker_area_mean);
 
@@ -225,39 +229,35 @@ void TeamDetector::findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrFie
       }
       if(det.debug) det.color(reg,rc,conf);*/
 
-      //allow twice as many robots for now...
-      //duplicate filtering will take care of the rest below:
-      robot=addRobot(robots,conf,_max_robots*2);
-
-      if (robot!=0) {
-        //setup robot:
-        robot->set_x(reg_center.x);
-        robot->set_y(reg_center.y);
-        robot->set_pixel_x(reg->cen_x);
-        robot->set_pixel_y(reg->cen_y);
-        robot->set_height(_robot_height);
-      }
+      RobotCandidate & robot=addCandidate(conf);
+      robot.x=reg_center.x;
+      robot.y=reg_center.y;
+      robot.pixel_x=reg->cen_x;
+      robot.pixel_y=reg->cen_y;
+      robot.height=_robot_height;
     }
   }
 
+  //allow twice as many robots for now...
+  //duplicate filtering will take care of the rest below:
+  selectCandidates(_max_robots*2);
+
   // remove duplicates ... keep the ones with higher confidence:
-  int size=robots->size();
+  int size=candidates.size();
   for(int i=0; i<size; i++){
     for(int j=i+1; j<size; j++){
-      if(sqdist(vector2d(robots->Get(i).x(),robots->Get(i).y()),vector2d(robots->Get(j).x(),robots->Get(j).y())) < sq(_center_marker_duplicate_distance)) {
-        robots->Mutable(i)->set_confidence(0.0);
+      if(sqdist(vector2d(candidates[i].x,candidates[i].y),vector2d(candidates[j].x,candidates[j].y)) < sq(_center_marker_duplicate_distance)) {
+        candidates[i].conf=0.0;
       }
     }
   }
 
   //remove items with 0-confidence:
-  stripRobots(robots);
+  stripCandidates();
 
   //remove extra items:
-  while(robots->size() > _max_robots) {
-    robots->RemoveLast();
-  }
-
+  selectCandidates(_max_robots);
+  writeRobots(robots);
 }
 
 
@@ -271,8 +271,8 @@ double TeamDetector::getRegionArea(const CMVision::Region * reg, double z) const
   vector3d a,b;
   vector2d right(reg->x2+1,reg->y2+1);
   vector2d left(reg->x1,reg->y1);
-  _camera_params.image2field(a,right,z);
-  _camera_params.image2field(b,left,z);
+  _projection.image2field(a,right,z);
+  _projection.image2field(b,left,z);
   vector3d box = a-b;
 
   double box_area = fabs(box.x) * fabs(box.y);
@@ -285,7 +285,7 @@ double TeamDetector::getRegionArea(const CMVision::Region * reg, double z) const
 }
 
 
-bool TeamDetector::checkHistogram(const CMVision::Region * reg, const Image<raw8> * image) {
+bool TeamDetector::checkHistogram(const CMVision::Region * reg, CMVision::LabelImage * labels) {
 
   if(_histogram_pixel_scan_radius == 0) return(true);
 
@@ -293,8 +293,18 @@ bool TeamDetector::checkHistogram(const CMVision::Region * reg, const Image<raw8
 
   int ix = (int)(reg->cen_x);
   int iy = (int)(reg->cen_y);
-  int num = histogram->addBox(image,ix-_histogram_pixel_scan_radius,iy-_histogram_pixel_scan_radius,
+  int num;
+  if(_histogram_integral && _label_integral != 0) {
+    //only the channels used below are counted:
+    const int channel_ids[] = {color_id_pink, color_id_green, color_id_cyan, color_id_team,
+                               color_id_field_green, color_id_white, color_id_black, color_id_clear};
+    _label_integral->setLabels(labels);
+    num = histogram->addBox(_label_integral,ix-_histogram_pixel_scan_radius,iy-_histogram_pixel_scan_radius,
+              ix+_histogram_pixel_scan_radius,iy+_histogram_pixel_scan_radius,channel_ids,8);
+  } else {
+    num = histogram->addBox(labels->get(),ix-_histogram_pixel_scan_radius,iy-_histogram_pixel_scan_radius,
               ix+_histogram_pixel_scan_radius,iy+_histogram_pixel_scan_radius);
+  }
 
   float inv_num = 1.0 / num;
 
@@ -354,52 +364,66 @@ bool TeamDetector::checkHistogram(const CMVision::Region * reg, const Image<raw8
 }
 
 
-SSL_DetectionRobot * TeamDetector::addRobot(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, double conf, int max_robots) {
+TeamDetector::RobotCandidate & TeamDetector::addCandidate(double conf) {
+  candidates.push_back(RobotCandidate());
+  RobotCandidate & robot=candidates.back();
+  robot.conf=conf;
+  robot.x=0.0;
+  robot.y=0.0;
+  robot.pixel_x=0.0;
+  robot.pixel_y=0.0;
+  robot.height=0.0;
+  robot.orientation=0.0;
+  robot.have_orientation=false;
+  robot.have_robot_id=false;
+  robot.robot_id=0;
+  return robot;
+}
 
-  int size=robots->size();
-  SSL_DetectionRobot * result_robot = 0;
-  for (int i=0;i<size;i++) {
-    if (robots->Get(i).confidence() < conf) {
-      //allocate new robot at end of array
-      //and shift everything down by 1...making room for newly inserted item.
-      if (size < max_robots) {
-        //we can expand the array by 1.
-        robots->Add();
-        size++;
-      }
-      for (int j=size-1; j>i; j--) {
-        (*(robots->Mutable(j)))=robots->Get(j-1);
-      }
-      result_robot = robots->Mutable(i);
-      result_robot->Clear();
-      result_robot->set_confidence(conf);
 
-      return result_robot;
+void TeamDetector::selectCandidates(int max_robots) {
+  //candidates are still in the order they were found, which settles ties.
+  //Insertion sort keeps that order and does not allocate; there are only a few dozen candidates:
+  int size=candidates.size();
+  for (int i=1;i<size;i++) {
+    RobotCandidate robot=candidates[i];
+    int j=i;
+    while (j>0 && candidates[j-1].conf < robot.conf) {
+      candidates[j]=candidates[j-1];
+      j--;
     }
+    candidates[j]=robot;
   }
-  if (size < max_robots) {
-    result_robot = robots->Add();
-    result_robot->set_confidence(conf);
-  }
-  return result_robot;
+  if (size > max_robots) candidates.resize(max(max_robots,0));
 }
 
 
-void TeamDetector::stripRobots(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots) {
-  int size=robots->size();
+void TeamDetector::stripCandidates() {
+  int size=candidates.size();
 
   int tgt=0;
   for (int src=0;src<size;src++) {
-    if (robots->Get(src).confidence() != 0.0) {
-      if (tgt!=src) {
-        //copy operation is needed:
-        (*(robots->Mutable(tgt)))=robots->Get(src);
-      }
+    if (candidates[src].conf != 0.0) {
+      if (tgt!=src) candidates[tgt]=candidates[src];
       tgt++;
     }
   }
-  for (int i=tgt;i<size;i++) {
-    robots->RemoveLast();
+  candidates.resize(tgt);
+}
+
+
+void TeamDetector::writeRobots(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots) const {
+  for (unsigned int i=0;i<candidates.size();i++) {
+    const RobotCandidate & c=candidates[i];
+    SSL_DetectionRobot * robot=robots->Add();
+    robot->set_confidence(c.conf);
+    robot->set_x(c.x);
+    robot->set_y(c.y);
+    if (c.have_orientation) robot->set_orientation(c.orientation);
+    if (c.have_robot_id) robot->set_robot_id(c.robot_id);
+    robot->set_pixel_x(c.pixel_x);
+    robot->set_pixel_y(c.pixel_y);
+    robot->set_height(c.height);
   }
 }
 
@@ -413,29 +437,30 @@ void TeamDetector::stripRobots(::google::protobuf::RepeatedPtrField< ::SSL_Detec
 
 
 
-void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, const Image<raw8> * image, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree)
+void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, CMVision::LabelImage * labels, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree)
 {
 
-  (void)image;
+  (void)labels;
   const int MaxDetections = _other_markers_max_detections;
   Marker cen; // center marker
-  Marker *markers = new Marker[MaxDetections];
+  if ((int)markers.size() < MaxDetections) markers.resize(MaxDetections);
   const float marker_max_query_dist = _other_markers_max_query_distance;
   const float marker_max_dist = _pattern_max_dist;
+  //a grid with cells of the query radius only has to look at the 3x3 cells around a query:
+  reg_tree.setUseGrid(_other_markers_grid, marker_max_query_dist);
 
   // partially forget old detections
   //decaySeen();
 
-  filter_team.init( colorlist->getRegionList(team_color_id).getInitialElement());
+  filter_team.init( colorlist->getRegionList(team_color_id) );
   const CMVision::Region * reg=0;
-  SSL_DetectionRobot * robot=0;
 
   MultiPatternModel::PatternDetectionResult res;
 
   while((reg = filter_team.getNext()) != 0) {
     vector2d reg_img_center(reg->cen_x,reg->cen_y);
     vector3d reg_center3d;
-    _camera_params.image2field(reg_center3d,reg_img_center,_robot_height);
+    _projection.image2field(reg_center3d,reg_img_center,_robot_height);
     vector2d reg_center(reg_center3d.x,reg_center3d.y);
     //TODO add masking:
     //if(det.mask.get(reg->cen_x,reg->cen_y) >= 0.5){
@@ -453,7 +478,7 @@ void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL
         if(filter_others.check(*mreg) && model.usesColor(mreg->color)) {
           vector2d marker_img_center(mreg->cen_x,mreg->cen_y);
           vector3d marker_center3d;
-          _camera_params.image2field(marker_center3d,marker_img_center,_robot_height);
+          _projection.image2field(marker_center3d,marker_img_center,_robot_height);
           Marker &m = markers[num_markers];
 
           m.set(mreg,marker_center3d,getRegionArea(mreg,_robot_height));
@@ -469,7 +494,7 @@ void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL
       reg_tree.endQuery();
 
       if(num_markers >= 2){
-        CMPattern::PatternProcessing::sortMarkersByAngle(markers,num_markers);
+        CMPattern::PatternProcessing::sortMarkersByAngle(markers.data(),num_markers);
         for(int i=0; i<num_markers; i++){
           /*DEBUG CODE:
           char colorchar='?';
@@ -485,31 +510,29 @@ void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL
           markers[i].next_angle_dist = angle_pos(angle_diff(markers[i].angle,markers[j].angle));
         }
 
-        if (model.findPattern(res,markers,num_markers,_pattern_fit_params,_camera_params)) {
-              robot=addRobot(robots,res.conf,_max_robots*2);
-              if (robot!=0) {
-                //setup robot:
-                robot->set_x(cen.loc.x);
-                robot->set_y(cen.loc.y);
-                if (_have_angle) robot->set_orientation(res.angle);
-                robot->set_robot_id(res.id);
-                robot->set_pixel_x(reg->cen_x);
-                robot->set_pixel_y(reg->cen_y);
-                robot->set_height(cen.height);
-              }
+        if (model.findPattern(res,markers.data(),num_markers,_pattern_fit_params,_projection)) {
+              RobotCandidate & robot=addCandidate(res.conf);
+              robot.x=cen.loc.x;
+              robot.y=cen.loc.y;
+              robot.orientation=res.angle;
+              robot.have_orientation=_have_angle;
+              robot.have_robot_id=true;
+              robot.robot_id=res.id;
+              robot.pixel_x=reg->cen_x;
+              robot.pixel_y=reg->cen_y;
+              robot.height=cen.height;
         }
       }
     }
   }
+  selectCandidates(_max_robots*2);
+
   //remove items with 0-confidence:
-  stripRobots(robots);
+  stripCandidates();
 
   //remove extra items:
-  while(robots->size() > _max_robots) {
-    robots->RemoveLast();
-  }
-
-  delete[] markers;
+  selectCandidates(_max_robots);
+  writeRobots(robots);
 }
 
 
@@ -28,6 +28,7 @@
 #include "cmpattern_team.h"
 #include "cmpattern_pattern.h"
 #include "cmvision_region.h"
+#include "cmvision_region_tree.h"
 #include "field.h"
 #include "camera_calibration.h"
 #include "field_filter.h"
@@ -161,6 +162,8 @@ protected:
   //TeamDetectorSettings * _detector_settings;
 
   const CameraParameters& _camera_params;
+  //the projection of the frame in update():
+  CameraParameters::FrameProjection _projection;
   const RoboCupField& _field;
   RobotPattern * _robotPattern;
   Team * _team;
@@ -187,9 +190,11 @@ protected:
   double _center_marker_duplicate_distance;
   int    _other_markers_max_detections;
   double _other_markers_max_query_distance;
+  bool   _other_markers_grid;
 
   bool  _histogram_enable;
   int    _histogram_pixel_scan_radius;
+  bool  _histogram_integral;
 
   ClosedRangeFloat _histogram_markeryness;
   ClosedRangeFloat _histogram_field_greenness;
@@ -212,17 +217,41 @@ protected:
 
 protected:
     double getRegionArea(const CMVision::Region * reg, double z) const;
-    bool checkHistogram(const CMVision::Region * reg, const Image<raw8> * image);
+    bool checkHistogram(const CMVision::Region * reg, CMVision::LabelImage * labels);
 
-    //returns a mutable pointer if the add was successful
-    //returns 0 if there already are max_robots with higher confidence than conf
-    SSL_DetectionRobot * addRobot(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, double conf, int max_robots);
+    //a detected robot, only written to the output once the best ones are known:
+    struct RobotCandidate {
+      float conf;
+      float x;
+      float y;
+      float pixel_x;
+      float pixel_y;
+      float height;
+      float orientation;
+      bool  have_orientation;
+      bool  have_robot_id;
+      int   robot_id;
+    };
+
+    //both are reused from frame to frame, so that the detection does not allocate memory:
+    vector<RobotCandidate> candidates;
+    vector<Marker> markers;
+
+    //appends a candidate with confidence conf:
+    RobotCandidate & addCandidate(double conf);
+
+    //keeps the max_robots candidates of highest confidence, sorted by decreasing
+    //confidence. Candidates of equal confidence stay in the order they were found:
+    void selectCandidates(int max_robots);
 
     //remove anything with a confidence of 0:
-    void stripRobots(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots);
+    void stripCandidates();
+
+    //appends the candidates to robots, which reuses the elements of a cleared field:
+    void writeRobots(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots) const;
 
 public:
-    TeamDetector(LUT3D * lut3d, const CameraParameters& camera_params, const RoboCupField& field);
+    TeamDetector(LUT3D * lut3d, const CameraParameters& camera_params, const RoboCupField& field, CMVision::IntegralHistogram * label_integral=0);
 
     virtual ~TeamDetector();
 
@@ -230,14 +259,15 @@ public:
       return 0;
     }
     CMVision::Histogram * histogram;
+    CMVision::IntegralHistogram * _label_integral;
 
     void init(RobotPattern * robotPattern, Team * team);
 
-    void findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, const Image<raw8> * image, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree);
+    void findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, CMVision::LabelImage * labels, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree);
 
-    void findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, const Image<raw8> * image, CMVision::ColorRegionList * colorlist);
+    void findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, CMVision::LabelImage * labels, CMVision::ColorRegionList * colorlist);
 
-    void update(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, int max_robots, const Image<raw8> * image, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree);
+    void update(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, int max_robots, CMVision::LabelImage * labels, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree);
 };
 
 }
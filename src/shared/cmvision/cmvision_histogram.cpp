@@ -19,6 +19,7 @@
 */
 //========================================================================
 #include "cmvision_histogram.h"
+#include <algorithm>
 
 namespace CMVision {
 
@@ -54,6 +55,25 @@ int Histogram::addBox(const Image<raw8> * image, int x1, int y1, int x2, int y2)
   return((x2 - x1 + 1) * (y2 - y1 + 1));
 }
 
+int Histogram::addBox(IntegralHistogram * integral, int x1, int y1, int x2, int y2, const int * channel_ids, int num_channels) {
+  int image_width = integral->getWidth();
+  int image_height = integral->getHeight();
+
+  x1 = bound(x1,0,image_width-1);
+  y1 = bound(y1,0,image_height-1);
+  x2 = bound(x2,0,image_width-1);
+  y2 = bound(y2,0,image_height-1);
+
+  integral->buildChannels(channel_ids,num_channels);
+  for (int i=0;i<num_channels;i++) {
+    int c = channel_ids[i];
+    if (c < 0 || c >= max_channels || std::find(channel_ids,channel_ids+i,c) != channel_ids+i) continue;
+    channels[c] += integral->countBox(c,x1,y1,x2,y2);
+  }
+
+  return((x2 - x1 + 1) * (y2 - y1 + 1));
+}
+
 int Histogram::getChannel(int channel) {
   return channels[channel];
 }
@@ -67,5 +87,136 @@ Histogram::~Histogram()
   delete[] channels;
 }
 
+IntegralHistogram::IntegralHistogram()
+{
+  labels=0;
+  version=0;
+  width=0;
+  height=0;
+}
+
+void IntegralHistogram::setLabels(LabelImage * _labels) {
+  if (_labels == labels && _labels->getVersion() == version) return;
+  labels=_labels;
+  version=_labels->getVersion();
+  width=_labels->getWidth();
+  height=_labels->getHeight();
+  built.assign(built.size(),false);
+}
+
+// Adds the labels [x_begin,x_end) of one color to the row prefix sums of a channel:
+static inline void addSegment(uint16_t * cur, const uint16_t * prev, int x_begin, int x_end, bool match, uint16_t & sum) {
+  if (match) {
+    for (int x=x_begin;x<x_end;x++) {
+      cur[x+1] = prev[x+1] + (uint16_t)(sum + (x - x_begin + 1));
+    }
+    sum += x_end - x_begin;
+  } else {
+    for (int x=x_begin;x<x_end;x++) {
+      cur[x+1] = prev[x+1] + sum;
+    }
+  }
+}
+
+void IntegralHistogram::buildChannels(const int * channel_ids, int num_channels) {
+  std::vector<int> missing;
+  for (int i=0;i<num_channels;i++) {
+    int c = channel_ids[i];
+    if (c < 0 || c > 255) continue;
+    if (c >= (int)tables.size()) {
+      tables.resize(c+1);
+      built.resize(c+1,false);
+    }
+    if (!built[c] && std::find(missing.begin(),missing.end(),c) == missing.end()) missing.push_back(c);
+  }
+  if (missing.empty() || width <= 0 || height <= 0) return;
+
+  int stride = width+1;
+  for (unsigned int k=0;k<missing.size();k++) {
+    std::vector<uint16_t> & table = tables[missing[k]];
+    table.resize((size_t)stride*(height+1));
+    std::fill(table.begin(),table.begin()+stride,0);
+  }
+
+  //each row is split into runs once, either from the run list or from the label image:
+  const raw8 * image = 0;
+  const Run * runs = 0;
+  int num_runs = 0;
+  int i = 0;
+  if (labels->isDecoded()) {
+    image = labels->get()->getPixelData();
+  } else {
+    runs = labels->getEncodedRuns()->getRunArrayPointer();
+    num_runs = labels->getEncodedRuns()->getUsedRuns();
+  }
+
+  for (int y=0;y<height;y++) {
+    const Run * row_runs;
+    int row_num_runs;
+    if (image != 0) {
+      const raw8 * r = image + y*width;
+      segments.clear();
+      Run run;
+      for (int x=0;x<width;) {
+        run.x = x;
+        run.color = r[x];
+        while (x < width && r[x] == run.color) x++;
+        run.width = x - run.x;
+        segments.push_back(run);
+      }
+      row_runs = segments.data();
+      row_num_runs = segments.size();
+    } else {
+      int first = i;
+      while (i < num_runs && runs[i].y == y) i++;
+      row_runs = runs + first;
+      row_num_runs = i - first;
+    }
+
+    for (unsigned int k=0;k<missing.size();k++) {
+      int c = missing[k];
+      uint16_t * t = tables[c].data();
+      const uint16_t * prev = t + y*stride;
+      uint16_t * cur = t + (y+1)*stride;
+      uint16_t sum = 0;
+      cur[0] = 0;
+      //runs of the clear color may be left out of the run list, so gaps are clear:
+      int x = 0;
+      for (int j=0;j<row_num_runs;j++) {
+        const Run & run = row_runs[j];
+        addSegment(cur, prev, x, run.x, c == 0, sum);
+        addSegment(cur, prev, run.x, run.x + run.width, run.color.v == c, sum);
+        x = run.x + run.width;
+      }
+      addSegment(cur, prev, x, width, c == 0, sum);
+    }
+  }
+
+  for (unsigned int k=0;k<missing.size();k++) built[missing[k]]=true;
+}
+
+int IntegralHistogram::countBox(int channel, int x1, int y1, int x2, int y2) {
+  if (labels == 0 || width <= 0 || height <= 0) return 0;
+  x1 = bound(x1,0,width-1);
+  y1 = bound(y1,0,height-1);
+  x2 = bound(x2,0,width-1);
+  y2 = bound(y2,0,height-1);
+  if (x2 < x1 || y2 < y1) return 0;
+  if (channel >= (int)built.size() || !built[channel]) buildChannels(&channel,1);
+
+  //strips of less than 65536 pixels, whose counts can't wrap around:
+  const uint16_t * t = tables[channel].data();
+  int stride = width+1;
+  int w = x2 - x1 + 1;
+  int strip_rows = std::max(65535 / w, 1);
+  int count = 0;
+  for (int ya=y1;ya<=y2;ya+=strip_rows) {
+    int yb = std::min(ya + strip_rows, y2 + 1);
+    uint16_t c = t[yb*stride + x2+1] - t[yb*stride + x1] - t[ya*stride + x2+1] + t[ya*stride + x1];
+    count += c;
+  }
+  return count;
+}
+
 };
 
@@ -21,9 +21,53 @@
 #ifndef CMVISION_HISTOGRAM_H
 #define CMVISION_HISTOGRAM_H
 #include "image.h"
+#include "cmvision_region.h"
+#include <vector>
 
 namespace CMVision {
 
+/*!
+  \class IntegralHistogram
+  \brief Summed-area tables of the channels of a frame's label image
+
+  Counts the pixels of a channel inside of any box with four lookups,
+  independent of the size of the box. The table of a channel is built
+  on its first use for the current labels, either from the label image
+  or, if that has not been decoded, directly from the run list.
+  The tables are 16 bit and wrap around, which still gives exact counts
+  for boxes of less than 65536 pixels; larger boxes are split into strips.
+*/
+class IntegralHistogram {
+protected:
+  std::vector<std::vector<uint16_t> > tables; //(width+1)*(height+1) per channel, empty until built
+  std::vector<bool> built;
+  std::vector<Run> segments;
+  LabelImage * labels;
+  unsigned int version;
+  int width;
+  int height;
+public:
+  IntegralHistogram();
+
+  /// uses the labels of the current frame, the tables of older labels are discarded
+  void setLabels(LabelImage * _labels);
+
+  /// builds the missing tables of the given channels in a single pass over the
+  /// labels, countBox() otherwise builds a missing table on its own
+  void buildChannels(const int * channel_ids, int num_channels);
+
+  /// returns the number of pixels of \p channel within the box (x1,y1) - (x2,y2),
+  /// which is clipped to the image just like in Histogram::addBox()
+  int countBox(int channel, int x1, int y1, int x2, int y2);
+
+  int getWidth() const {
+    return width;
+  }
+  int getHeight() const {
+    return height;
+  }
+};
+
 class Histogram{
 protected:
     int * channels;
@@ -35,6 +79,8 @@ public:
     //will sample a rectangular bounding box of a color-labeled image and add it to the histogram
     //the return value is the area of the box.
     int addBox(const Image<raw8> * image, int x1, int y1, int x2, int y2);
+    //same as above, but only adds the \p num_channels channels in \p channel_ids
+    int addBox(IntegralHistogram * integral, int x1, int y1, int x2, int y2, const int * channel_ids, int num_channels);
     int getChannel(int channel);
     void setChannel(int channel, int value);
     void clear();
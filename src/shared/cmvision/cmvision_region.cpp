@@ -21,6 +21,8 @@
 */
 //========================================================================
 #include "cmvision_region.h"
+#include <algorithm>
+#include <vector>
 
 namespace CMVision {
 
@@ -34,6 +36,93 @@ RegionProcessing::~RegionProcessing()
 }
 
 
+// Run-length encodes a single row of labels, appending to runs[j...].
+// Returns the new number of runs, which is at most max_runs.
+static inline int encodeRow(const raw8 * row, int y, int width, CMVision::Run * runs, int j, int max_runs)
+{
+  raw8 clear(0);
+  raw8 m;
+  int x,l;
+  CMVision::Run r;
+
+  r.next = 0;
+  r.y = y;
+
+  x = 0;
+  while(x < width){
+    m = row[x];
+    r.x = x;
+
+    l = x;
+
+    //fix by Stefan: stop if x==row-width
+    //(and don't access the row array in that case as it could cause a segfault)
+    //Note that the left argument of the && operator is always evaluated first and as
+    //such this expression should be safe.
+    while(x != width && row[x] == m) x++;
+
+    if(m != clear || x==width) {
+      r.color = m;
+      r.width = x - l;
+      r.parent = j;
+      runs[j++] = r;
+
+      if(j >= max_runs){
+        return j;
+      }
+    }
+  }
+  return j;
+}
+
+// Same as encodeRow(), but only reads the labels within the given spans
+// and treats all others as clear, so masked pixels are skipped entirely.
+// The spans must be sorted and neither overlap nor touch (see RowSpans).
+static inline int encodeRowSpans(const raw8 * row, int y, const Range::PixelSpan * spans, int num_spans, int width, CMVision::Run * runs, int j, int max_runs)
+{
+  raw8 clear(0);
+  raw8 m;
+  int x,l;
+  CMVision::Run r;
+
+  r.next = 0;
+  r.y = y;
+
+  //end of the last labeled run, where the trailing clear run begins:
+  int clear_begin = 0;
+  for(int k=0; k<num_spans; k++){
+    x = std::max(spans[k].min, clear_begin);
+    int x_end = std::min(spans[k].max, width);
+    while(x < x_end){
+      m = row[x];
+      l = x;
+      while(x != x_end && row[x] == m) x++;
+
+      if(m != clear) {
+        r.x = l;
+        r.color = m;
+        r.width = x - l;
+        r.parent = j;
+        runs[j++] = r;
+        clear_begin = x;
+
+        if(j >= max_runs){
+          return j;
+        }
+      }
+    }
+  }
+
+  if(clear_begin < width) {
+    r.x = clear_begin;
+    r.color = clear;
+    r.width = width - clear_begin;
+    r.parent = j;
+    runs[j++] = r;
+  }
+  return j;
+}
+
 void RegionProcessing::encodeRuns(Image<raw8> * tmap, CMVision::RunList * runlist)
 // Changes the flat array version of the thresholded image into a run
 // length encoded version, which speeds up later processing since we
@@ -46,83 +135,283 @@ void RegionProcessing::encodeRuns(Image<raw8> * tmap, CMVision::RunList * runlis
   int width=tmap->getWidth();
   int height=tmap->getHeight();
 
+  int y,j;
 
-  raw8 clear(0);
-  raw8 m;
-  raw8 *row;
-  int x,y,j,l;
-  CMVision::Run r;
+  j = 0;
+  for(y=0; y<height && j<max_runs; y++){
+    j = encodeRow(&map[y * width], y, width, runs, j, max_runs);
+  }
 
-  r.next = 0;
+  runlist->setUsedRuns(j);
+}
 
-  j = 0;
-  for(y=0; y<height; y++){
-    row = &map[y * width];
+bool RegionProcessing::encodeRuns(Image<raw8> * tmap, CMVision::RunTable * runtable)
+// Same as above, but writes the runs in the structure-of-arrays layout.
+{
+  int max_runs = runtable->getMaxRuns();
+  uint16_t * run_x = runtable->getX();
+  uint16_t * run_y = runtable->getY();
+  uint16_t * run_width = runtable->getWidth();
+  raw8 * run_color = runtable->getColor();
+  int32_t * run_parent = runtable->getParent();
+  raw8 * map = tmap->getPixelData();
+  int width=tmap->getWidth();
+  int height=tmap->getHeight();
+
+  if (width > CMVision::RunTable::MAX_COORDINATE || height > CMVision::RunTable::MAX_COORDINATE) {
+    fprintf(stderr,"CMVision run table: a %dx%d image exceeds the 16 bit coordinates!\n",width,height);
+    runtable->setUsedRuns(0);
+    return false;
+  }
 
-    r.y = y;
+  raw8 clear(0);
+  raw8 m;
+  int x,l,y,j;
 
+  j = 0;
+  for(y=0; y<height && j<max_runs; y++){
+    const raw8 * row = &map[y * width];
     x = 0;
-    while(x < width){
+    while(x < width && j < max_runs){
       m = row[x];
-      r.x = x;
-
       l = x;
-
-      //fix by Stefan: stop if x==row-width
-      //(and don't access the row array in that case as it could cause a segfault)
-      //Note that the left argument of the && operator is always evaluated first and as
-      //such this expression should be safe.
       while(x != width && row[x] == m) x++;
 
       if(m != clear || x==width) {
-        r.color = m;
-        r.width = x - l;
-        r.parent = j;
-        runs[j++] = r;
+        run_x[j] = l;
+        run_y[j] = y;
+        run_width[j] = x - l;
+        run_color[j] = m;
+        run_parent[j] = j;
+        j++;
+      }
+    }
+  }
 
-        if(j >= max_runs){
-          runlist->setUsedRuns(j);
-          return;
-        }
+  runtable->setUsedRuns(j);
+  return true;
+}
+
+bool RegionProcessing::thresholdAndEncodeRuns(const RawImage * source, YUVLUT * lut, const RowSpans * spans, CMVision::RunList * runlist,
+                                              std::vector<raw8> & row, const LUTTable * table)
+// Thresholds the image one row at a time into a small row buffer that
+// stays in cache and run length encodes that row right away. The result
+// is identical to encodeRuns() on the fully thresholded image, but the
+// full-frame label image is never written. Only the pixels within the
+// spans of each row (if given) are read at all.
+{
+  int width=source->getWidth();
+  int height=source->getHeight();
+  ColorFormat format=source->getColorFormat();
+  RGBLUT * rgblut=0;
+  BayerLUT * bayerlut=0;
+
+  if (format==COLOR_YUV422_UYVY) {
+    if (width % 2 != 0) {
+      fprintf(stderr,"CMVision fused thresholding: YUV422 requires an even image width, but found %d\n",width);
+      return false;
+    }
+  } else if (format==COLOR_RGB8) {
+    rgblut=(RGBLUT *)lut->getDerivedLUT(CSPACE_RGB);
+    if (rgblut==0) {
+      fprintf(stderr,"CMVision fused thresholding: no derived RGB LUT has been defined!\n");
+      return false;
+    }
+  } else if (format==COLOR_RAW8) {
+    bayerlut=(BayerLUT *)lut->getDerivedLUT(CSPACE_BAYER);
+    if (bayerlut==0) {
+      fprintf(stderr,"CMVision fused thresholding: no derived Bayer LUT has been defined!\n");
+      return false;
+    }
+  } else if (format!=COLOR_YUV444) {
+    fprintf(stderr,"CMVision fused thresholding needs YUV422, YUV444, RGB8 or RAW8 (Bayer) as input image, but found: %s\n",
+            Colors::colorFormatToString(format).c_str());
+    return false;
+  }
+
+  if (spans!=0 && spans->getHeight()!=height) {
+    fprintf(stderr,"CMVision fused thresholding: got spans for %d rows, but the image has %d rows!\n",spans->getHeight(),height);
+    return false;
+  }
+
+  int max_runs = runlist->getMaxRuns();
+  CMVision::Run * runs = runlist->getRunArrayPointer();
+  const unsigned char * source_pointer = source->getData();
+  int row_bytes = RawImage::computeImageSize(format,width);
+  if ((int)row.size() < width) row.resize(width);
+
+  std::shared_ptr<const LUTTable> pinned;
+  if (table==0) {
+    pinned = CMVisionThreshold::pinLUT(lut,format);
+    table = pinned.get();
+  }
+  int j = 0;
+  Range::PixelSpan full;
+  full.set(0,width);
+  for(int y=0; y<height && j<max_runs; y++){
+    const Range::PixelSpan * row_spans = &full;
+    int num_spans = 1;
+    if (spans!=0) {
+      row_spans = spans->getSpans(y);
+      num_spans = spans->getNumSpans(y);
+    }
+    const unsigned char * source_row = source_pointer + y * row_bytes;
+    for(int k=0; k<num_spans; k++){
+      Range::PixelSpan span;
+      span.set(std::max(row_spans[k].min,0),std::min(row_spans[k].max,width));
+      if (bayerlut!=0) {
+        CMVisionThreshold::thresholdRowBayer(row.data(), source, y, span, bayerlut, table);
+      } else {
+        CMVisionThreshold::thresholdRow(row.data(), source_row, format, span, lut, rgblut, table);
       }
     }
+    j = encodeRowSpans(row.data(), y, row_spans, num_spans, width, runs, j, max_runs);
   }
 
   runlist->setUsedRuns(j);
+  return true;
 }
 
+void RegionProcessing::decodeRuns(Image<raw8> * tmap, CMVision::RunList * runlist)
+// Reconstructs the flat label image from its run length encoding.
+// Only uses the position, width and color of the runs, so it can
+// also be applied after connectComponents() and extractRegions().
+{
+  unsigned char * map = tmap->getData();
+  int width=tmap->getWidth();
+  const CMVision::Run * runs = runlist->getRunArrayPointer();
+  int num = runlist->getUsedRuns();
 
+  memset(map,0,tmap->getNumBytes());
+  for(int i=0; i<num; i++){
+    const CMVision::Run & r = runs[i];
+    if(r.color.v != 0) {
+      memset(&map[r.y * width + r.x], r.color.v, r.width);
+    }
+  }
+}
 
+void RunTable::fromRunList(RunList * runlist)
+{
+  const Run * runs = runlist->getRunArrayPointer();
+  int num = std::min(runlist->getUsedRuns(), max_runs);
+  for(int i=0; i<num; i++){
+    x[i] = runs[i].x;
+    y[i] = runs[i].y;
+    width[i] = runs[i].width;
+    color[i] = runs[i].color;
+    parent[i] = runs[i].parent;
+  }
+  used_runs = num;
+}
 
-void RegionProcessing::connectComponents(CMVision::RunList * runlist)
-// Connect components using four-connecteness so that the runs each
-// identify the global parent of the connected region they are a part
-// of.  It does this by scanning adjacent rows and merging where
-// similar colors overlap.  Used to be union by rank w/ path
-// compression, but now is just uses path compression as the global
-// parent index is a simpler rank bound in practice.
-// WARNING: This code is complicated.  I'm pretty sure it's a correct
-//   implementation, but minor changes can easily cause big problems.
-//   Read the papers on this library and have a good understanding of
-//   tree-based union find before you touch it
+void RunTable::toRunList(RunList * runlist) const
+{
+  Run * runs = runlist->getRunArrayPointer();
+  int num = std::min(used_runs, runlist->getMaxRuns());
+  for(int i=0; i<num; i++){
+    runs[i].x = x[i];
+    runs[i].y = y[i];
+    runs[i].width = width[i];
+    runs[i].color = color[i];
+    runs[i].parent = parent[i];
+    runs[i].next = 0;
+  }
+  runlist->setUsedRuns(num);
+}
+
+void RegionTable::toRegionList(RegionList * reglist) const
 {
+  Region * reg = reglist->getRegionArrayPointer();
+  int num = std::min(used_regions, reglist->getMaxRegions());
+  for(int i=0; i<num; i++){
+    const CompactRegion & r = regions[i];
+    reg[i].color = r.color;
+    reg[i].x1 = r.x1;
+    reg[i].y1 = r.y1;
+    reg[i].x2 = r.x2;
+    reg[i].y2 = r.y2;
+    reg[i].cen_x = r.cen_x;
+    reg[i].cen_y = r.cen_y;
+    reg[i].area = r.area;
+    reg[i].run_start = r.run_start;
+    reg[i].iterator_id = 0;
+    reg[i].next = 0;
+    reg[i].tree_next = 0;
+  }
+  reglist->setUsedRegions(num);
+}
 
-  CMVision::Run * map=runlist->getRunArrayPointer();
-  int num = runlist->getUsedRuns();
+const Image<raw8> * LabelImage::get()
+{
+  if (!_decoded && _image!=0 && _runs!=0) {
+    RegionProcessing::decodeRuns(_image,_runs);
+  }
+  _decoded=true;
+  return _image;
+}
+
+
+
+
+// Uniform access to the runs of a RunList or a RunTable, so that the
+// connected components code below is shared by both layouts.
+class RunListView {
+  CMVision::Run * map;
+public:
+  explicit RunListView(CMVision::RunList * runlist) : map(runlist->getRunArrayPointer()) {}
+  CMVision::Run get(int i) const {return map[i];}
+  int y(int i) const {return map[i].y;}
+  int & parent(int i) {return map[i].parent;}
+};
+
+class RunTableView {
+  const uint16_t * x;
+  const uint16_t * y_;
+  const uint16_t * width;
+  const raw8 * color;
+  int32_t * parent_;
+public:
+  explicit RunTableView(CMVision::RunTable * runtable)
+    : x(runtable->getX()), y_(runtable->getY()), width(runtable->getWidth()),
+      color(runtable->getColor()), parent_(runtable->getParent()) {}
+  CMVision::Run get(int i) const {
+    CMVision::Run r;
+    r.x = x[i];
+    r.y = y_[i];
+    r.width = width[i];
+    r.color = color[i];
+    r.parent = parent_[i];
+    r.next = 0;
+    return r;
+  }
+  int y(int i) const {return y_[i];}
+  int32_t & parent(int i) {return parent_[i];}
+};
+
+// Connects the runs in [begin,end) of a run list, which must start at the
+// beginning of a row. Parents always point to smaller run indices, but
+// paths are not yet compressed.
+template <class RunMap>
+static void connectRows(RunMap map, int begin, int end)
+{
   int l1,l2;
   CMVision::Run r1,r2;
   int i,j,s;
 
+  if(end - begin < 2) return;
+
   // l2 starts on first scan line, l1 starts on second
-  l2 = 0;
-  l1 = 1;
-  while(map[l1].y == 0) l1++; // skip first line
+  l2 = begin;
+  l1 = begin + 1;
+  while(l1 < end && map.y(l1) == map.y(begin)) l1++; // skip first line
+  if(l1 >= end) return;
 
   // Do rest in lock step
-  r1 = map[l1];
-  r2 = map[l2];
+  r1 = map.get(l1);
+  r2 = map.get(l2);
   s = l1;
-  while(l1 < num){
+  while(l1 < end){
     /*
     printf("%6d:(%3d,%3d,%3d) %6d:(%3d,%3d,%3d)\n",
 	   l1,r1.x,r1.y,r1.width,
@@ -136,44 +425,243 @@ void RegionProcessing::connectComponents(CMVision::RunList * runlist)
         (r1.x<=r2.x && r2.x<r1.x+r1.width)){
         if(s != l1){
           // if we didn't have a parent already, just take this one
-          map[l1].parent = r1.parent = r2.parent;
+          map.parent(l1) = r1.parent = r2.parent;
           s = l1;
         }else if(r1.parent != r2.parent){
           // otherwise union two parents if they are different
 
           // find terminal roots of each path up tree
           i = r1.parent;
-          while(i != map[i].parent) i = map[i].parent;
+          while(i != map.parent(i)) i = map.parent(i);
           j = r2.parent;
-          while(j != map[j].parent) j = map[j].parent;
+          while(j != map.parent(j)) j = map.parent(j);
 
           // union and compress paths; use smaller of two possible
           // representative indicies to preserve DAG property
           if(i < j){
-            map[j].parent = i;
-            map[l1].parent = map[l2].parent = r1.parent = r2.parent = i;
+            map.parent(j) = i;
+            map.parent(l1) = map.parent(l2) = r1.parent = r2.parent = i;
           }else{
-            map[i].parent = j;
-            map[l1].parent = map[l2].parent = r1.parent = r2.parent = j;
+            map.parent(i) = j;
+            map.parent(l1) = map.parent(l2) = r1.parent = r2.parent = j;
           }
         }
       }
     }
 
     // Move to next point where values may change
+    // (never reads beyond end, which might belong to another stripe)
     i = (r2.x + r2.width) - (r1.x + r1.width);
-    if(i >= 0) r1 = map[++l1];
-    if(i <= 0) r2 = map[++l2];
+    if(i >= 0 && ++l1 < end) r1 = map.get(l1);
+    if(i <= 0) r2 = map.get(++l2);
   }
+}
 
-  // Now we need to compress all parent paths
-  for(i=0; i<num; i++){
-    j = map[i].parent;
-    map[i].parent = map[j].parent;
+// Connects the runs [begin,end) and compresses their paths, assuming
+// that all parents are inside of this range.
+template <class RunMap>
+static void connectRange(RunMap map, int begin, int end)
+{
+  int i,j;
+
+  connectRows(map, begin, end);
+
+  for(i=begin; i<end; i++){
+    j = map.parent(i);
+    map.parent(i) = map.parent(j);
+  }
+}
+
+template <class RunMap>
+static int rowStart(RunMap map, int num, int y)
+{
+  int left = 0;
+  int right = num;
+  while(left < right){
+    int m = (left + right) / 2;
+    if(map.y(m) < y){
+      left = m + 1;
+    }else{
+      right = m;
+    }
   }
+  return left;
 }
 
+template <class RunMap>
+static void mergeStripes(RunMap map, const int * stripe_begin, int num_stripes, std::vector<int> & merged)
+{
+  int i,j;
 
+  merged.clear();
+  // (empty stripes are skipped, the seam is then with the stripe above them)
+  int upper_begin = stripe_begin[0];
+  for(int k=1; k<num_stripes; k++){
+    int upper_end = stripe_begin[k];
+    int lower_end = stripe_begin[k+1];
+    if(stripe_begin[k-1] < upper_end) upper_begin = stripe_begin[k-1];
+    if(lower_end <= upper_end || upper_end <= upper_begin) continue;
+
+    // last row of the upper stripe and first row of the lower stripe
+    int l2 = upper_end - 1;
+    while(l2 > upper_begin && map.y(l2-1) == map.y(upper_end-1)) l2--;
+    int l1 = upper_end;
+    int row_end = l1;
+    while(row_end < lower_end && map.y(row_end) == map.y(l1)) row_end++;
+    if(map.y(l1) != map.y(l2) + 1) continue;
+
+    while(l1 < row_end && l2 < upper_end){
+      const CMVision::Run r1 = map.get(l1);
+      const CMVision::Run r2 = map.get(l2);
+      if(r1.color==r2.color && r1.color.v!=0 &&
+         ((r2.x<=r1.x && r1.x<r2.x+r2.width) ||
+          (r1.x<=r2.x && r2.x<r1.x+r1.width))){
+        i = r1.parent;
+        while(i != map.parent(i)) i = map.parent(i);
+        j = r2.parent;
+        while(j != map.parent(j)) j = map.parent(j);
+        if(i < j){
+          map.parent(j) = i;
+          merged.push_back(j);
+        }else if(j < i){
+          map.parent(i) = j;
+          merged.push_back(i);
+        }
+      }
+      i = (r2.x + r2.width) - (r1.x + r1.width);
+      if(i >= 0) l1++;
+      if(i <= 0) l2++;
+    }
+  }
+
+  // point all merged stripe roots directly to their global root
+  for(unsigned int m=0; m<merged.size(); m++){
+    i = merged[m];
+    while(i != map.parent(i)) i = map.parent(i);
+    map.parent(merged[m]) = i;
+  }
+}
+
+template <class RunMap>
+static void compressStripe(RunMap map, int begin, int end)
+{
+  for(int i=begin; i<end; i++){
+    int j = map.parent(i);
+    if(j >= begin && j != i){
+      map.parent(i) = map.parent(j);
+    }
+  }
+}
+
+void RegionProcessing::connectComponents(CMVision::RunList * runlist)
+// Connect components using four-connecteness so that the runs each
+// identify the global parent of the connected region they are a part
+// of.  It does this by scanning adjacent rows and merging where
+// similar colors overlap.  Used to be union by rank w/ path
+// compression, but now is just uses path compression as the global
+// parent index is a simpler rank bound in practice.
+// WARNING: This code is complicated.  I'm pretty sure it's a correct
+//   implementation, but minor changes can easily cause big problems.
+//   Read the papers on this library and have a good understanding of
+//   tree-based union find before you touch it
+{
+  connectRange(RunListView(runlist), 0, runlist->getUsedRuns());
+}
+
+void RegionProcessing::connectComponents(CMVision::RunTable * runtable)
+// Same as above, for the structure-of-arrays layout.
+{
+  connectRange(RunTableView(runtable), 0, runtable->getUsedRuns());
+}
+
+int RegionProcessing::findRowStart(CMVision::RunList * runlist, int y)
+// Binary search for the index of the first run in row y or below.
+{
+  return rowStart(RunListView(runlist), runlist->getUsedRuns(), y);
+}
+
+int RegionProcessing::findRowStart(CMVision::RunTable * runtable, int y)
+{
+  return rowStart(RunTableView(runtable), runtable->getUsedRuns(), y);
+}
+
+void RegionProcessing::encodeRunStripe(Image<raw8> * tmap, int row_begin, int row_end, CMVision::RunList * stripe)
+// Run length encodes rows [row_begin,row_end) into a stripe-local run list.
+{
+  int max_runs = stripe->getMaxRuns();
+  CMVision::Run * runs = stripe->getRunArrayPointer();
+  raw8 * map = tmap->getPixelData();
+  int width=tmap->getWidth();
+
+  int j = 0;
+  for(int y=row_begin; y<row_end && j<max_runs; y++){
+    j = encodeRow(&map[y * width], y, width, runs, j, max_runs);
+  }
+  stripe->setUsedRuns(j);
+}
+
+void RegionProcessing::concatenateRunStripes(CMVision::RunList * runlist, CMVision::RunList * const * stripes, int num_stripes)
+// Appends the stripe-local run lists in order, renumbering the parents
+// to the global run indices. Truncates at the maximum number of runs,
+// just like encodeRuns() does.
+{
+  int max_runs = runlist->getMaxRuns();
+  CMVision::Run * runs = runlist->getRunArrayPointer();
+  int j = 0;
+  for(int k=0; k<num_stripes && j<max_runs; k++){
+    const CMVision::Run * src = stripes[k]->getRunArrayPointer();
+    int n = min(stripes[k]->getUsedRuns(), max_runs - j);
+    for(int i=0; i<n; i++){
+      runs[j] = src[i];
+      runs[j].parent = j;
+      j++;
+    }
+  }
+  runlist->setUsedRuns(j);
+}
+
+void RegionProcessing::connectComponentStripe(CMVision::RunList * runlist, int begin, int end)
+// Connects the components of the runs [begin,end), which must consist
+// of complete rows. Stripes can be processed concurrently, and are then
+// joined by mergeComponentStripes().
+{
+  connectRange(RunListView(runlist), begin, end);
+}
+
+void RegionProcessing::connectComponentStripe(CMVision::RunTable * runtable, int begin, int end)
+{
+  connectRange(RunTableView(runtable), begin, end);
+}
+
+void RegionProcessing::mergeComponentStripes(CMVision::RunList * runlist, const int * stripe_begin, int num_stripes,
+                                             std::vector<int> & merged)
+// Unions the components touching across the seams between consecutive
+// stripes (stripe k covers runs [stripe_begin[k],stripe_begin[k+1]) ).
+// As with connectComponents, the smaller root index always wins, so the
+// final roots are the same as in the sequential version. Afterwards every
+// stripe root points directly to its global root. The merged roots are
+// collected in the caller's scratch vector, which keeps its capacity.
+{
+  mergeStripes(RunListView(runlist), stripe_begin, num_stripes, merged);
+}
+
+void RegionProcessing::mergeComponentStripes(CMVision::RunTable * runtable, const int * stripe_begin, int num_stripes,
+                                             std::vector<int> & merged)
+{
+  mergeStripes(RunTableView(runtable), stripe_begin, num_stripes, merged);
+}
+
+void RegionProcessing::compressComponentStripe(CMVision::RunList * runlist, int begin, int end)
+// Final path compression for a stripe after mergeComponentStripes().
+// Only touches runs inside of the stripe, so stripes can run concurrently.
+{
+  compressStripe(RunListView(runlist), begin, end);
+}
+
+void RegionProcessing::compressComponentStripe(CMVision::RunTable * runtable, int begin, int end)
+{
+  compressStripe(RunTableView(runtable), begin, end);
+}
 
 void RegionProcessing::extractRegions(CMVision::RegionList * reglist, CMVision::RunList * runlist)
 // Takes the list of runs and formats them into a region table,
@@ -247,6 +735,73 @@ void RegionProcessing::extractRegions(CMVision::RegionList * reglist, CMVision::
 
 
 
+void RegionProcessing::extractRegions(CMVision::RegionTable * regtable, CMVision::RunTable * runtable)
+// Same as above for the structure-of-arrays layout, with identical
+// results. The per-run loop only reads 7 bytes of each run plus its
+// parent, and updates a region entry of half the size of Region.
+{
+  int b,i,n,a;
+  int x,y,w;
+  CMVision::CompactRegion * reg = regtable->getRegionArrayPointer();
+  const uint16_t * run_x = runtable->getX();
+  const uint16_t * run_y = runtable->getY();
+  const uint16_t * run_width = runtable->getWidth();
+  const raw8 * run_color = runtable->getColor();
+  int32_t * run_parent = runtable->getParent();
+  int max_reg=regtable->getMaxRegions();
+  int num = runtable->getUsedRuns();
+
+  n = 0;
+
+  for(i=0; i<num; i++){
+    if(run_color[i].v!=0){
+      x = run_x[i];
+      y = run_y[i];
+      w = run_width[i];
+      if(run_parent[i] == i){
+        // Add new region if this run is a root (i.e. self parented)
+        run_parent[i] = b = n;  // renumber to point to region id
+        reg[b].color = run_color[i];
+        reg[b].area = w;
+        reg[b].x1 = x;
+        reg[b].y1 = y;
+        reg[b].x2 = x + w;
+        reg[b].y2 = y;
+        reg[b].cen_x = rangeSum(x,w);
+        reg[b].cen_y = y * w;
+        reg[b].run_start = i;
+        n++;
+        if(n >= max_reg) {
+          regtable->setUsedRegions(max_reg);
+          return;
+        }
+      }else{
+        // Otherwise update region stats incrementally
+        b = run_parent[run_parent[i]];
+        run_parent[i] = b; // update parent to identify region id
+        reg[b].area += w;
+        reg[b].x2 = max(x + w,(int)reg[b].x2);
+        reg[b].x1 = min(x,(int)reg[b].x1);
+        reg[b].y2 = y; // last set by lowest run
+        reg[b].cen_x += rangeSum(x,w);
+        reg[b].cen_y += y * w;
+      }
+    }
+  }
+
+  // calculate centroids from stored sums
+  for(i=0; i<n; i++){
+    a = reg[i].area;
+    reg[i].cen_x = (float)reg[i].cen_x / a;
+    reg[i].cen_y = (float)reg[i].cen_y / a;
+    reg[i].x2--; // change to inclusive range
+  }
+
+  regtable->setUsedRegions(n);
+}
+
+
+
 int RegionProcessing::separateRegions(CMVision::ColorRegionList * colorlist, CMVision::RegionList * reglist, int min_area)
 // Splits the various regions in the region table a separate list for
 // each color.  The lists are threaded through the table using the
@@ -289,75 +844,78 @@ int RegionProcessing::separateRegions(CMVision::ColorRegionList * colorlist, CMV
 
 
 
-// These are the tweaking values for the radix sort given below
-// Feel free to change them, though these values seemed to work well
-// in testing.  Don't worry about extra passes to get all 32 bits of
-// the area; the implementation only does as many passes as needed to
-// touch the most significant set bit (MSB of largest region's area)
-#define CMV_RBITS 6
+// These are the tweaking values for the radix sort given below.
+// A region area below CMV_RADIX is sorted in a single counting pass,
+// larger ones take as many passes as needed to touch the most
+// significant set bit (MSB of largest region's area).
+#define CMV_RBITS 11
 #define CMV_RADIX (1 << CMV_RBITS)
 #define CMV_RMASK (CMV_RADIX-1)
 
-CMVision::Region * RegionProcessing::sortRegionListByArea(CMVision::Region *list,int passes)
-// Sorts a list of regions by their area field.
-// Uses a linked list based radix sort to process the list.
-{
-  CMVision::Region *tbl[CMV_RADIX],*p,*pn;
-  int slot,shift;
-  int i,j;
-
-  // Handle trivial cases
-  if(!list || !list->next) return(list);
-
-  // Initialize table
-  for(j=0; j<CMV_RADIX; j++) tbl[j] = NULL;
-
-  for(i=0; i<passes; i++){
-    // split list into buckets
-    shift = CMV_RBITS * i;
-    p = list;
-    while(p){
-      pn = p->next;
-      slot = ((p->area) >> shift) & CMV_RMASK;
-      p->next = tbl[slot];
-      tbl[slot] = p;
-      p = pn;
-    }
-
-    // integrate back into partially ordered list
-    list = NULL;
-    for(j=0; j<CMV_RADIX; j++){
-      p = tbl[j];
-      tbl[j] = NULL; // clear out table for next pass
-      while(p){
-        pn = p->next;
-        p->next = list;
-        list = p;
-        p = pn;
-      }
-    }
-  }
-
-  return(list);
-}
-
 void RegionProcessing::sortRegions(CMVision::ColorRegionList * colors,int max_area)
-// Sorts entire region table by area, using the above
-// function to sort each threaded region list.
+// Sorts each color's region list by decreasing area, and copies the
+// regions of all colors into one contiguous array, so that each list
+// can afterwards be scanned linearly (see RegionFilter). Regions of
+// equal area keep their order in the list. This is a stable LSD radix
+// sort over an array of pointers; each pass is a counting sort over
+// only as many buckets as the digit of max_area requires.
 {
-  int i,p;
+  int i,j,k,n;
+  int count[CMV_RADIX];
+
   // do minimal number of passes sufficient to touch all set bits
-  p = 0;
-  while(max_area != 0){
-    max_area >>= CMV_RBITS;
-    p++;
-  }
+  int passes = 0;
+  for(int a=max_area; a!=0; a>>=CMV_RBITS) passes++;
 
   int num_colors=colors->getNumColorRegions();
   CMVision::RegionLinkedList * color = colors->getColorRegionArrayPointer();
-  // sort each list
+  int total = 0;
+  for(i=0; i<num_colors; i++){
+    total += color[i].getNumRegions();
+  }
+  std::vector<CMVision::Region *> & order = colors->sort_order;
+  std::vector<CMVision::Region *> & temp = colors->sort_temp;
+  std::vector<CMVision::Region> & sorted = colors->sorted_regions;
+  order.resize(total);
+  temp.resize(total);
+  sorted.resize(total);
+
+  int begin = 0;
   for(i=0; i<num_colors; i++){
-    color[i].setFront(sortRegionListByArea(color[i].getInitialElement(),p));
+    CMVision::Region ** list = &order[begin];
+    CMVision::Region ** buffer = &temp[begin];
+    n = 0;
+    for(CMVision::Region * p=color[i].getInitialElement(); p!=0 && n<total-begin; p=p->next){
+      list[n++] = p;
+    }
+
+    for(int pass=0; pass<passes && n>1; pass++){
+      int shift = CMV_RBITS * pass;
+      int buckets = std::min((max_area >> shift) + 1, CMV_RADIX);
+      for(j=0; j<buckets; j++) count[j] = 0;
+      for(k=0; k<n; k++){
+        count[(list[k]->area >> shift) & CMV_RMASK]++;
+      }
+      // largest digit first
+      int offset = 0;
+      for(j=buckets-1; j>=0; j--){
+        int c = count[j];
+        count[j] = offset;
+        offset += c;
+      }
+      for(k=0; k<n; k++){
+        buffer[count[(list[k]->area >> shift) & CMV_RMASK]++] = list[k];
+      }
+      std::swap(list,buffer);
+    }
+
+    CMVision::Region * out = sorted.data() + begin;
+    for(k=0; k<n; k++){
+      out[k] = *list[k];
+      out[k].next = (k+1 < n) ? &out[k+1] : 0;
+    }
+    color[i].setSorted(n > 0 ? out : 0, n);
+    begin += n;
   }
 }
 
@@ -406,19 +964,13 @@ ImageProcessor::~ImageProcessor() {
 
 void ImageProcessor::processYUV422_UYVY(const RawImage * image, int min_blob_area) {
   img_thresholded->allocate(image->getWidth(),image->getHeight());
-  Image<raw8> mask;
-  mask.allocate(image->getWidth(),image->getHeight());
-  memset(mask.getData(),-1,mask.getNumBytes());
-  CMVisionThreshold::thresholdImageYUV422_UYVY(img_thresholded,image,lut,&mask);
+  CMVisionThreshold::thresholdImageYUV422_UYVY(img_thresholded,image,lut,0);
   processThresholded(img_thresholded,min_blob_area);
 }
 
 void ImageProcessor::processYUV444(const ImageInterface * image, int min_blob_area) {
   img_thresholded->allocate(image->getWidth(),image->getHeight());
-  Image<raw8> mask;
-  mask.allocate(image->getWidth(),image->getHeight());
-  memset(mask.getData(),-1,mask.getNumBytes());
-  CMVisionThreshold::thresholdImageYUV444(img_thresholded,image,lut,&mask);
+  CMVisionThreshold::thresholdImageYUV444(img_thresholded,image,lut,0);
   processThresholded(img_thresholded,min_blob_area);
 }
 
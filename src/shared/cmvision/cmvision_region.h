@@ -27,6 +27,8 @@
 #include "nkdtree.h"
 #include "cmvision_threshold.h"
 #include "lut3d.h"
+#include <stdint.h>
+#include <vector>
 
 namespace CMVision {
 
@@ -70,6 +72,115 @@ public:
 
 
 
+/// Structure-of-arrays alternative to RunList. A run only takes 11 bytes
+/// instead of the 24 bytes of Run, so connectComponents() and
+/// extractRegions() stream through far less memory per frame. Coordinates
+/// are 16 bit, so images can have at most MAX_COORDINATE pixels per side.
+/// The runs of a region are not linked through a next index.
+class RunTable {
+private:
+  std::vector<uint16_t> x,y,width; // location and width of each run
+  std::vector<raw8> color;         // which color(s) each run represents
+  std::vector<int32_t> parent;     // parent run, or region id after extractRegions()
+  int max_runs;
+  int used_runs;
+public:
+  static const int MAX_COORDINATE = 65535;
+
+  explicit RunTable(int _max_runs)
+    : x(_max_runs), y(_max_runs), width(_max_runs), color(_max_runs), parent(_max_runs) {
+    max_runs=_max_runs;
+    used_runs=0;
+  }
+  void setUsedRuns(int runs) {
+    used_runs=runs;
+  }
+  int getUsedRuns() const {
+    return used_runs;
+  }
+  int getMaxRuns() const {
+    return max_runs;
+  }
+  uint16_t * getX() {
+    return x.data();
+  }
+  uint16_t * getY() {
+    return y.data();
+  }
+  uint16_t * getWidth() {
+    return width.data();
+  }
+  raw8 * getColor() {
+    return color.data();
+  }
+  int32_t * getParent() {
+    return parent.data();
+  }
+  /// the number of bytes stored per run
+  static int getBytesPerRun() {
+    return 3*sizeof(uint16_t) + sizeof(raw8) + sizeof(int32_t);
+  }
+  /// copies the runs of \p runlist (truncating at the maximum number of runs)
+  void fromRunList(RunList * runlist);
+  /// copies all runs to \p runlist (truncating at its maximum number of runs)
+  void toRunList(RunList * runlist) const;
+};
+
+
+
+/// The color-labeled image of the current frame.
+/// When thresholding is fused with run-length encoding, only the run list
+/// is produced and the full label image is decoded from it on first request.
+class LabelImage {
+protected:
+  Image<raw8> * _image;
+  RunList * _runs;
+  bool _decoded;
+  unsigned int _version;
+public:
+  LabelImage() {
+    _image=0;
+    _runs=0;
+    _decoded=false;
+    _version=0;
+  }
+  /// the labels of this frame were written to \p image
+  void setImage(Image<raw8> * image) {
+    _image=image;
+    _runs=0;
+    _decoded=true;
+    _version++;
+  }
+  /// the labels of this frame were only encoded to \p runs,
+  /// \p image serves as storage once they are decoded
+  void setRuns(Image<raw8> * image, RunList * runs) {
+    _image=image;
+    _runs=runs;
+    _decoded=false;
+    _version++;
+  }
+  /// returns the run list holding this frame's runs, if thresholding was fused
+  RunList * getEncodedRuns() const {
+    return _runs;
+  }
+  /// whether the label image is available without decoding the runs
+  bool isDecoded() const {
+    return _decoded || _runs==0;
+  }
+  /// changes whenever new labels are set, e.g. to invalidate derived data
+  unsigned int getVersion() const {
+    return _version;
+  }
+  int getWidth() const {
+    return _image!=0 ? _image->getWidth() : 0;
+  }
+  int getHeight() const {
+    return _image!=0 ? _image->getHeight() : 0;
+  }
+  /// returns the label image, decoding it from the run list if required
+  const Image<raw8> * get();
+};
+
 class Region{
   public:
   raw8 color;        // id of the color
@@ -122,10 +233,50 @@ public:
 };
 
 
+/// Compact region entry produced from a RunTable. Holds only what
+/// extractRegions() updates per run, without the list pointers of Region,
+/// so that the randomly accessed region table stays small.
+class CompactRegion {
+public:
+  float cen_x,cen_y;      // centroid (sums of the coordinates while extracting)
+  int area;               // occupied area in pixels
+  int run_start;          // first run index for this region
+  uint16_t x1,y1,x2,y2;   // bounding box (x1,y1) - (x2,y2)
+  raw8 color;             // id of the color
+};
+
+class RegionTable {
+private:
+  std::vector<CompactRegion> regions;
+  int max_regions;
+  int used_regions;
+public:
+  explicit RegionTable(int _max_regions) : regions(_max_regions) {
+    max_regions=_max_regions;
+    used_regions=0;
+  }
+  void setUsedRegions(int regions) {
+    used_regions=regions;
+  }
+  int getUsedRegions() const {
+    return used_regions;
+  }
+  CompactRegion * getRegionArrayPointer() {
+    return regions.data();
+  }
+  int getMaxRegions() const {
+    return max_regions;
+  }
+  /// converts the regions to \p reglist, e.g. for separateRegions()
+  void toRegionList(RegionList * reglist) const;
+};
+
+
 class RegionLinkedList {
 protected:
   Region * _first;
   int _num;
+  bool _contiguous;
 public:
   RegionLinkedList() {
     reset();
@@ -136,20 +287,34 @@ public:
   int getNumRegions() const {
    return _num;
   };
+  /// whether the regions are stored in an array sorted by decreasing area,
+  /// i.e. the i-th region of the list is getInitialElement()[i]
+  bool isContiguous() const {
+    return _contiguous;
+  }
   void setFront(Region * r) {
     _first=r;
+    _contiguous=false;
   }
   void setNum(int num) {
     _num=num;
   }
+  /// sets the list to the \p num regions of the sorted array \p first
+  void setSorted(Region * first, int num) {
+    _first=first;
+    _num=num;
+    _contiguous=true;
+  }
   void reset() {
     _first=0;
     _num=0;
+    _contiguous=false;
   }
   inline void insertFront(Region * r) {
     r->next=_first;
     _first=r;
     _num++;
+    _contiguous=false;
   }
 };
 
@@ -157,6 +322,11 @@ class ColorRegionList {
 private:
   RegionLinkedList * color_regions;
   int num_color_regions;
+  //storage of RegionProcessing::sortRegions():
+  std::vector<Region> sorted_regions;
+  std::vector<Region *> sort_order;
+  std::vector<Region *> sort_temp;
+  friend class RegionProcessing;
 public:
   ColorRegionList(int _num_color_regions) {
     color_regions=new RegionLinkedList[_num_color_regions];
@@ -231,6 +401,27 @@ public:
     while(reg!=0 && reg->area>area.max) reg = reg->next;
   }
 
+  void init(const CMVision::RegionLinkedList & list) {
+    if (!list.isContiguous()) {
+      init(list.getInitialElement());
+      return;
+    }
+
+    // binary search for the first region that is not too large
+    const CMVision::Region * first = list.getInitialElement();
+    int left = 0;
+    int right = list.getNumRegions();
+    while(left < right){
+      int m = (left + right) / 2;
+      if(first[m].area > area.max){
+        left = m + 1;
+      }else{
+        right = m;
+      }
+    }
+    reg = (left < list.getNumRegions()) ? &first[left] : 0;
+  }
+
   const CMVision::Region * getNext()
   {
     // terminate when no regions, or no suitably large ones
@@ -293,19 +484,45 @@ public:
     ~RegionProcessing();
 
     static void encodeRuns(Image<raw8> * tmap, CMVision::RunList * runlist);
+    //thresholds and encodes in a single pass without writing a label image,
+    //skipping all pixels outside of the row spans (if not null).
+    //Uses the pinned table if given, see CMVisionThreshold::pinLUT().
+    //The labels of each row go to the caller's row buffer, which grows to the image width once:
+    static bool thresholdAndEncodeRuns(const RawImage * source, YUVLUT * lut, const RowSpans * spans, CMVision::RunList * runlist,
+                                       std::vector<raw8> & row, const LUTTable * table=0);
+    static void decodeRuns(Image<raw8> * tmap, CMVision::RunList * runlist);
     static void connectComponents(CMVision::RunList * runlist);
+
+    //the same steps for the structure-of-arrays layout, encodeRuns fails for images
+    //larger than RunTable::MAX_COORDINATE:
+    static bool encodeRuns(Image<raw8> * tmap, CMVision::RunTable * runtable);
+    static void connectComponents(CMVision::RunTable * runtable);
+    static int  findRowStart(CMVision::RunTable * runtable, int y);
+    static void connectComponentStripe(CMVision::RunTable * runtable, int begin, int end);
+    static void mergeComponentStripes(CMVision::RunTable * runtable, const int * stripe_begin, int num_stripes,
+                                      std::vector<int> & merged);
+    static void compressComponentStripe(CMVision::RunTable * runtable, int begin, int end);
+    static void extractRegions(CMVision::RegionTable * regtable, CMVision::RunTable * runtable);
+
+    //stripe-parallel variants of encodeRuns and connectComponents with identical results:
+    static int  findRowStart(CMVision::RunList * runlist, int y);
+    static void encodeRunStripe(Image<raw8> * tmap, int row_begin, int row_end, CMVision::RunList * stripe);
+    static void concatenateRunStripes(CMVision::RunList * runlist, CMVision::RunList * const * stripes, int num_stripes);
+    static void connectComponentStripe(CMVision::RunList * runlist, int begin, int end);
+    static void mergeComponentStripes(CMVision::RunList * runlist, const int * stripe_begin, int num_stripes,
+                                      std::vector<int> & merged);
+    static void compressComponentStripe(CMVision::RunList * runlist, int begin, int end);
+
     static void extractRegions(CMVision::RegionList * reglist, CMVision::RunList * runlist);
     //returns the max area found:
     static int  separateRegions(CMVision::ColorRegionList * colorlist, CMVision::RegionList * reglist, int min_area);
 
-    static CMVision::Region * sortRegionListByArea(CMVision::Region *list,int passes);
+    //sorts the lists by decreasing area into contiguous per-color arrays, max_area as
+    //returned by separateRegions bounds the number of passes:
     static void sortRegions(CMVision::ColorRegionList * colors,int max_area);
 
 };
 
-//a region-tree (assuming square-pixels):
-typedef NKDTree<Region,float,2,false,CMVision::RegionTreeGetNext> RegionTree;
-
 class ImageProcessor {
 protected:
   YUVLUT * lut;
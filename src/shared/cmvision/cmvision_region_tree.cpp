@@ -0,0 +1,206 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    cmvision_region_tree.cpp
+  \brief   C++ Implementation: RegionGrid, RegionTree
+*/
+//========================================================================
+#include "cmvision_region_tree.h"
+#include <algorithm>
+#include <cmath>
+
+namespace CMVision {
+
+RegionGrid::RegionGrid()
+{
+  setCellSize(20.0f);
+  min_x=min_y=0.0f;
+  cols=rows=0;
+  next_hit=0;
+}
+
+void RegionGrid::setCellSize(float size) {
+  cell_size=std::max(size,1.0f);
+  inv_cell=1.0f/cell_size;
+}
+
+void RegionGrid::clear() {
+  regions.clear();
+  cols=rows=0;
+  endQuery();
+}
+
+void RegionGrid::build() {
+  int n=regions.size();
+  if (n==0) {
+    cols=rows=0;
+    return;
+  }
+
+  float max_x, max_y;
+  min_x=max_x=regions[0]->cen_x;
+  min_y=max_y=regions[0]->cen_y;
+  for (int i=1;i<n;i++) {
+    min_x=std::min(min_x,regions[i]->cen_x);
+    max_x=std::max(max_x,regions[i]->cen_x);
+    min_y=std::min(min_y,regions[i]->cen_y);
+    max_y=std::max(max_y,regions[i]->cen_y);
+  }
+
+  //coarsen the grid if it would have many more cells than regions (which only
+  //happens for a few regions scattered over the image), so clearing it stays cheap:
+  float size=cell_size;
+  long long max_cells=std::max(4*n,1024);
+  while (true) {
+    cols=(int)((max_x-min_x)/size)+1;
+    rows=(int)((max_y-min_y)/size)+1;
+    if ((long long)cols*rows <= max_cells) break;
+    size*=2.0f;
+  }
+  inv_cell=1.0f/size;
+
+  //counting sort of the regions by cell, keeping the order of each cell:
+  region_cell.resize(n);
+  cell_start.assign(cols*rows+1,0);
+  for (int i=0;i<n;i++) {
+    int cx=std::min((int)((regions[i]->cen_x-min_x)*inv_cell),cols-1);
+    int cy=std::min((int)((regions[i]->cen_y-min_y)*inv_cell),rows-1);
+    region_cell[i]=cy*cols+cx;
+    cell_start[region_cell[i]+1]++;
+  }
+  for (int c=0;c<cols*rows;c++) {
+    cell_start[c+1]+=cell_start[c];
+  }
+  cell_regions.resize(n);
+  for (int i=0;i<n;i++) {
+    cell_regions[cell_start[region_cell[i]]++]=i;
+  }
+  //the fill pass advanced each start to the next cell's start:
+  for (int c=cols*rows;c>0;c--) {
+    cell_start[c]=cell_start[c-1];
+  }
+  cell_start[0]=0;
+}
+
+void RegionGrid::startQuery(const Region & query_point, double query_max_dist) {
+  endQuery();
+  if (cols==0 || query_max_dist <= 0.0) return;
+
+  float qx=query_point.cen_x;
+  float qy=query_point.cen_y;
+  float r=query_max_dist;
+  int x0=std::max((int)std::floor((qx-r-min_x)*inv_cell),0);
+  int y0=std::max((int)std::floor((qy-r-min_y)*inv_cell),0);
+  int x1=std::min((int)std::floor((qx+r-min_x)*inv_cell),cols-1);
+  int y1=std::min((int)std::floor((qy+r-min_y)*inv_cell),rows-1);
+
+  for (int cy=y0;cy<=y1;cy++) {
+    for (int cx=x0;cx<=x1;cx++) {
+      int c=cy*cols+cx;
+      for (int k=cell_start[c];k<cell_start[c+1];k++) {
+        Region * reg=regions[cell_regions[k]];
+        //the same arithmetic as NKDTree, so both return the same neighbors:
+        float dx=qx-reg->cen_x;
+        float dy=qy-reg->cen_y;
+        double d=0.0;
+        d+=dx*dx;
+        d+=dy*dy;
+        Hit h;
+        h.dist=sqrt(d);
+        if (h.dist < query_max_dist) {
+          h.index=cell_regions[k];
+          h.reg=reg;
+          hits.push_back(h);
+        }
+      }
+    }
+  }
+  std::sort(hits.begin(),hits.end());
+}
+
+Region * RegionGrid::getNextNearest(double & dist) {
+  if (next_hit >= hits.size()) return 0;
+  dist=hits[next_hit].dist;
+  return hits[next_hit++].reg;
+}
+
+void RegionGrid::endQuery() {
+  hits.clear();
+  next_hit=0;
+}
+
+RegionTree::RegionTree()
+{
+  use_grid=false;
+  tree_built=false;
+  grid_built=false;
+  query_grid=false;
+}
+
+void RegionTree::clear() {
+  regions.clear();
+  tree.clear();
+  grid.clear();
+  tree_built=false;
+  grid_built=false;
+}
+
+void RegionTree::build() {
+  tree_built=false;
+  grid_built=false;
+}
+
+void RegionTree::setUseGrid(bool enable, float cell_size) {
+  use_grid=enable;
+  if (enable && cell_size != grid.getCellSize()) {
+    grid.setCellSize(cell_size);
+    grid_built=false;
+  }
+}
+
+void RegionTree::startQuery(const Region & query_point, double query_max_dist) {
+  query_grid=use_grid;
+  if (query_grid) {
+    if (!grid_built) {
+      grid.clear();
+      for (Region * reg : regions) grid.add(reg);
+      grid.build();
+      grid_built=true;
+    }
+    grid.startQuery(query_point,query_max_dist);
+  } else {
+    if (!tree_built) {
+      tree.clear();
+      for (Region * reg : regions) tree.add(reg);
+      tree.build();
+      tree_built=true;
+    }
+    tree.startQuery(query_point,query_max_dist);
+  }
+}
+
+Region * RegionTree::getNextNearest(double & dist) {
+  return query_grid ? grid.getNextNearest(dist) : tree.getNextNearest(dist);
+}
+
+void RegionTree::endQuery() {
+  if (query_grid) {
+    grid.endQuery();
+  } else {
+    tree.endQuery();
+  }
+}
+
+}
@@ -0,0 +1,119 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    cmvision_region_tree.h
+  \brief   C++ Interface: RegionGrid, RegionTree
+*/
+//========================================================================
+#ifndef CMVISION_REGION_TREE_H
+#define CMVISION_REGION_TREE_H
+#include "cmvision_region.h"
+#include "nkdtree.h"
+#include <vector>
+
+namespace CMVision {
+
+/*!
+  \class RegionGrid
+  \brief A uniform grid of buckets over the region centroids
+
+  Built with a counting sort in linear time, without allocating once its
+  buffers have grown to the number of regions. A query with a radius of up
+  to the cell size only looks at the 3x3 cells around the query point.
+  The neighbors are returned by increasing distance, just like
+  NKDTree::getNextNearest(). Neighbors at the same distance come in the
+  order they were added.
+*/
+class RegionGrid {
+protected:
+  struct Hit {
+    float dist;
+    int index;
+    Region * reg;
+    bool operator<(const Hit & h) const {
+      return dist < h.dist || (dist == h.dist && index < h.index);
+    }
+  };
+
+  float cell_size;
+  float inv_cell;
+  float min_x, min_y;
+  int cols, rows;
+  std::vector<Region *> regions;   //in the order they were added
+  std::vector<int> region_cell;
+  std::vector<int> cell_start;     //first entry of each cell in cell_regions, and the end
+  std::vector<int> cell_regions;   //indices into regions, grouped by cell
+
+  std::vector<Hit> hits;
+  unsigned int next_hit;
+
+public:
+  RegionGrid();
+
+  /// the edge length of the cells in pixels, ideally the largest query radius
+  void setCellSize(float size);
+  float getCellSize() const { return cell_size; }
+
+  void clear();
+  void add(Region * reg) { regions.push_back(reg); }
+  void build();
+
+  void startQuery(const Region & query_point, double query_max_dist);
+  Region * getNextNearest(double & dist);
+  void endQuery();
+
+  bool isEmpty() const { return regions.empty(); }
+};
+
+/*!
+  \class RegionTree
+  \brief Spatial lookup of the regions near a point, with a selectable index
+
+  Collects the regions of a frame and answers radius queries about them
+  either with an NKDTree or with a RegionGrid. Only the index that is
+  selected when the first query after build() starts is built, so
+  switching between them at runtime costs nothing when not in use.
+*/
+class RegionTree {
+protected:
+  NKDTree<Region,float,2,false,RegionTreeGetNext> tree;
+  RegionGrid grid;
+  std::vector<Region *> regions;
+  bool use_grid;
+  bool tree_built;
+  bool grid_built;
+  bool query_grid;  //index of the running query
+
+public:
+  RegionTree();
+
+  void clear();
+  void add(Region * reg) { regions.push_back(reg); }
+  /// marks the end of adding regions
+  void build();
+
+  /// selects the grid (with cells of \p cell_size pixels) instead of the
+  /// NKDTree for the following queries
+  void setUseGrid(bool enable, float cell_size);
+  bool isUsingGrid() const { return use_grid; }
+
+  void startQuery(const Region & query_point, double query_max_dist);
+  Region * getNextNearest(double & dist);
+  void endQuery();
+};
+
+}
+
+#endif
@@ -20,108 +20,349 @@
 */
 //========================================================================
 #include "cmvision_threshold.h"
-#ifdef __AVX2__
+#include <algorithm>
+#include <string.h>
+#if defined(__AVX2__) || defined(SIMD_DISPATCH)
 #include <x86intrin.h>
 #endif
 
-CMVisionThreshold::CMVisionThreshold()
-{
-}
+// The index computation and masking below are identical to the scalar
+// CMVision code, so all kernels produce bit-identical label images.
+// The SIMD kernels are compiled with per-function target attributes and
+// selected at runtime, so they are available even without -march=native.
+struct LUTShifts {
+  int X_SHIFT;
+  int Y_SHIFT;
+  int Z_SHIFT;
+  int Z_AND_Y_BITS;
+  int Z_BITS;
+  int TOTAL_BITS;
+};
 
+static LUTShifts getLUTShifts(const LUT3D * lut) {
+  LUTShifts s;
+  s.X_SHIFT=lut->X_SHIFT;
+  s.Y_SHIFT=lut->Y_SHIFT;
+  s.Z_SHIFT=lut->Z_SHIFT;
+  s.Z_AND_Y_BITS=lut->Z_AND_Y_BITS;
+  s.Z_BITS=lut->Z_BITS;
+  s.TOTAL_BITS=lut->TOTAL_BITS;
+  return s;
+}
 
-CMVisionThreshold::~CMVisionThreshold()
-{
+template <bool masked>
+static void thresholdUYVYScalar(raw8 * target_pointer, const uyvy * source_pointer, const unsigned char * mask_pointer,
+                                unsigned int begin, unsigned int end, const lut_mask_t * LUT, const LUTShifts & s) {
+  uyvy p;
+  for (unsigned int i=begin;i<end;i+=2) {
+    p=source_pointer[(i >> 0x01)];
+    int B=((p.u >> s.Y_SHIFT) << s.Z_BITS);
+    int C=(p.v >> s.Z_SHIFT);
+    lut_mask_t l1 = LUT[(((p.y1 >> s.X_SHIFT) << s.Z_AND_Y_BITS) | B | C)];
+    lut_mask_t l2 = LUT[(((p.y2 >> s.X_SHIFT) << s.Z_AND_Y_BITS) | B | C)];
+    target_pointer[i] = masked ? (mask_pointer[i] & l1) : l1;
+    target_pointer[i+1] = masked ? (mask_pointer[i+1] & l2) : l2;
+  }
 }
 
-bool CMVisionThreshold::thresholdImageYUV422_UYVY(Image<raw8> * target, const RawImage * source, YUVLUT * lut, const ImageInterface* mask) {
-  if (source->getColorFormat()!=COLOR_YUV422_UYVY) {
-    //TODO add YUV444 and maybe even 411 mode
-    fprintf(stderr,"CMVision thresholdImageYUV422_UYVY assumes YUV422 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
-    return false;
+template <bool masked>
+static void thresholdYUV444Scalar(raw8 * target_pointer, const yuv * source_pointer, const unsigned char * mask_pointer,
+                                  unsigned int begin, unsigned int end, const lut_mask_t * LUT, const LUTShifts & s) {
+  yuv p;
+  for (unsigned int i=begin;i<end;i++) {
+    p=source_pointer[i];
+    lut_mask_t l = LUT[(((p.y >> s.X_SHIFT) << s.Z_AND_Y_BITS) | ((p.u >> s.Y_SHIFT) << s.Z_BITS) | (p.v >> s.Z_SHIFT))];
+    target_pointer[i] = masked ? (mask_pointer[i] & l) : l;
   }
+}
 
-  register lut_mask_t * LUT = lut->getTable();
+#ifdef SIMD_DISPATCH
 
-  register unsigned int          target_size    = target->getNumPixels();
-  register uyvy *       source_pointer = (uyvy*)(source->getData());
-  register raw8 *      target_pointer = target->getPixelData();
-  register unsigned char *      mask_pointer = mask->getData();
+// SSE4.1: compute 16 LUT indices at a time in 16-bit lanes, look them up
+// with scalar loads and apply the mask (if any) with a single SIMD AND.
+// Requires TOTAL_BITS <= 16 so that indices fit into 16-bit lanes.
+template <bool masked>
+__attribute__((target("sse4.1")))
+static unsigned int thresholdUYVYSSE41(raw8 * target_pointer, const uyvy * source_pointer, const unsigned char * mask_pointer,
+                                       unsigned int size, const lut_mask_t * LUT, const LUTShifts & s) {
+  const __m128i x_shift = _mm_cvtsi32_si128(s.X_SHIFT);
+  const __m128i y_shift = _mm_cvtsi32_si128(s.Y_SHIFT);
+  const __m128i z_shift = _mm_cvtsi32_si128(s.Z_SHIFT);
+  const __m128i z_and_y_bits = _mm_cvtsi32_si128(s.Z_AND_Y_BITS);
+  const __m128i z_bits = _mm_cvtsi32_si128(s.Z_BITS);
+  const __m128i low_byte = _mm_set1_epi16(0x00FF);
+  const uint8_t * source_bytes = (const uint8_t *)source_pointer;
+  uint8_t * target_bytes = (uint8_t *)target_pointer;
+  uint16_t idx[16];
+  alignas(16) uint8_t labels[16];
 
-  if (target->getNumPixels() != source->getNumPixels()) {
-    fprintf(stderr, "CMVision YUV422_UYVY thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
-    return false;
-  }
+  unsigned int i=0;
+  for (; i+16<=size; i+=16) {
+    for (int k=0; k<2; k++) {
+      // each 16-bit lane holds (u,y1) on even and (v,y2) on odd positions
+      const __m128i chunk = _mm_loadu_si128((const __m128i*)(source_bytes + 2*i + 16*k));
+      const __m128i lo = _mm_and_si128(chunk, low_byte);
+      const __m128i hi = _mm_srli_epi16(chunk, 8);
 
-  lut->lock();
-  int X_SHIFT=lut->X_SHIFT;
-  int Y_SHIFT=lut->Y_SHIFT;
-  int Z_SHIFT=lut->Z_SHIFT;
-  int Z_AND_Y_BITS=lut->Z_AND_Y_BITS;
-  int Z_BITS = lut->Z_BITS;
-  uyvy p;
-  for (unsigned int i=0;i<target_size;i+=2) {
-    p=source_pointer[(i >> 0x01)];
-    register int B=((p.u >> Y_SHIFT) << Z_BITS);
-    register int C=(p.v >> Z_SHIFT);
-    target_pointer[i] =  mask_pointer[i] & LUT[(((p.y1 >> X_SHIFT) << Z_AND_Y_BITS) | B | C)];
-    target_pointer[i+1] =  mask_pointer[i+1] & LUT[(((p.y2 >> X_SHIFT) << Z_AND_Y_BITS) | B | C)];
+      const __m128i us = _mm_sll_epi16(_mm_srl_epi16(lo, y_shift), z_bits);
+      const __m128i vs = _mm_srl_epi16(lo, z_shift);
+      const __m128i uv = _mm_blend_epi16(us, vs, 0xAA);
+      // combine the u and v part of each pixel pair
+      const __m128i common = _mm_or_si128(uv, _mm_or_si128(_mm_slli_epi32(uv, 16), _mm_srli_epi32(uv, 16)));
+      const __m128i ys = _mm_sll_epi16(_mm_srl_epi16(hi, x_shift), z_and_y_bits);
+
+      _mm_storeu_si128((__m128i*)(idx + 8*k), _mm_or_si128(ys, common));
+    }
+
+#pragma GCC unroll 16
+    for (int j=0; j<16; j++) {
+      labels[j] = LUT[idx[j]];
+    }
+
+    __m128i result = _mm_load_si128((const __m128i*)labels);
+    if (masked) result = _mm_and_si128(_mm_loadu_si128((const __m128i*)(mask_pointer + i)), result);
+    _mm_storeu_si128((__m128i*)(target_bytes + i), result);
   }
-  lut->unlock();
-  return true;
+  return i;
 }
 
-bool CMVisionThreshold::thresholdImageYUV444(Image<raw8> * target, const ImageInterface * source, YUVLUT * lut, const ImageInterface* mask) {
-  if (source->getColorFormat()!=COLOR_YUV444) {
-    fprintf(stderr,"CMVision thresholdImageYUV444 assumes YUV444 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
-    return false;
+// AVX2: compute 32 LUT indices at a time in 32-bit lanes and fetch the
+// labels with hardware gathers. A gather reads 4 bytes starting at the
+// index, which stays within the table as LUT_SIZE is twice the index range.
+template <bool masked>
+__attribute__((target("avx2")))
+static unsigned int thresholdUYVYAVX2(raw8 * target_pointer, const uyvy * source_pointer, const unsigned char * mask_pointer,
+                                      unsigned int size, const lut_mask_t * LUT, const LUTShifts & s) {
+  const __m128i x_shift = _mm_cvtsi32_si128(s.X_SHIFT);
+  const __m128i y_shift = _mm_cvtsi32_si128(s.Y_SHIFT);
+  const __m128i z_shift = _mm_cvtsi32_si128(s.Z_SHIFT);
+  const __m128i z_and_y_bits = _mm_cvtsi32_si128(s.Z_AND_Y_BITS);
+  const __m128i z_bits = _mm_cvtsi32_si128(s.Z_BITS);
+  const __m256i low_byte = _mm256_set1_epi32(0xFF);
+  const uint8_t * source_bytes = (const uint8_t *)source_pointer;
+  uint8_t * target_bytes = (uint8_t *)target_pointer;
+  const int * table = (const int *)LUT;
+
+  unsigned int i=0;
+  for (; i+32<=size; i+=32) {
+    __m256i pairs[2];
+    for (int k=0; k<2; k++) {
+      // each 32-bit lane holds one u,y1,v,y2 macro-pixel
+      const __m256i q = _mm256_loadu_si256((const __m256i*)(source_bytes + 2*i + 32*k));
+      const __m256i u = _mm256_and_si256(q, low_byte);
+      const __m256i y1 = _mm256_and_si256(_mm256_srli_epi32(q, 8), low_byte);
+      const __m256i v = _mm256_and_si256(_mm256_srli_epi32(q, 16), low_byte);
+      const __m256i y2 = _mm256_srli_epi32(q, 24);
+
+      const __m256i common = _mm256_or_si256(_mm256_sll_epi32(_mm256_srl_epi32(u, y_shift), z_bits),
+                                             _mm256_srl_epi32(v, z_shift));
+      const __m256i idx1 = _mm256_or_si256(_mm256_sll_epi32(_mm256_srl_epi32(y1, x_shift), z_and_y_bits), common);
+      const __m256i idx2 = _mm256_or_si256(_mm256_sll_epi32(_mm256_srl_epi32(y2, x_shift), z_and_y_bits), common);
+
+      const __m256i l1 = _mm256_and_si256(_mm256_i32gather_epi32(table, idx1, 1), low_byte);
+      const __m256i l2 = _mm256_and_si256(_mm256_i32gather_epi32(table, idx2, 1), low_byte);
+      // two labels per macro-pixel, in output order
+      pairs[k] = _mm256_or_si256(l1, _mm256_slli_epi32(l2, 8));
+    }
+
+    // narrow to 16-bit pairs and undo the per-lane interleaving of packus
+    const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(pairs[0], pairs[1]), _MM_SHUFFLE(3,1,2,0));
+    __m256i result = packed;
+    if (masked) result = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(mask_pointer + i)), result);
+    _mm256_storeu_si256((__m256i*)(target_bytes + i), result);
   }
+  return i;
+}
 
-  register lut_mask_t * LUT = lut->getTable();
+template <bool masked>
+__attribute__((target("sse4.1")))
+static unsigned int thresholdYUV444SSE41(raw8 * target_pointer, const yuv * source_pointer, const unsigned char * mask_pointer,
+                                         unsigned int size, const lut_mask_t * LUT, const LUTShifts & s) {
+  const __m128i y_indeces_0 = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 15, 12, 9, 6, 3, 0);
+  const __m128i y_indeces_1 = _mm_set_epi8(-1, -1, -1, -1, -1, 14, 11, 8, 5, 2, -1, -1, -1, -1, -1, -1);
+  const __m128i y_indeces_2 = _mm_set_epi8(13, 10, 7, 4, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i u_indeces_0 = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 13, 10, 7, 4, 1);
+  const __m128i u_indeces_1 = _mm_set_epi8(-1, -1, -1, -1, -1, 15, 12, 9, 6, 3, 0, -1, -1, -1, -1, -1);
+  const __m128i u_indeces_2 = _mm_set_epi8(14, 11, 8, 5, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i v_indeces_0 = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 14, 11, 8, 5, 2);
+  const __m128i v_indeces_1 = _mm_set_epi8(-1, -1, -1, -1, -1, -1, 13, 10, 7, 4, 1, -1, -1, -1, -1, -1);
+  const __m128i v_indeces_2 = _mm_set_epi8(15, 12, 9, 6, 3, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i x_shift = _mm_cvtsi32_si128(s.X_SHIFT);
+  const __m128i y_shift = _mm_cvtsi32_si128(s.Y_SHIFT);
+  const __m128i z_shift = _mm_cvtsi32_si128(s.Z_SHIFT);
+  const __m128i z_and_y_bits = _mm_cvtsi32_si128(s.Z_AND_Y_BITS);
+  const __m128i z_bits = _mm_cvtsi32_si128(s.Z_BITS);
+  const uint8_t * source_bytes = (const uint8_t *)source_pointer;
+  uint8_t * target_bytes = (uint8_t *)target_pointer;
+  uint16_t idx[16];
+  alignas(16) uint8_t labels[16];
 
-  register unsigned int          target_size    = target->getNumPixels();
-  register yuv  *                source_pointer = (yuv*)(source->getData());
-  register raw8 *                target_pointer = target->getPixelData();
-  register unsigned char *       mask_pointer = mask->getData();
+  unsigned int i=0;
+  for (; i+16<=size; i+=16) {
+    const __m128i chunk0 = _mm_loadu_si128((const __m128i*)(source_bytes + 3*i));
+    const __m128i chunk1 = _mm_loadu_si128((const __m128i*)(source_bytes + 3*i + 16));
+    const __m128i chunk2 = _mm_loadu_si128((const __m128i*)(source_bytes + 3*i + 32));
 
-  if (target->getNumPixels() != source->getNumPixels()) {
-     fprintf(stderr, "CMVision YUV444 thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
-    return false;
+    const __m128i y = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(chunk0, y_indeces_0),
+                                                _mm_shuffle_epi8(chunk1, y_indeces_1)), _mm_shuffle_epi8(chunk2, y_indeces_2));
+    const __m128i u = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(chunk0, u_indeces_0),
+                                                _mm_shuffle_epi8(chunk1, u_indeces_1)), _mm_shuffle_epi8(chunk2, u_indeces_2));
+    const __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(chunk0, v_indeces_0),
+                                                _mm_shuffle_epi8(chunk1, v_indeces_1)), _mm_shuffle_epi8(chunk2, v_indeces_2));
+
+    for (int k=0; k<2; k++) {
+      const __m128i yw = _mm_cvtepu8_epi16(k==0 ? y : _mm_srli_si128(y, 8));
+      const __m128i uw = _mm_cvtepu8_epi16(k==0 ? u : _mm_srli_si128(u, 8));
+      const __m128i vw = _mm_cvtepu8_epi16(k==0 ? v : _mm_srli_si128(v, 8));
+      const __m128i result = _mm_or_si128(_mm_sll_epi16(_mm_srl_epi16(yw, x_shift), z_and_y_bits),
+                                          _mm_or_si128(_mm_sll_epi16(_mm_srl_epi16(uw, y_shift), z_bits),
+                                                       _mm_srl_epi16(vw, z_shift)));
+      _mm_storeu_si128((__m128i*)(idx + 8*k), result);
+    }
+
+#pragma GCC unroll 16
+    for (int j=0; j<16; j++) {
+      labels[j] = LUT[idx[j]];
+    }
+
+    __m128i result = _mm_load_si128((const __m128i*)labels);
+    if (masked) result = _mm_and_si128(_mm_loadu_si128((const __m128i*)(mask_pointer + i)), result);
+    _mm_storeu_si128((__m128i*)(target_bytes + i), result);
   }
+  return i;
+}
 
-  lut->lock();
-  int X_SHIFT=lut->X_SHIFT;
-  int Y_SHIFT=lut->Y_SHIFT;
-  int Z_SHIFT=lut->Z_SHIFT;
-  int Z_AND_Y_BITS=lut->Z_AND_Y_BITS;
-  int Z_BITS = lut->Z_BITS;
-  yuv p;
-  for (unsigned int i=0;i<target_size;i++) {
-    p=source_pointer[i];
-    target_pointer[i] =  mask_pointer[i] & LUT[(((p.y >> X_SHIFT) << Z_AND_Y_BITS) | ((p.u >> Y_SHIFT) << Z_BITS) | (p.v >> Z_SHIFT))];
+template <bool masked>
+__attribute__((target("avx2")))
+static unsigned int thresholdYUV444AVX2(raw8 * target_pointer, const yuv * source_pointer, const unsigned char * mask_pointer,
+                                        unsigned int size, const lut_mask_t * LUT, const LUTShifts & s) {
+  const __m128i y_indeces_0 = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 15, 12, 9, 6, 3, 0);
+  const __m128i y_indeces_1 = _mm_set_epi8(-1, -1, -1, -1, -1, 14, 11, 8, 5, 2, -1, -1, -1, -1, -1, -1);
+  const __m128i y_indeces_2 = _mm_set_epi8(13, 10, 7, 4, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i u_indeces_0 = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 13, 10, 7, 4, 1);
+  const __m128i u_indeces_1 = _mm_set_epi8(-1, -1, -1, -1, -1, 15, 12, 9, 6, 3, 0, -1, -1, -1, -1, -1);
+  const __m128i u_indeces_2 = _mm_set_epi8(14, 11, 8, 5, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i v_indeces_0 = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 14, 11, 8, 5, 2);
+  const __m128i v_indeces_1 = _mm_set_epi8(-1, -1, -1, -1, -1, -1, 13, 10, 7, 4, 1, -1, -1, -1, -1, -1);
+  const __m128i v_indeces_2 = _mm_set_epi8(15, 12, 9, 6, 3, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i x_shift = _mm_cvtsi32_si128(s.X_SHIFT);
+  const __m128i y_shift = _mm_cvtsi32_si128(s.Y_SHIFT);
+  const __m128i z_shift = _mm_cvtsi32_si128(s.Z_SHIFT);
+  const __m128i z_and_y_bits = _mm_cvtsi32_si128(s.Z_AND_Y_BITS);
+  const __m128i z_bits = _mm_cvtsi32_si128(s.Z_BITS);
+  const __m256i low_byte = _mm256_set1_epi32(0xFF);
+  const __m256i reorder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  const uint8_t * source_bytes = (const uint8_t *)source_pointer;
+  uint8_t * target_bytes = (uint8_t *)target_pointer;
+  const int * table = (const int *)LUT;
+
+  unsigned int i=0;
+  for (; i+32<=size; i+=32) {
+    __m256i labels[4];
+    for (int k=0; k<2; k++) {
+      const uint8_t * source_pixel = source_bytes + 3*i + 48*k;
+      const __m128i chunk0 = _mm_loadu_si128((const __m128i*)(source_pixel));
+      const __m128i chunk1 = _mm_loadu_si128((const __m128i*)(source_pixel + 16));
+      const __m128i chunk2 = _mm_loadu_si128((const __m128i*)(source_pixel + 32));
+
+      const __m128i y = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(chunk0, y_indeces_0),
+                                                  _mm_shuffle_epi8(chunk1, y_indeces_1)), _mm_shuffle_epi8(chunk2, y_indeces_2));
+      const __m128i u = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(chunk0, u_indeces_0),
+                                                  _mm_shuffle_epi8(chunk1, u_indeces_1)), _mm_shuffle_epi8(chunk2, u_indeces_2));
+      const __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(chunk0, v_indeces_0),
+                                                  _mm_shuffle_epi8(chunk1, v_indeces_1)), _mm_shuffle_epi8(chunk2, v_indeces_2));
+
+      for (int h=0; h<2; h++) {
+        const __m256i yw = _mm256_cvtepu8_epi32(h==0 ? y : _mm_srli_si128(y, 8));
+        const __m256i uw = _mm256_cvtepu8_epi32(h==0 ? u : _mm_srli_si128(u, 8));
+        const __m256i vw = _mm256_cvtepu8_epi32(h==0 ? v : _mm_srli_si128(v, 8));
+        const __m256i idx = _mm256_or_si256(_mm256_sll_epi32(_mm256_srl_epi32(yw, x_shift), z_and_y_bits),
+                                            _mm256_or_si256(_mm256_sll_epi32(_mm256_srl_epi32(uw, y_shift), z_bits),
+                                                            _mm256_srl_epi32(vw, z_shift)));
+        labels[2*k+h] = _mm256_and_si256(_mm256_i32gather_epi32(table, idx, 1), low_byte);
+      }
+    }
+
+    // narrow 4x8 32-bit labels to 32 bytes and restore pixel order
+    const __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(labels[0], labels[1]),
+                                               _mm256_packus_epi32(labels[2], labels[3]));
+    const __m256i ordered = _mm256_permutevar8x32_epi32(packed, reorder);
+    __m256i result = ordered;
+    if (masked) result = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(mask_pointer + i)), result);
+    _mm256_storeu_si256((__m256i*)(target_bytes + i), result);
   }
-  lut->unlock();
+  return i;
+}
 
-  return true;
+#endif
+
+CMVisionThreshold::CMVisionThreshold()
+{
 }
 
 
+CMVisionThreshold::~CMVisionThreshold()
+{
+}
 
-bool CMVisionThreshold::thresholdImageRGB(Image<raw8> * target, const ImageInterface * source, RGBLUT * lut, const ImageInterface* mask) {
-  if (source->getColorFormat()!=COLOR_RGB8) {
-    fprintf(stderr,"CMVision RGB thresholding assumes RGB8 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
-    return false;
+template <bool masked>
+static void thresholdSpanUYVY(raw8 * target, const uyvy * source, const unsigned char * mask, unsigned int n, const YUVLUT * lut, const lut_mask_t * LUT) {
+  LUTShifts shifts = getLUTShifts(lut);
+  unsigned int done = 0;
+#ifdef SIMD_DISPATCH
+  SimdDispatch::SimdLevel level = SimdDispatch::getLevel();
+  if (level == SimdDispatch::SIMD_AVX2) {
+    done = thresholdUYVYAVX2<masked>(target, source, mask, n, LUT, shifts);
+  } else if (level == SimdDispatch::SIMD_SSE41 && shifts.TOTAL_BITS <= 16) {
+    done = thresholdUYVYSSE41<masked>(target, source, mask, n, LUT, shifts);
   }
+#endif
+  thresholdUYVYScalar<masked>(target, source, mask, done, n, LUT, shifts);
+}
 
-  register lut_mask_t * LUT = lut->getTable();
-  int source_size    = source->getNumPixels();
-  const rgb * source_pointer = (const rgb*)(source->getData());
-  auto * target_pointer = (uint8_t*) target->getPixelData();
-  auto * mask_pointer = mask->getData();
+template <bool masked>
+static void thresholdSpanYUV444(raw8 * target, const yuv * source, const unsigned char * mask, unsigned int n, const YUVLUT * lut, const lut_mask_t * LUT) {
+  LUTShifts shifts = getLUTShifts(lut);
+  unsigned int done = 0;
+#ifdef SIMD_DISPATCH
+  SimdDispatch::SimdLevel level = SimdDispatch::getLevel();
+  if (level == SimdDispatch::SIMD_AVX2) {
+    done = thresholdYUV444AVX2<masked>(target, source, mask, n, LUT, shifts);
+  } else if (level == SimdDispatch::SIMD_SSE41 && shifts.TOTAL_BITS <= 16) {
+    done = thresholdYUV444SSE41<masked>(target, source, mask, n, LUT, shifts);
+  }
+#endif
+  thresholdYUV444Scalar<masked>(target, source, mask, done, n, LUT, shifts);
+}
 
-  if (target->getNumPixels() != source->getNumPixels()) {
-    fprintf(stderr, "CMVision RGB thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
-    return false;
+//the pinned table if there is one, otherwise the one that is edited:
+static inline const lut_mask_t * selectTable(const LUT3D * lut, const LUTTable * table) {
+  return table != 0 ? table->getTable() : lut->getTable();
+}
+
+void CMVisionThreshold::thresholdSpanYUV422_UYVY(raw8 * target, const uyvy * source, const unsigned char * mask, unsigned int n, const YUVLUT * lut, const LUTTable * table) {
+  if (mask == 0) {
+    thresholdSpanUYVY<false>(target, source, mask, n, lut, selectTable(lut, table));
+  } else {
+    thresholdSpanUYVY<true>(target, source, mask, n, lut, selectTable(lut, table));
+  }
+}
+
+void CMVisionThreshold::thresholdSpanYUV444(raw8 * target, const yuv * source, const unsigned char * mask, unsigned int n, const YUVLUT * lut, const LUTTable * table) {
+  if (mask == 0) {
+    ::thresholdSpanYUV444<false>(target, source, mask, n, lut, selectTable(lut, table));
+  } else {
+    ::thresholdSpanYUV444<true>(target, source, mask, n, lut, selectTable(lut, table));
   }
+}
+
+template <bool masked>
+static void thresholdSpanRGB(raw8 * target, const rgb * source, const unsigned char * mask, unsigned int n, const RGBLUT * lut, const lut_mask_t * LUT) {
+  auto * target_pointer = (uint8_t*) target;
+  const rgb * source_pointer = source;
+  const unsigned char * mask_pointer = mask;
+  int source_size = (int)n;
+  int i = 0;
 
   int X_SHIFT=lut->X_SHIFT;
   int Y_SHIFT=lut->Y_SHIFT;
@@ -145,7 +386,7 @@ bool CMVisionThreshold::thresholdImageRGB(Image<raw8> * target, const ImageInter
   const rgb* p=&source_pointer[0];
   const uint8_t* source_pixel = (const uint8_t*)p;
 
-  for (int i=0; i<source_size; i+=16) {
+  for (; i+16<=source_size; i+=16) {
 
     // crazy RGB unpacking
     const __m128i chunk0 = _mm_loadu_si128((const __m128i*)(source_pixel));
@@ -177,16 +418,344 @@ bool CMVisionThreshold::thresholdImageRGB(Image<raw8> * target, const ImageInter
 
 #pragma GCC unroll 16
     for(int j=0; j<16; j++) {
-      target_pointer[i+j] = mask_pointer[i] & LUT[idx[j]];
+      target_pointer[i+j] = masked ? (mask_pointer[i+j] & LUT[idx[j]]) : LUT[idx[j]];
     }
   }
-#else
+#endif
   #pragma GCC unroll 4
-  for (int i=0; i<source_size; i++) {
+  for (; i<source_size; i++) {
     rgb p=source_pointer[i];
-    target_pointer[i] = mask_pointer[i] & LUT[(((p.r >> X_SHIFT) << Z_AND_Y_BITS) | ((p.g >> Y_SHIFT) << Z_BITS) | (p.b >> Z_SHIFT))];
+    lut_mask_t l = LUT[(((p.r >> X_SHIFT) << Z_AND_Y_BITS) | ((p.g >> Y_SHIFT) << Z_BITS) | (p.b >> Z_SHIFT))];
+    target_pointer[i] = masked ? (mask_pointer[i] & l) : l;
   }
-#endif
+}
+
+void CMVisionThreshold::thresholdSpanRGB(raw8 * target, const rgb * source, const unsigned char * mask, unsigned int n, const RGBLUT * lut, const LUTTable * table) {
+  if (mask == 0) {
+    ::thresholdSpanRGB<false>(target, source, mask, n, lut, selectTable(lut, table));
+  } else {
+    ::thresholdSpanRGB<true>(target, source, mask, n, lut, selectTable(lut, table));
+  }
+}
+
+// The window of 2x2 samples that starts at column x has its red sample at
+// position q = red ^ (x & 1) ^ ((y & 1) << 1) (x + 2*y within the window),
+// the blue one at q ^ 3 and the green ones at q ^ 1 and q ^ 2.
+static inline lut_mask_t lookupBayer(const unsigned char * row0, const unsigned char * row1, int x, int q,
+                                     const LUTShifts & s, const lut_mask_t * LUT) {
+  const unsigned char v[4] = { row0[x], row0[x + 1], row1[x], row1[x + 1] };
+  int r = v[q];
+  int g = (v[q ^ 1] + v[q ^ 2] + 1) >> 1;
+  int b = v[q ^ 3];
+  return LUT[(((r >> s.X_SHIFT) << s.Z_AND_Y_BITS) | ((g >> s.Y_SHIFT) << s.Z_BITS) | (b >> s.Z_SHIFT))];
+}
+
+void CMVisionThreshold::thresholdRowBayer(raw8 * target, const RawImage * source, int y, const Range::PixelSpan & span,
+                                          const BayerLUT * lut, const LUTTable * table) {
+  int width = source->getWidth();
+  int height = source->getHeight();
+  if (span.max <= span.min || width < 2 || height < 2) return;
+  //the last row and column use the window that ends at them:
+  int y0 = std::min(y, height - 2);
+  const unsigned char * row0 = source->getData() + y0 * width;
+  const unsigned char * row1 = row0 + width;
+  int q0 = (int)lut->getPattern() ^ ((y0 & 1) << 1);
+  LUTShifts s = getLUTShifts(lut);
+  const lut_mask_t * LUT = selectTable(lut, table);
+  auto * target_pointer = (uint8_t*) target;
 
+  int end = std::min(span.max, width - 1);
+  int x = span.min;
+  //two windows per step, which have the same red position as their columns:
+  if (x < end && (x & 1)) {
+    target_pointer[x] = lookupBayer(row0, row1, x, q0 ^ 1, s, LUT);
+    x++;
+  }
+  for (; x + 2 <= end; x += 2) {
+    target_pointer[x] = lookupBayer(row0, row1, x, q0, s, LUT);
+    target_pointer[x + 1] = lookupBayer(row0, row1, x + 1, q0 ^ 1, s, LUT);
+  }
+  for (; x < end; x++) {
+    target_pointer[x] = lookupBayer(row0, row1, x, q0 ^ (x & 1), s, LUT);
+  }
+  if (span.max >= width) {
+    target_pointer[width - 1] = lookupBayer(row0, row1, width - 2, q0 ^ (width & 1), s, LUT);
+  }
+}
+
+bool CMVisionThreshold::thresholdImageYUV422_UYVY(Image<raw8> * target, const RawImage * source, YUVLUT * lut, const ImageInterface* mask) {
+  if (source->getColorFormat()!=COLOR_YUV422_UYVY) {
+    //TODO add YUV444 and maybe even 411 mode
+    fprintf(stderr,"CMVision thresholdImageYUV422_UYVY assumes YUV422 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
+    return false;
+  }
+
+  if (target->getNumPixels() != source->getNumPixels()) {
+    fprintf(stderr, "CMVision YUV422_UYVY thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
+    return false;
+  }
+
+  std::shared_ptr<const LUTTable> table = lut->pin();
+  thresholdSpanYUV422_UYVY(target->getPixelData(), (const uyvy*)(source->getData()), mask != 0 ? mask->getData() : 0, target->getNumPixels(), lut, table.get());
+  return true;
+}
+
+bool CMVisionThreshold::thresholdImageYUV444(Image<raw8> * target, const ImageInterface * source, YUVLUT * lut, const ImageInterface* mask) {
+  if (source->getColorFormat()!=COLOR_YUV444) {
+    fprintf(stderr,"CMVision thresholdImageYUV444 assumes YUV444 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
+    return false;
+  }
+
+  if (target->getNumPixels() != source->getNumPixels()) {
+     fprintf(stderr, "CMVision YUV444 thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
+    return false;
+  }
+
+  std::shared_ptr<const LUTTable> table = lut->pin();
+  thresholdSpanYUV444(target->getPixelData(), (const yuv*)(source->getData()), mask != 0 ? mask->getData() : 0, target->getNumPixels(), lut, table.get());
+
+  return true;
+}
+
+
+
+bool CMVisionThreshold::thresholdImageRGB(Image<raw8> * target, const ImageInterface * source, RGBLUT * lut, const ImageInterface* mask) {
+  if (source->getColorFormat()!=COLOR_RGB8) {
+    fprintf(stderr,"CMVision RGB thresholding assumes RGB8 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
+    return false;
+  }
+
+  if (target->getNumPixels() != source->getNumPixels()) {
+    fprintf(stderr, "CMVision RGB thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
+    return false;
+  }
+
+  std::shared_ptr<const LUTTable> table = lut->pin();
+  thresholdSpanRGB(target->getPixelData(), (const rgb*)(source->getData()), mask != 0 ? mask->getData() : 0, source->getNumPixels(), lut, table.get());
+
+  return true;
+}
+
+void CMVisionThreshold::thresholdRow(raw8 * target, const unsigned char * source, ColorFormat format,
+                                     const Range::PixelSpan & span, const YUVLUT * lut, const RGBLUT * rgblut,
+                                     const LUTTable * table) {
+  if (span.max <= span.min) return;
+  if (format == COLOR_YUV422_UYVY) {
+    //align to macro-pixels:
+    int begin = span.min & ~1;
+    int end = (span.max + 1) & ~1;
+    thresholdSpanYUV422_UYVY(target + begin, (const uyvy*)source + (begin >> 1), 0, end - begin, lut, table);
+  } else if (format == COLOR_YUV444) {
+    thresholdSpanYUV444(target + span.min, (const yuv*)source + span.min, 0, span.max - span.min, lut, table);
+  } else if (format == COLOR_RGB8) {
+    thresholdSpanRGB(target + span.min, (const rgb*)source + span.min, 0, span.max - span.min, rgblut, table);
+  }
+}
+
+/// the LUT that images of \p format are thresholded with, null if the needed derived LUT is missing
+static LUT3D * getFormatLUT(YUVLUT * lut, ColorFormat format) {
+  if (format == COLOR_RGB8) return lut->getDerivedLUT(CSPACE_RGB);
+  if (format == COLOR_RAW8) return lut->getDerivedLUT(CSPACE_BAYER);
+  return lut;
+}
+
+std::shared_ptr<const LUTTable> CMVisionThreshold::pinLUT(YUVLUT * lut, ColorFormat format) {
+  LUT3D * used_lut = getFormatLUT(lut, format);
+  if (used_lut == 0) return std::shared_ptr<const LUTTable>();
+  return used_lut->pin();
+}
+
+bool CMVisionThreshold::thresholdImage(Image<raw8> * target, const RawImage * source, YUVLUT * lut, const RowSpans * spans,
+                                       const LUTTable * table) {
+  return thresholdRows(target, source, lut, spans, 0, source->getHeight(), table);
+}
+
+bool CMVisionThreshold::thresholdRows(Image<raw8> * target, const RawImage * source, YUVLUT * lut, const RowSpans * spans,
+                                      int row_begin, int row_end, const LUTTable * table) {
+  ColorFormat format = source->getColorFormat();
+  if (format != COLOR_YUV422_UYVY && format != COLOR_YUV444 && format != COLOR_RGB8 && format != COLOR_RAW8) {
+    fprintf(stderr, "ColorThresholding needs YUV422, YUV444, RGB8 or RAW8 (Bayer) as input image, but found: %s\n",
+            Colors::colorFormatToString(format).c_str());
+    return false;
+  }
+  RGBLUT * rgblut = 0;
+  if (format == COLOR_RGB8) {
+    rgblut = (RGBLUT *)lut->getDerivedLUT(CSPACE_RGB);
+    if (rgblut == 0) {
+      printf("WARNING: No RGB LUT has been defined. You need to create a derived RGB LUT by calling e.g. \"lut_yuv->addDerivedLUT(new RGBLUT(5,5,5,\"\"))\" in the stack constructor!\n");
+      return false;
+    }
+  }
+  BayerLUT * bayerlut = 0;
+  if (format == COLOR_RAW8) {
+    bayerlut = (BayerLUT *)lut->getDerivedLUT(CSPACE_BAYER);
+    if (bayerlut == 0) {
+      printf("WARNING: No Bayer LUT has been defined. You need to create a derived Bayer LUT by calling e.g. \"lut_yuv->addDerivedLUT(new BayerLUT(BayerLUT::PATTERN_RGGB,5,5,5,\"\"))\" in the stack constructor!\n");
+      return false;
+    }
+  }
+
+  int width = source->getWidth();
+  int height = source->getHeight();
+  if (spans == 0 && row_begin == 0 && row_end == height && table == 0 && bayerlut == 0) {
+    if (format == COLOR_YUV422_UYVY) return thresholdImageYUV422_UYVY(target, source, lut, 0);
+    if (format == COLOR_YUV444) return thresholdImageYUV444(target, source, lut, 0);
+    return thresholdImageRGB(target, source, rgblut, 0);
+  }
+
+  if (target->getWidth() != width || target->getHeight() != height) {
+    fprintf(stderr, "CMVision thresholding: source (w=%d h=%d) and target (w=%d h=%d) sizes do not match!\n", width, height, target->getWidth(), target->getHeight());
+    return false;
+  }
+  if (spans != 0 && spans->getHeight() != height) {
+    fprintf(stderr, "CMVision thresholding: got spans for %d rows, but the image has %d rows!\n", spans->getHeight(), height);
+    return false;
+  }
+  if (format == COLOR_YUV422_UYVY && width % 2 != 0) {
+    fprintf(stderr, "CMVision thresholding: YUV422 requires an even image width, but found %d\n", width);
+    return false;
+  }
+  row_begin = std::max(row_begin, 0);
+  row_end = std::min(row_end, height);
+
+  Range::PixelSpan full;
+  full.set(0, width);
+  int row_bytes = RawImage::computeImageSize(format, width);
+  std::shared_ptr<const LUTTable> pinned;
+  if (table == 0) {
+    pinned = getFormatLUT(lut, format)->pin();
+    table = pinned.get();
+  }
+  for (int y = row_begin; y < row_end; y++) {
+    raw8 * target_row = target->getPixelData() + y * width;
+    const unsigned char * source_row = source->getData() + y * row_bytes;
+    if (spans == 0) {
+      if (bayerlut != 0) {
+        thresholdRowBayer(target_row, source, y, full, bayerlut, table);
+      } else {
+        thresholdRow(target_row, source_row, format, full, lut, rgblut, table);
+      }
+      continue;
+    }
+    int n = spans->getNumSpans(y);
+    const Range::PixelSpan * row_spans = spans->getSpans(y);
+    for (int k = 0; k < n; k++) {
+      Range::PixelSpan span;
+      span.set(std::max(row_spans[k].min, 0), std::min(row_spans[k].max, width));
+      if (bayerlut != 0) {
+        thresholdRowBayer(target_row, source, y, span, bayerlut, table);
+      } else {
+        thresholdRow(target_row, source_row, format, span, lut, rgblut, table);
+      }
+    }
+    //clear the pixels between the spans, including those written due to the YUV422 alignment:
+    unsigned char * clear_row = target->getData() + y * width;
+    int x = 0;
+    for (int k = 0; k < n; k++) {
+      int begin = std::min(std::max(row_spans[k].min, x), width);
+      memset(clear_row + x, 0, begin - x);
+      x = std::min(std::max(row_spans[k].max, begin), width);
+    }
+    memset(clear_row + x, 0, width - x);
+  }
+  return true;
+}
+
+// thresholds the samples x0 <= x < x1 of a row of the decimated image, the
+// sample x is taken from the source pixel x * factor of source row sy
+static void thresholdDecimatedRow(raw8 * target_row, const RawImage * source, ColorFormat format, const LUT3D * used_lut,
+                                  int sy, int factor, int x0, int x1, const LUTShifts & s, const lut_mask_t * LUT) {
+  int row_bytes = RawImage::computeImageSize(format, source->getWidth());
+  const unsigned char * source_row = source->getData() + sy * row_bytes;
+  if (format == COLOR_YUV422_UYVY) {
+    const uyvy * row = (const uyvy *)source_row;
+    for (int x = x0; x < x1; x++) {
+      int sx = x * factor;
+      const uyvy & p = row[sx >> 1];
+      int Y = (sx & 1) ? p.y2 : p.y1;
+      target_row[x] = LUT[(((Y >> s.X_SHIFT) << s.Z_AND_Y_BITS) | ((p.u >> s.Y_SHIFT) << s.Z_BITS) | (p.v >> s.Z_SHIFT))];
+    }
+  } else if (format == COLOR_YUV444) {
+    const yuv * row = (const yuv *)source_row;
+    for (int x = x0; x < x1; x++) {
+      const yuv & p = row[x * factor];
+      target_row[x] = LUT[(((p.y >> s.X_SHIFT) << s.Z_AND_Y_BITS) | ((p.u >> s.Y_SHIFT) << s.Z_BITS) | (p.v >> s.Z_SHIFT))];
+    }
+  } else if (format == COLOR_RGB8) {
+    const rgb * row = (const rgb *)source_row;
+    for (int x = x0; x < x1; x++) {
+      const rgb & p = row[x * factor];
+      target_row[x] = LUT[(((p.r >> s.X_SHIFT) << s.Z_AND_Y_BITS) | ((p.g >> s.Y_SHIFT) << s.Z_BITS) | (p.b >> s.Z_SHIFT))];
+    }
+  } else {
+    //the quad of the sensor that contains the sample, which starts at even coordinates:
+    int last_x = (source->getWidth() - 2) & ~1;
+    int qy = std::min(sy & ~1, (source->getHeight() - 2) & ~1);
+    const unsigned char * row0 = source->getData() + qy * row_bytes;
+    const unsigned char * row1 = row0 + row_bytes;
+    int q = (int)((const BayerLUT *)used_lut)->getPattern();
+    for (int x = x0; x < x1; x++) {
+      target_row[x] = lookupBayer(row0, row1, std::min((x * factor) & ~1, last_x), q, s, LUT);
+    }
+  }
+}
+
+bool CMVisionThreshold::thresholdDecimated(Image<raw8> * target, const RawImage * source, YUVLUT * lut, int factor,
+                                           const RowSpans * spans, const LUTTable * table) {
+  ColorFormat format = source->getColorFormat();
+  if (format != COLOR_YUV422_UYVY && format != COLOR_YUV444 && format != COLOR_RGB8 && format != COLOR_RAW8) {
+    fprintf(stderr, "CMVision decimated thresholding needs YUV422, YUV444, RGB8 or RAW8 (Bayer) as input image, but found: %s\n",
+            Colors::colorFormatToString(format).c_str());
+    return false;
+  }
+  LUT3D * used_lut = getFormatLUT(lut, format);
+  if (used_lut == 0) {
+    fprintf(stderr, "CMVision decimated thresholding: no derived %s LUT has been defined!\n",
+            format == COLOR_RAW8 ? "Bayer" : "RGB");
+    return false;
+  }
+  if (factor < 1) factor = 1;
+  if (format == COLOR_RAW8 && (source->getWidth() < 2 || source->getHeight() < 2)) {
+    fprintf(stderr, "CMVision decimated thresholding: a Bayer image needs at least 2x2 pixels\n");
+    return false;
+  }
+  if (spans != 0 && spans->getHeight() != source->getHeight()) {
+    fprintf(stderr, "CMVision decimated thresholding: got spans for %d rows, but the image has %d rows!\n",
+            spans->getHeight(), source->getHeight());
+    return false;
+  }
+
+  int width = source->getWidth() / factor;
+  int height = source->getHeight() / factor;
+  target->allocate(width, height);
+
+  std::shared_ptr<const LUTTable> pinned;
+  if (table == 0) {
+    pinned = used_lut->pin();
+    table = pinned.get();
+  }
+  const lut_mask_t * LUT = table->getTable();
+  LUTShifts s = getLUTShifts(used_lut);
+  for (int y = 0; y < height; y++) {
+    int sy = y * factor;
+    raw8 * target_row = target->getPixelData() + y * width;
+    if (spans == 0) {
+      thresholdDecimatedRow(target_row, source, format, used_lut, sy, factor, 0, width, s, LUT);
+      continue;
+    }
+    //only the samples inside of the spans of the source row are read, all others are cleared:
+    int n = spans->getNumSpans(sy);
+    const Range::PixelSpan * row_spans = spans->getSpans(sy);
+    unsigned char * clear_row = target->getData() + y * width;
+    int x = 0;
+    for (int k = 0; k < n; k++) {
+      int begin = std::min(std::max((row_spans[k].min + factor - 1) / factor, x), width);
+      int end = std::min(std::max((row_spans[k].max + factor - 1) / factor, begin), width);
+      memset(clear_row + x, 0, begin - x);
+      thresholdDecimatedRow(target_row, source, format, used_lut, sy, factor, begin, end, s, LUT);
+      x = end;
+    }
+    memset(clear_row + x, 0, width - x);
+  }
   return true;
 }
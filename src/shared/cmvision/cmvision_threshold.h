@@ -27,6 +27,8 @@
 #include "image.h"
 #include "colors.h"
 #include "timer.h"
+#include "row_spans.h"
+#include "simd_dispatch.h"
 
 /**
 	@author James Bruce (Original CMVision implementation and algorithms),
@@ -38,9 +40,55 @@ public:
 
     ~CMVisionThreshold();
 
+  /// threshold \p n consecutive pixels, e.g. a single image row. For YUV422,
+  /// \p n must be even and \p source must start at a macro-pixel.
+  /// Without a \p mask, all pixels are thresholded.
+  /// The labels are read from \p table, a version of \p lut pinned with
+  /// LUT3D::pin(). Without it, the caller is responsible for locking the LUT.
+  static void thresholdSpanYUV422_UYVY(raw8 * target, const uyvy * source, const unsigned char * mask, unsigned int n, const YUVLUT * lut, const LUTTable * table=0);
+  static void thresholdSpanYUV444(raw8 * target, const yuv * source, const unsigned char * mask, unsigned int n, const YUVLUT * lut, const LUTTable * table=0);
+  static void thresholdSpanRGB(raw8 * target, const rgb * source, const unsigned char * mask, unsigned int n, const RGBLUT * lut, const LUTTable * table=0);
+
   static bool thresholdImageYUV422_UYVY(Image<raw8> * target, const RawImage * source, YUVLUT * lut, const ImageInterface* mask);
   static bool thresholdImageYUV444(Image<raw8> * target, const ImageInterface * source, YUVLUT * lut, const ImageInterface* mask);
   static bool thresholdImageRGB(Image<raw8> * target, const ImageInterface * source, RGBLUT * lut, const ImageInterface* mask);
+
+  /// thresholds the pixels within \p span of a single row of a YUV422, YUV444
+  /// or RGB8 image. For YUV422, the pixel before and after the span may also
+  /// be written. \p table is the pinned version of the LUT used for the format,
+  /// without it the caller is responsible for locking that LUT.
+  static void thresholdRow(raw8 * target, const unsigned char * source, ColorFormat format,
+                           const Range::PixelSpan & span, const YUVLUT * lut, const RGBLUT * rgblut,
+                           const LUTTable * table=0);
+
+  /// thresholds the pixels within \p span of row \p y of a RAW8 Bayer image without
+  /// demosaicing it. Each pixel is labeled by the color of the 2x2 quad of samples
+  /// that starts at it (or ends at it, in the last row and column), see BayerLUT.
+  static void thresholdRowBayer(raw8 * target, const RawImage * source, int y, const Range::PixelSpan & span,
+                                const BayerLUT * lut, const LUTTable * table=0);
+
+  /// pins the current version of the LUT that images of \p format are thresholded
+  /// with, which is \p lut or its derived RGB or Bayer LUT. Passing it to all
+  /// thresholding calls of a frame keeps them on the same version, even if a new
+  /// one is published in between. Returns null if the derived LUT is missing.
+  static std::shared_ptr<const LUTTable> pinLUT(YUVLUT * lut, ColorFormat format);
+
+  /// thresholds a YUV422, YUV444, RGB8 or RAW8 (Bayer) image. Only the pixels within the
+  /// spans of each row are read, all others are cleared. Without \p spans,
+  /// the whole image is thresholded. Without a \p table from pinLUT(), the
+  /// currently published version of the LUT is used.
+  static bool thresholdImage(Image<raw8> * target, const RawImage * source, YUVLUT * lut, const RowSpans * spans,
+                             const LUTTable * table=0);
+  /// same as thresholdImage(), but only for the rows [\p row_begin, \p row_end),
+  /// e.g. to split the image among several threads
+  static bool thresholdRows(Image<raw8> * target, const RawImage * source, YUVLUT * lut, const RowSpans * spans,
+                            int row_begin, int row_end, const LUTTable * table=0);
+
+  /// thresholds every \p factor-th pixel of every \p factor-th row of a YUV422,
+  /// YUV444, RGB8 or RAW8 (Bayer) image, \p target is allocated to the reduced size.
+  /// Samples outside of the row spans (if not null) are not read and set to 0.
+  static bool thresholdDecimated(Image<raw8> * target, const RawImage * source, YUVLUT * lut, int factor,
+                                 const RowSpans * spans=0, const LUTTable * table=0);
 };
 
 #endif
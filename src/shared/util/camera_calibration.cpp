@@ -4,12 +4,15 @@
 #include <iostream>
 #include <algorithm>
 #include <limits>
+#include <cmath>
 #include "field.h"
 #include "field_default_constants.h"
 #include "geomalgo.h"
 
 CameraParameters::CameraParameters(int camera_index_, RoboCupField * field_) :
-        p_alpha(Eigen::VectorXd(1)) {
+        p_alpha(Eigen::VectorXd(1)),
+        projection([this](Projection & p) { readProjection(p); }), grid_requested_version(~0u),
+        grid_requested(false), grid_stopping(false) {
   focal_length = new VarDouble("focal length", 500.0);
   principal_point_x = new VarDouble("principal point x", 390.0);
   principal_point_y = new VarDouble("principal point y", 290.0);
@@ -33,9 +36,31 @@ CameraParameters::CameraParameters(int camera_index_, RoboCupField * field_) :
       new AdditionalCalibrationInformation(camera_index_, field_);
 
   q_rotate180 = Quaternion<double>(0, 0, 1.0,0);
+
+  projection.addItem(focal_length);
+  projection.addItem(principal_point_x);
+  projection.addItem(principal_point_y);
+  projection.addItem(distortion);
+  projection.addItem(q0);
+  projection.addItem(q1);
+  projection.addItem(q2);
+  projection.addItem(q3);
+  projection.addItem(tx);
+  projection.addItem(ty);
+  projection.addItem(tz);
+  projection.addItem(additional_calibration_information->imageWidth);
+  projection.addItem(additional_calibration_information->imageHeight);
+  projection.get();
 }
 
 CameraParameters::~CameraParameters() {
+  {
+    std::lock_guard<std::mutex> lock(grid_mutex);
+    grid_stopping = true;
+  }
+  grid_request.notify_all();
+  if (grid_builder.joinable()) grid_builder.join();
+
   delete focal_length;
   delete principal_point_x;
   delete principal_point_y;
@@ -158,31 +183,44 @@ void CameraParameters::radialDistortion(
   pd = pd.norm(rd);
 }
 
+void CameraParameters::readProjection(Projection & p) const {
+  p.focal_length = focal_length->getDouble();
+  p.principal_point_x = principal_point_x->getDouble();
+  p.principal_point_y = principal_point_y->getDouble();
+  p.distortion = distortion->getDouble();
+  p.q_field2cam = Quaternion<double>(
+      q0->getDouble(),q1->getDouble(),q2->getDouble(),q3->getDouble());
+  p.q_field2cam.norm();
+  p.q_cam2field = p.q_field2cam;
+  p.q_cam2field.invert();
+  p.translation = GVector::vector3d<double>(
+      tx->getDouble(),ty->getDouble(),tz->getDouble());
+  p.camera_in_field = p.q_cam2field.rotateVectorByQuaternion(
+      GVector::vector3d<double>(0,0,0) - p.translation);
+  p.image_width = additional_calibration_information->imageWidth->getInt();
+  p.image_height = additional_calibration_information->imageHeight->getInt();
+}
+
 void CameraParameters::field2image(
     const GVector::vector3d<double> &p_f,
     GVector::vector2d<double> &p_i) const {
-  Quaternion<double> q_field2cam = Quaternion<double>(
-      q0->getDouble(),q1->getDouble(),q2->getDouble(),q3->getDouble());
-  q_field2cam.norm();
-  GVector::vector3d<double> translation = GVector::vector3d<double>(
-      tx->getDouble(),ty->getDouble(),tz->getDouble());
+  std::shared_ptr<const Projection> p = projection.get();
 
   // First transform the point from the field into the coordinate system of the
   // camera
   GVector::vector3d<double> p_c =
-      q_field2cam.rotateVectorByQuaternion(p_f) + translation;
+      p->q_field2cam.rotateVectorByQuaternion(p_f) + p->translation;
   GVector::vector2d<double> p_un =
       GVector::vector2d<double>(p_c.x/p_c.z, p_c.y/p_c.z);
 
   // Apply distortion
   GVector::vector2d<double> p_d;
-  radialDistortion(p_un,p_d);
+  radialDistortion(p_un,p_d,p->distortion);
 
   // Then project from the camera coordinate system onto the image plane using
   // the instrinsic parameters
-  p_i = focal_length->getDouble() * p_d +
-      GVector::vector2d<double>(principal_point_x->getDouble(),
-                                principal_point_y->getDouble());
+  p_i = p->focal_length * p_d +
+      GVector::vector2d<double>(p->principal_point_x, p->principal_point_y);
 }
 
 void CameraParameters::field2image(
@@ -220,35 +258,156 @@ void CameraParameters::field2image(
                                 principal_point_y->getDouble() + p[PP_Y]);
 }
 
+/*!
+  \class CameraParameters::ProjectionGrid
+  \brief The viewing rays of a regular grid of pixels, in field coordinates
+
+  The projection of a pixel onto the plane at height z is
+  origin + (slope_x, slope_y, 1) * (z - origin.z), so the slopes of the rays
+  are enough for any height. Pixels between the grid points are interpolated
+  bilinearly.
+**/
+class CameraParameters::ProjectionGrid
+{
+public:
+  unsigned int version;
+  int width;
+  int height;
+  GVector::vector3d<double> origin;
+  std::vector<float> slope_x;
+  std::vector<float> slope_y;
+
+  /// returns false if \p p_i is not covered by the grid
+  bool project(GVector::vector3d<double> &p_f, const GVector::vector2d<double> &p_i, double z) const {
+    double gx = p_i.x / GRID_STEP;
+    double gy = p_i.y / GRID_STEP;
+    //also rejects NaN:
+    if (!(gx >= 0.0 && gy >= 0.0)) return false;
+    int x = (int)gx;
+    int y = (int)gy;
+    if (x >= width - 1 || y >= height - 1) return false;
+    double fx = gx - x;
+    double fy = gy - y;
+    int i = y * width + x;
+    double sx = (1.0 - fy) * ((1.0 - fx) * slope_x[i] + fx * slope_x[i + 1]) +
+                fy * ((1.0 - fx) * slope_x[i + width] + fx * slope_x[i + width + 1]);
+    double sy = (1.0 - fy) * ((1.0 - fx) * slope_y[i] + fx * slope_y[i + 1]) +
+                fy * ((1.0 - fx) * slope_y[i + width] + fx * slope_y[i + width + 1]);
+    //rays parallel to the field are marked with NaN:
+    if (std::isnan(sx) || std::isnan(sy)) return false;
+    double d = z - origin.z;
+    p_f.set(origin.x + sx * d, origin.y + sy * d, z);
+    return true;
+  }
+};
+
+std::shared_ptr<const CameraParameters::ProjectionGrid> CameraParameters::getProjectionGrid() const {
+  unsigned int version = projection.getVersion();
+  std::shared_ptr<const ProjectionGrid> grid = std::atomic_load(&projection_grid);
+  if (grid == nullptr || grid->version != version) {
+    requestProjectionGrid(version);
+    return nullptr;
+  }
+  return grid;
+}
+
+void CameraParameters::requestProjectionGrid(unsigned int version) const {
+  if (grid_requested_version.exchange(version) == version) return;
+  std::lock_guard<std::mutex> lock(grid_mutex);
+  grid_requested = true;
+  if (!grid_builder.joinable()) {
+    grid_builder = std::thread(&CameraParameters::runProjectionGridBuilder, this);
+  }
+  grid_request.notify_all();
+}
+
+void CameraParameters::runProjectionGridBuilder() const {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(grid_mutex);
+      grid_request.wait(lock, [this] { return grid_requested || grid_stopping; });
+      if (grid_stopping) return;
+      grid_requested = false;
+    }
+
+    //the version is taken first, so a change in between only causes another rebuild:
+    std::shared_ptr<ProjectionGrid> grid(new ProjectionGrid());
+    grid->version = projection.getVersion();
+    std::shared_ptr<const Projection> p = projection.get();
+    if (p->image_width <= 0 || p->image_height <= 0) continue;
+
+    grid->origin = p->camera_in_field;
+    grid->width = p->image_width / GRID_STEP + 2;
+    grid->height = p->image_height / GRID_STEP + 2;
+    grid->slope_x.resize(grid->width * grid->height);
+    grid->slope_y.resize(grid->width * grid->height);
+    for (int y = 0; y < grid->height; y++) {
+      for (int x = 0; x < grid->width; x++) {
+        //same as image2fieldExact():
+        double d_x = (x * GRID_STEP - p->principal_point_x) / p->focal_length;
+        double d_y = (y * GRID_STEP - p->principal_point_y) / p->focal_length;
+        double scale = 1.0 + (d_x * d_x + d_y * d_y) * p->distortion;
+        GVector::vector3d<double> v = p->q_cam2field.rotateVectorByQuaternion(
+            GVector::vector3d<double>(d_x * scale, d_y * scale, 1));
+        int i = y * grid->width + x;
+        if (fabs(v.z) < 1e-9) {
+          grid->slope_x[i] = grid->slope_y[i] = std::numeric_limits<float>::quiet_NaN();
+        } else {
+          grid->slope_x[i] = (float)(v.x / v.z);
+          grid->slope_y[i] = (float)(v.y / v.z);
+        }
+      }
+    }
+    std::atomic_store(&projection_grid, std::shared_ptr<const ProjectionGrid>(grid));
+  }
+}
+
+CameraParameters::FrameProjection CameraParameters::getFrameProjection() const {
+  FrameProjection result;
+  result.grid = getProjectionGrid();
+  result.projection = projection.get();
+  return result;
+}
+
+void CameraParameters::FrameProjection::image2field(
+    GVector::vector3d<double> &p_f, const GVector::vector2d<double> &p_i,
+    double z) const {
+  if (grid == nullptr || !grid->project(p_f, p_i, z)) {
+    image2fieldExact(*projection, p_f, p_i, z);
+  }
+}
+
 void CameraParameters::image2field(
     GVector::vector3d<double> &p_f, const GVector::vector2d<double> &p_i,
     double z) const {
+  getFrameProjection().image2field(p_f, p_i, z);
+}
+
+void CameraParameters::image2fieldExact(
+    GVector::vector3d<double> &p_f, const GVector::vector2d<double> &p_i,
+    double z) const {
+  image2fieldExact(*projection.get(), p_f, p_i, z);
+}
+
+void CameraParameters::image2fieldExact(
+    const Projection & p, GVector::vector3d<double> &p_f,
+    const GVector::vector2d<double> &p_i, double z) {
   // Undo scaling and offset
   GVector::vector2d<double> p_d(
-      (p_i.x - principal_point_x->getDouble()) / focal_length->getDouble(),
-      (p_i.y - principal_point_y->getDouble()) / focal_length->getDouble());
+      (p_i.x - p.principal_point_x) / p.focal_length,
+      (p_i.y - p.principal_point_y) / p.focal_length);
 
   // Compensate for distortion (undistort)
-  GVector::vector2d<double> p_un;
-  radialDistortionInv(p_un,p_d);
+  double ru = p_d.length() * (1.0 + p_d.sqlength() * p.distortion);
+  GVector::vector2d<double> p_un = p_d.norm(ru);
 
   // Now we got a ray on the z axis
   GVector::vector3d<double> v(p_un.x, p_un.y, 1);
 
   // Transform this ray into world coordinates
-  Quaternion<double> q_field2cam = Quaternion<double>(
-      q0->getDouble(),q1->getDouble(),q2->getDouble(),q3->getDouble());
-  q_field2cam.norm();
-  GVector::vector3d<double> translation =
-    GVector::vector3d<double>(tx->getDouble(),ty->getDouble(),tz->getDouble());
-
-  Quaternion<double> q_field2cam_inv = q_field2cam;
-  q_field2cam_inv.invert();
   GVector::vector3d<double> v_in_w =
-      q_field2cam_inv.rotateVectorByQuaternion(v);
-  GVector::vector3d<double> zero_in_w =
-      q_field2cam_inv.rotateVectorByQuaternion(
-          GVector::vector3d<double>(0,0,0) - translation);
+      p.q_cam2field.rotateVectorByQuaternion(v);
+  const GVector::vector3d<double> & zero_in_w = p.camera_in_field;
 
   // Compute the the point where the rays intersects the field
   double t = GVector::ray_plane_intersect(
@@ -21,8 +21,14 @@
 
 #include <VarDouble.h>
 #include <VarList.h>
+#include <VarSnapshot.h>
 #include <quaternion.h>
 #include <Eigen/Core>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include "field.h"
 #include "timer.h"
 
@@ -79,7 +85,12 @@ public:
 
   GVector::vector3d<double> getWorldLocation();
   void field2image(const GVector::vector3d<double> &p_f, GVector::vector2d<double> &p_i) const;
+  /// projects the pixel \p p_i onto the plane at height \p z. This uses the
+  /// precomputed projection grid where available, see image2fieldExact().
+  /// Code projecting many pixels per frame should use getFrameProjection() instead.
   void image2field(GVector::vector3d< double >& p_f, const GVector::vector2d< double >& p_i, double z) const;
+  /// same as image2field(), but always computed from the calibration parameters
+  void image2fieldExact(GVector::vector3d< double >& p_f, const GVector::vector2d< double >& p_i, double z) const;
   void calibrate(std::vector<GVector::vector3d<double> > &p_f, std::vector<GVector::vector2d<double> > &p_i, int cal_type);
 
   double radialDistortion(double ru) const;  //apply radial distortion to (undistorted) radius ru and return distorted radius
@@ -207,6 +218,67 @@ public:
 public:
   void do_calibration(int cal_type);
   void reset();
+
+protected:
+  class ProjectionGrid;
+
+  /// the pixel spacing of the projection grid
+  static const int GRID_STEP = 4;
+
+  /// all parameters the projection depends on
+  struct Projection {
+    double focal_length;
+    double principal_point_x;
+    double principal_point_y;
+    double distortion;
+    Quaternion<double> q_field2cam; //normalized
+    Quaternion<double> q_cam2field;
+    GVector::vector3d<double> translation;
+    GVector::vector3d<double> camera_in_field;
+    int image_width;
+    int image_height;
+  };
+  mutable VarSnapshot<Projection> projection;
+  void readProjection(Projection & p) const;
+
+  mutable std::atomic<unsigned int> grid_requested_version;
+  mutable std::shared_ptr<const ProjectionGrid> projection_grid;
+
+  //the grid is rebuilt in the background after changes:
+  mutable std::mutex grid_mutex;
+  mutable std::condition_variable grid_request;
+  mutable bool grid_requested;
+  bool grid_stopping;
+  mutable std::thread grid_builder;
+
+  std::shared_ptr<const ProjectionGrid> getProjectionGrid() const;
+  void requestProjectionGrid(unsigned int version) const;
+  void runProjectionGridBuilder() const;
+  static void image2fieldExact(const Projection & p, GVector::vector3d<double> &p_f,
+                               const GVector::vector2d<double> &p_i, double z);
+
+public:
+  /*!
+    \brief The projection of one frame, as returned by getFrameProjection()
+
+    It holds on to the grid and the parameters current at the time it was
+    made, so projecting through it does no atomic loads and all pixels of a
+    frame are projected consistently. Get a new one for every frame, so that
+    calibration changes are picked up.
+  */
+  class FrameProjection {
+  public:
+    /// same as CameraParameters::image2field()
+    void image2field(GVector::vector3d<double> &p_f, const GVector::vector2d<double> &p_i, double z) const;
+    /// false while the grid is still being built, then everything is computed exactly
+    bool hasGrid() const { return grid != nullptr; }
+  protected:
+    friend class CameraParameters;
+    std::shared_ptr<const Projection> projection;
+    std::shared_ptr<const ProjectionGrid> grid;
+  };
+
+  FrameProjection getFrameProjection() const;
 };
 
 #endif
@@ -33,6 +33,7 @@ enum ColorSpace {
   CSPACE_YUV,
   CSPACE_HSV,
   CSPACE_LAB,
+  CSPACE_BAYER, //RGB, as sampled from a 2x2 quad of a Bayer sensor
   CSPACE_COUNT
 };
 
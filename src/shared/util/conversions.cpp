@@ -14,43 +14,530 @@
 //========================================================================
 /*!
   \file    conversions.cpp
-  \brief   Various color conversion operations, but NOT very optimized
+  \brief   Various color conversion operations
   \author
 */
 //========================================================================
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
 
 
 #include "conversions.h"
+#ifdef SIMD_DISPATCH
+#include <x86intrin.h>
+#endif
 
 using namespace std;
 // The following #define is there for the users who experience green/purple
 // images in the display. This seems to be a videocard driver problem.
 
 
+// The SIMD kernels below use the same integer arithmetic as the scalar
+// versions, so all of them produce bit-identical images. They are compiled
+// with per-function target attributes and selected at runtime, so they are
+// available even without -march=native. Each kernel converts as many pixels
+// as it can and returns their number, the scalar version does the rest.
+
+static void uyvyToRGBScalar(const unsigned char * src, unsigned char * dest, int begin, int end, bool yuyv) {
+  int r, g, b;
+  const int y_offset = yuyv ? 0 : 1;
+  const int c_offset = yuyv ? 1 : 0;
+  for (int i = begin; i + 1 < end; i += 2) {
+    const unsigned char * p = src + 2 * i;
+    int y0 = p[y_offset];
+    int y1 = p[y_offset + 2];
+    int u = p[c_offset] - 128;
+    int v = p[c_offset + 2] - 128;
+    unsigned char * d = dest + 3 * i;
+    Conversions::yuv2rgb(y0, u, v, r, g, b);
+    d[0] = r;
+    d[1] = g;
+    d[2] = b;
+    Conversions::yuv2rgb(y1, u, v, r, g, b);
+    d[3] = r;
+    d[4] = g;
+    d[5] = b;
+  }
+}
+
+static void rgbToUYVYScalar(const unsigned char * src, unsigned char * dest, int begin, int end, bool yuyv) {
+  int y0, u0, v0, y1, u1, v1;
+  for (int i = begin; i + 1 < end; i += 2) {
+    const unsigned char * p = src + 3 * i;
+    Conversions::rgb2yuv(p[0], p[1], p[2], y0, u0, v0);
+    Conversions::rgb2yuv(p[3], p[4], p[5], y1, u1, v1);
+    unsigned char * d = dest + 2 * i;
+    if (yuyv) {
+      d[0] = y0;
+      d[1] = (u0 + u1) >> 1;
+      d[2] = y1;
+      d[3] = (v0 + v1) >> 1;
+    } else {
+      d[0] = (u0 + u1) >> 1;
+      d[1] = y0;
+      d[2] = (v0 + v1) >> 1;
+      d[3] = y1;
+    }
+  }
+}
+
+static void yToRGBScalar(const unsigned char * src, unsigned char * dest, int begin, int end) {
+  for (int i = begin; i < end; i++) {
+    dest[3 * i] = dest[3 * i + 1] = dest[3 * i + 2] = src[i];
+  }
+}
+
+static void swapRBScalar(const unsigned char * src, unsigned char * dest, int begin, int end) {
+  for (int i = 3 * begin; i < 3 * end; i += 3) {
+    unsigned char r = src[i];
+    dest[i + 1] = src[i + 1];
+    dest[i] = src[i + 2];
+    dest[i + 2] = r;
+  }
+}
+
+// Bilinear demosaicing: the missing green of a red or blue sample is the mean
+// of its four neighbors, the missing red or blue the mean of the two (at green
+// samples) or four (diagonal, at blue or red samples) nearest samples of that
+// color. red_x and red_y are the column and row parity of the red samples.
+static void demosaicScalar(const unsigned char * up, const unsigned char * row, const unsigned char * down,
+                           unsigned char * dest, int width, int y, int begin, int end, int red_x, int red_y) {
+  bool red_row = (y & 1) == red_y;
+  for (int x = begin; x < end; x++) {
+    int xl = x > 0 ? x - 1 : 1;
+    int xr = x < width - 1 ? x + 1 : width - 2;
+    int c = row[x];
+    int h2 = (row[xl] + row[xr] + 1) >> 1;
+    int v2 = (up[x] + down[x] + 1) >> 1;
+    int cross4 = (row[xl] + row[xr] + up[x] + down[x] + 2) >> 2;
+    int diag4 = (up[xl] + up[xr] + down[xl] + down[xr] + 2) >> 2;
+    unsigned char * d = dest + 3 * x;
+    if ((x & 1) == red_x) {
+      //red sample on red rows, green sample on blue rows:
+      d[0] = red_row ? c : v2;
+      d[1] = red_row ? cross4 : c;
+      d[2] = red_row ? diag4 : h2;
+    } else {
+      //green sample on red rows, blue sample on blue rows:
+      d[0] = red_row ? h2 : diag4;
+      d[1] = red_row ? c : cross4;
+      d[2] = red_row ? v2 : c;
+    }
+  }
+}
+
+#ifdef SIMD_DISPATCH
+
+// pshufb masks to convert between 16 pixels of interleaved RGB (three blocks
+// of 16 bytes) and one vector of 16 bytes per channel
+struct RGBShuffleMasks {
+  alignas(16) unsigned char store[3][3][16]; //[output block][channel]
+  alignas(16) unsigned char load[3][3][16];  //[input block][channel]
+  alignas(16) unsigned char swap[16];        //swaps red and blue of 4 pixels, keeps bytes 12 to 15
+  RGBShuffleMasks() {
+    for (int k = 0; k < 3; k++) {
+      for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 16; i++) {
+          int j = 16 * k + i;
+          store[k][c][i] = (j % 3 == c) ? j / 3 : 0x80;
+          j = 3 * i + c;
+          load[k][c][i] = (j / 16 == k) ? j % 16 : 0x80;
+        }
+      }
+    }
+    for (int i = 0; i < 16; i++) {
+      swap[i] = i < 12 ? 3 * (i / 3) + 2 - i % 3 : i;
+    }
+  }
+};
+
+static const RGBShuffleMasks & rgbShuffleMasks() {
+  static const RGBShuffleMasks masks;
+  return masks;
+}
+
+__attribute__((target("sse4.1")))
+static inline void storeRGBSSE41(unsigned char * dest, __m128i r, __m128i g, __m128i b) {
+  const RGBShuffleMasks & m = rgbShuffleMasks();
+  for (int k = 0; k < 3; k++) {
+    __m128i out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, _mm_load_si128((const __m128i*)m.store[k][0])),
+                                            _mm_shuffle_epi8(g, _mm_load_si128((const __m128i*)m.store[k][1]))),
+                               _mm_shuffle_epi8(b, _mm_load_si128((const __m128i*)m.store[k][2])));
+    _mm_storeu_si128((__m128i*)(dest + 16 * k), out);
+  }
+}
+
+__attribute__((target("sse4.1")))
+static inline void loadRGBSSE41(const unsigned char * src, __m128i & r, __m128i & g, __m128i & b) {
+  const RGBShuffleMasks & m = rgbShuffleMasks();
+  __m128i in[3];
+  __m128i * channels[3] = { &r, &g, &b };
+  for (int k = 0; k < 3; k++) in[k] = _mm_loadu_si128((const __m128i*)(src + 16 * k));
+  for (int c = 0; c < 3; c++) {
+    *channels[c] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in[0], _mm_load_si128((const __m128i*)m.load[0][c])),
+                                             _mm_shuffle_epi8(in[1], _mm_load_si128((const __m128i*)m.load[1][c]))),
+                                _mm_shuffle_epi8(in[2], _mm_load_si128((const __m128i*)m.load[2][c])));
+  }
+}
+
+// yuv2rgb() of 8 pixels in 16-bit lanes, with u and v already centered at 0.
+// (v << 6) * 1436 >> 16 equals v * 1436 >> 10, also for negative v.
+__attribute__((target("sse4.1")))
+static inline void yuvToRGBSSE41(__m128i y, __m128i u, __m128i v, __m128i & r, __m128i & g, __m128i & b) {
+  r = _mm_add_epi16(y, _mm_mulhi_epi16(_mm_slli_epi16(v, 6), _mm_set1_epi16(1436)));
+  b = _mm_add_epi16(y, _mm_mulhi_epi16(_mm_slli_epi16(u, 6), _mm_set1_epi16(1814)));
+  const __m128i g_coeffs = _mm_setr_epi16(352, 731, 352, 731, 352, 731, 352, 731);
+  __m128i g_lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(u, v), g_coeffs), 10);
+  __m128i g_hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(u, v), g_coeffs), 10);
+  g = _mm_sub_epi16(y, _mm_packs_epi32(g_lo, g_hi));
+}
+
+template <bool yuyv>
+__attribute__((target("sse4.1")))
+static int uyvyToRGBSSE41(const unsigned char * src, unsigned char * dest, int n) {
+  const __m128i low_byte = _mm_set1_epi16(0x00FF);
+  const __m128i offset = _mm_set1_epi16(128);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i r16[2], g16[2], b16[2];
+    for (int k = 0; k < 2; k++) {
+      // each 16-bit lane holds (u,y0) and (v,y1) alternately, (y0,u) and (y1,v) for YUYV
+      const __m128i chunk = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16 * k));
+      const __m128i y = yuyv ? _mm_and_si128(chunk, low_byte) : _mm_srli_epi16(chunk, 8);
+      const __m128i c = yuyv ? _mm_srli_epi16(chunk, 8) : _mm_and_si128(chunk, low_byte);
+      // both pixels of a pair share its u and v
+      const __m128i u = _mm_sub_epi16(_mm_blend_epi16(c, _mm_slli_epi32(c, 16), 0xAA), offset);
+      const __m128i v = _mm_sub_epi16(_mm_blend_epi16(_mm_srli_epi32(c, 16), c, 0xAA), offset);
+      yuvToRGBSSE41(y, u, v, r16[k], g16[k], b16[k]);
+    }
+    // the saturation to 0..255 is the bound() of the scalar version
+    storeRGBSSE41(dest + 3 * i, _mm_packus_epi16(r16[0], r16[1]), _mm_packus_epi16(g16[0], g16[1]),
+                  _mm_packus_epi16(b16[0], b16[1]));
+  }
+  return i;
+}
+
+// rgb2yuv() of 8 pixels, clamped to 0..255 in 16-bit lanes
+__attribute__((target("sse4.1")))
+static inline void rgbToYUVSSE41(__m128i r, __m128i g, __m128i b, __m128i & y, __m128i & u, __m128i & v) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i max = _mm_set1_epi16(255);
+  const __m128i offset = _mm_set1_epi32(128);
+  const __m128i rg[2] = { _mm_unpacklo_epi16(r, g), _mm_unpackhi_epi16(r, g) };
+  const __m128i b0[2] = { _mm_unpacklo_epi16(b, zero), _mm_unpackhi_epi16(b, zero) };
+  // the coefficients of (r,g) and (b,0) pairs for _mm_madd_epi16
+  const __m128i y_rg = _mm_setr_epi16(306, 601, 306, 601, 306, 601, 306, 601);
+  const __m128i y_b = _mm_setr_epi16(117, 0, 117, 0, 117, 0, 117, 0);
+  const __m128i u_rg = _mm_setr_epi16(-172, -340, -172, -340, -172, -340, -172, -340);
+  const __m128i u_b = _mm_setr_epi16(512, 0, 512, 0, 512, 0, 512, 0);
+  const __m128i v_rg = _mm_setr_epi16(512, -429, 512, -429, 512, -429, 512, -429);
+  const __m128i v_b = _mm_setr_epi16(-83, 0, -83, 0, -83, 0, -83, 0);
+  __m128i y32[2], u32[2], v32[2];
+  for (int k = 0; k < 2; k++) {
+    y32[k] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rg[k], y_rg), _mm_madd_epi16(b0[k], y_b)), 10);
+    u32[k] = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rg[k], u_rg), _mm_madd_epi16(b0[k], u_b)), 10), offset);
+    v32[k] = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rg[k], v_rg), _mm_madd_epi16(b0[k], v_b)), 10), offset);
+  }
+  y = _mm_max_epi16(_mm_min_epi16(_mm_packs_epi32(y32[0], y32[1]), max), zero);
+  u = _mm_max_epi16(_mm_min_epi16(_mm_packs_epi32(u32[0], u32[1]), max), zero);
+  v = _mm_max_epi16(_mm_min_epi16(_mm_packs_epi32(v32[0], v32[1]), max), zero);
+}
+
+template <bool yuyv>
+__attribute__((target("sse4.1")))
+static int rgbToUYVYSSE41(const unsigned char * src, unsigned char * dest, int n) {
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i r, g, b;
+    loadRGBSSE41(src + 3 * i, r, g, b);
+    __m128i y[2], u[2], v[2];
+    rgbToYUVSSE41(_mm_unpacklo_epi8(r, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(b, zero), y[0], u[0], v[0]);
+    rgbToYUVSSE41(_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(b, zero), y[1], u[1], v[1]);
+    // the mean chroma of the 8 pairs
+    const __m128i u_mean = _mm_srli_epi16(_mm_hadd_epi16(u[0], u[1]), 1);
+    const __m128i v_mean = _mm_srli_epi16(_mm_hadd_epi16(v[0], v[1]), 1);
+    const __m128i c[2] = { _mm_unpacklo_epi16(u_mean, v_mean), _mm_unpackhi_epi16(u_mean, v_mean) };
+    for (int k = 0; k < 2; k++) {
+      const __m128i out = yuyv ? _mm_or_si128(y[k], _mm_slli_epi16(c[k], 8)) : _mm_or_si128(c[k], _mm_slli_epi16(y[k], 8));
+      _mm_storeu_si128((__m128i*)(dest + 2 * i + 16 * k), out);
+    }
+  }
+  return i;
+}
+
+__attribute__((target("sse4.1")))
+static int yToRGBSSE41(const unsigned char * src, unsigned char * dest, int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i y = _mm_loadu_si128((const __m128i*)(src + i));
+    storeRGBSSE41(dest + 3 * i, y, y, y);
+  }
+  return i;
+}
+
+// 4 pixels per step with one shuffle. Each store also writes the first 4 bytes of
+// the next step unchanged, so this works in place as well.
+__attribute__((target("sse4.1")))
+static int swapRBSSE41(const unsigned char * src, unsigned char * dest, int n) {
+  const __m128i mask = _mm_load_si128((const __m128i*)rgbShuffleMasks().swap);
+  int i = 0;
+  for (; 3 * i + 16 <= 3 * n; i += 4) {
+    const __m128i in = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+    _mm_storeu_si128((__m128i*)(dest + 3 * i), _mm_shuffle_epi8(in, mask));
+  }
+  return i;
+}
+
+// (a + b + c + d + 2) >> 2 of 16 bytes
+__attribute__((target("sse4.1")))
+static inline __m128i mean4SSE41(__m128i a, __m128i b, __m128i c, __m128i d) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i two = _mm_set1_epi16(2);
+  __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                             _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+  __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+                             _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+  return _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(lo, two), 2), _mm_srli_epi16(_mm_add_epi16(hi, two), 2));
+}
+
+// demosaicScalar() for the pixels from begin on, as long as their right neighbor exists
+__attribute__((target("sse4.1")))
+static int demosaicSSE41(const unsigned char * up, const unsigned char * row, const unsigned char * down,
+                         unsigned char * dest, int width, int y, int begin, int red_x, int red_y) {
+  bool red_row = (y & 1) == red_y;
+  // the lanes of the columns with red samples, which are green samples on blue rows
+  const __m128i even = _mm_set1_epi16(0x00FF);
+  const __m128i red_cols = ((begin & 1) == red_x) ? even : _mm_andnot_si128(even, _mm_set1_epi8(-1));
+  int x = begin;
+  for (; x + 17 <= width; x += 16) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(row + x));
+    const __m128i l = _mm_loadu_si128((const __m128i*)(row + x - 1));
+    const __m128i r = _mm_loadu_si128((const __m128i*)(row + x + 1));
+    const __m128i u = _mm_loadu_si128((const __m128i*)(up + x));
+    const __m128i d = _mm_loadu_si128((const __m128i*)(down + x));
+    const __m128i h2 = _mm_avg_epu8(l, r);
+    const __m128i v2 = _mm_avg_epu8(u, d);
+    const __m128i cross4 = mean4SSE41(l, r, u, d);
+    const __m128i diag4 = mean4SSE41(_mm_loadu_si128((const __m128i*)(up + x - 1)), _mm_loadu_si128((const __m128i*)(up + x + 1)),
+                                     _mm_loadu_si128((const __m128i*)(down + x - 1)), _mm_loadu_si128((const __m128i*)(down + x + 1)));
+    if (red_row) {
+      storeRGBSSE41(dest + 3 * x, _mm_blendv_epi8(h2, c, red_cols), _mm_blendv_epi8(c, cross4, red_cols),
+                    _mm_blendv_epi8(v2, diag4, red_cols));
+    } else {
+      storeRGBSSE41(dest + 3 * x, _mm_blendv_epi8(diag4, v2, red_cols), _mm_blendv_epi8(cross4, c, red_cols),
+                    _mm_blendv_epi8(c, h2, red_cols));
+    }
+  }
+  return x;
+}
+
+// interleaves 32 pixels, the low lanes hold pixels 0 to 15, the high lanes 16 to 31
+__attribute__((target("avx2")))
+static inline void storeRGBAVX2(unsigned char * dest, __m256i r, __m256i g, __m256i b) {
+  const RGBShuffleMasks & m = rgbShuffleMasks();
+  __m256i out[3];
+  for (int k = 0; k < 3; k++) {
+    out[k] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(r, _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)m.store[k][0]))),
+                                             _mm256_shuffle_epi8(g, _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)m.store[k][1])))),
+                             _mm256_shuffle_epi8(b, _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)m.store[k][2]))));
+  }
+  _mm256_storeu_si256((__m256i*)dest, _mm256_permute2x128_si256(out[0], out[1], 0x20));
+  _mm256_storeu_si256((__m256i*)(dest + 32), _mm256_permute2x128_si256(out[2], out[0], 0x30));
+  _mm256_storeu_si256((__m256i*)(dest + 64), _mm256_permute2x128_si256(out[1], out[2], 0x31));
+}
+
+template <bool yuyv>
+__attribute__((target("avx2")))
+static int uyvyToRGBAVX2(const unsigned char * src, unsigned char * dest, int n) {
+  const __m256i low_byte = _mm256_set1_epi16(0x00FF);
+  const __m256i offset = _mm256_set1_epi16(128);
+  const __m256i g_coeffs = _mm256_setr_epi16(352, 731, 352, 731, 352, 731, 352, 731,
+                                             352, 731, 352, 731, 352, 731, 352, 731);
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i r16[2], g16[2], b16[2];
+    for (int k = 0; k < 2; k++) {
+      const __m256i chunk = _mm256_loadu_si256((const __m256i*)(src + 2 * i + 32 * k));
+      const __m256i y = yuyv ? _mm256_and_si256(chunk, low_byte) : _mm256_srli_epi16(chunk, 8);
+      const __m256i c = yuyv ? _mm256_srli_epi16(chunk, 8) : _mm256_and_si256(chunk, low_byte);
+      const __m256i u = _mm256_sub_epi16(_mm256_blend_epi16(c, _mm256_slli_epi32(c, 16), 0xAA), offset);
+      const __m256i v = _mm256_sub_epi16(_mm256_blend_epi16(_mm256_srli_epi32(c, 16), c, 0xAA), offset);
+      r16[k] = _mm256_add_epi16(y, _mm256_mulhi_epi16(_mm256_slli_epi16(v, 6), _mm256_set1_epi16(1436)));
+      b16[k] = _mm256_add_epi16(y, _mm256_mulhi_epi16(_mm256_slli_epi16(u, 6), _mm256_set1_epi16(1814)));
+      __m256i g_lo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(u, v), g_coeffs), 10);
+      __m256i g_hi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(u, v), g_coeffs), 10);
+      g16[k] = _mm256_sub_epi16(y, _mm256_packs_epi32(g_lo, g_hi));
+    }
+    // packing works within 128-bit lanes, restore the pixel order
+    storeRGBAVX2(dest + 3 * i,
+                 _mm256_permute4x64_epi64(_mm256_packus_epi16(r16[0], r16[1]), 0xD8),
+                 _mm256_permute4x64_epi64(_mm256_packus_epi16(g16[0], g16[1]), 0xD8),
+                 _mm256_permute4x64_epi64(_mm256_packus_epi16(b16[0], b16[1]), 0xD8));
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i mean4AVX2(__m256i a, __m256i b, __m256i c, __m256i d) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i two = _mm256_set1_epi16(2);
+  __m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero)),
+                                _mm256_add_epi16(_mm256_unpacklo_epi8(c, zero), _mm256_unpacklo_epi8(d, zero)));
+  __m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero)),
+                                _mm256_add_epi16(_mm256_unpackhi_epi8(c, zero), _mm256_unpackhi_epi8(d, zero)));
+  return _mm256_packus_epi16(_mm256_srli_epi16(_mm256_add_epi16(lo, two), 2), _mm256_srli_epi16(_mm256_add_epi16(hi, two), 2));
+}
+
+__attribute__((target("avx2")))
+static int demosaicAVX2(const unsigned char * up, const unsigned char * row, const unsigned char * down,
+                        unsigned char * dest, int width, int y, int begin, int red_x, int red_y) {
+  bool red_row = (y & 1) == red_y;
+  const __m256i even = _mm256_set1_epi16(0x00FF);
+  const __m256i red_cols = ((begin & 1) == red_x) ? even : _mm256_andnot_si256(even, _mm256_set1_epi8(-1));
+  int x = begin;
+  for (; x + 33 <= width; x += 32) {
+    const __m256i c = _mm256_loadu_si256((const __m256i*)(row + x));
+    const __m256i l = _mm256_loadu_si256((const __m256i*)(row + x - 1));
+    const __m256i r = _mm256_loadu_si256((const __m256i*)(row + x + 1));
+    const __m256i u = _mm256_loadu_si256((const __m256i*)(up + x));
+    const __m256i d = _mm256_loadu_si256((const __m256i*)(down + x));
+    const __m256i h2 = _mm256_avg_epu8(l, r);
+    const __m256i v2 = _mm256_avg_epu8(u, d);
+    const __m256i cross4 = mean4AVX2(l, r, u, d);
+    const __m256i diag4 = mean4AVX2(_mm256_loadu_si256((const __m256i*)(up + x - 1)), _mm256_loadu_si256((const __m256i*)(up + x + 1)),
+                                    _mm256_loadu_si256((const __m256i*)(down + x - 1)), _mm256_loadu_si256((const __m256i*)(down + x + 1)));
+    if (red_row) {
+      storeRGBAVX2(dest + 3 * x, _mm256_blendv_epi8(h2, c, red_cols), _mm256_blendv_epi8(c, cross4, red_cols),
+                   _mm256_blendv_epi8(v2, diag4, red_cols));
+    } else {
+      storeRGBAVX2(dest + 3 * x, _mm256_blendv_epi8(diag4, v2, red_cols), _mm256_blendv_epi8(cross4, c, red_cols),
+                   _mm256_blendv_epi8(c, h2, red_cols));
+    }
+  }
+  return x;
+}
+
+#endif
+
+void Conversions::uyvy2rgb ( unsigned char *src,
+                             unsigned char *dest,
+                             int width,
+                             int height ) {
+  int n = width * height;
+  int done = 0;
+#ifdef SIMD_DISPATCH
+  SimdDispatch::SimdLevel level = SimdDispatch::getLevel();
+  if (level == SimdDispatch::SIMD_AVX2) {
+    done = uyvyToRGBAVX2<false>(src, dest, n);
+  } else if (level == SimdDispatch::SIMD_SSE41) {
+    done = uyvyToRGBSSE41<false>(src, dest, n);
+  }
+#endif
+  uyvyToRGBScalar(src, dest, done, n, false);
+}
+
+void Conversions::yuyv2rgb ( unsigned char *src,
+                             unsigned char *dest,
+                             int width,
+                             int height ) {
+  int n = width * height;
+  int done = 0;
+#ifdef SIMD_DISPATCH
+  SimdDispatch::SimdLevel level = SimdDispatch::getLevel();
+  if (level == SimdDispatch::SIMD_AVX2) {
+    done = uyvyToRGBAVX2<true>(src, dest, n);
+  } else if (level == SimdDispatch::SIMD_SSE41) {
+    done = uyvyToRGBSSE41<true>(src, dest, n);
+  }
+#endif
+  uyvyToRGBScalar(src, dest, done, n, true);
+}
+
+void Conversions::rgb2uyvy (unsigned char *src, unsigned char *dest, int width, int height)
+{
+  int n = width * height;
+  int done = 0;
+#ifdef SIMD_DISPATCH
+  if (SimdDispatch::getLevel() >= SimdDispatch::SIMD_SSE41) done = rgbToUYVYSSE41<false>(src, dest, n);
+#endif
+  rgbToUYVYScalar(src, dest, done, n, false);
+}
+
+void Conversions::rgb2yuyv (unsigned char *src, unsigned char *dest, int width, int height)
+{
+  int n = width * height;
+  int done = 0;
+#ifdef SIMD_DISPATCH
+  if (SimdDispatch::getLevel() >= SimdDispatch::SIMD_SSE41) done = rgbToUYVYSSE41<true>(src, dest, n);
+#endif
+  rgbToUYVYScalar(src, dest, done, n, true);
+}
+
+void Conversions::y2rgb ( unsigned char *src,
+                          unsigned char *dest,
+                          int width,
+                          int height ) {
+  int n = width * height;
+  int done = 0;
+#ifdef SIMD_DISPATCH
+  if (SimdDispatch::getLevel() >= SimdDispatch::SIMD_SSE41) done = yToRGBSSE41(src, dest, n);
+#endif
+  yToRGBScalar(src, dest, done, n);
+}
+
 void Conversions::bgr2rgb ( unsigned char *src,
                             unsigned char *dest,
                             int width,
                             int height ) {
-  int NumPixels = width*height;
-  for ( int i=0;i<NumPixels*3;i+=3 ) {
-    dest[i]   = src[i+2];
-    dest[i+1] = src[i+1];
-    dest[i+2] = src[i];
-  }
+  int n = width * height;
+  int done = 0;
+#ifdef SIMD_DISPATCH
+  if (SimdDispatch::getLevel() >= SimdDispatch::SIMD_SSE41) done = swapRBSSE41(src, dest, n);
+#endif
+  swapRBScalar(src, dest, done, n);
 }
 
 void Conversions::rgb2bgr ( unsigned char *src,
                             unsigned char *dest,
                             int width,
                             int height ) {
-  int NumPixels = width*height;
-  for ( int i=0;i<NumPixels*3;i+=3 ) {
-    dest[i]   = src[i+2];
-    dest[i+1] = src[i+1];
-    dest[i+2] = src[i];
+  bgr2rgb(src, dest, width, height);
+}
+
+void Conversions::bayer2rgb ( unsigned char *src,
+                              unsigned char *dest,
+                              int width,
+                              int height,
+                              int red_position ) {
+  if (width < 2 || height < 2) {
+    fprintf(stderr, "Conversions::bayer2rgb: the image needs at least 2x2 pixels\n");
+    return;
+  }
+  int red_x = red_position & 1;
+  int red_y = (red_position >> 1) & 1;
+#ifdef SIMD_DISPATCH
+  SimdDispatch::SimdLevel level = SimdDispatch::getLevel();
+#endif
+  for (int y = 0; y < height; y++) {
+    //mirrored at the borders, which keeps the color of the samples:
+    const unsigned char * row = src + y * width;
+    const unsigned char * up = src + (y > 0 ? y - 1 : 1) * width;
+    const unsigned char * down = src + (y < height - 1 ? y + 1 : height - 2) * width;
+    unsigned char * dest_row = dest + 3 * y * width;
+    demosaicScalar(up, row, down, dest_row, width, y, 0, 1, red_x, red_y);
+    int x = 1;
+#ifdef SIMD_DISPATCH
+    if (level == SimdDispatch::SIMD_AVX2) {
+      x = demosaicAVX2(up, row, down, dest_row, width, y, x, red_x, red_y);
+    }
+    if (level >= SimdDispatch::SIMD_SSE41) {
+      x = demosaicSSE41(up, row, down, dest_row, width, y, x, red_x, red_y);
+    }
+#endif
+    demosaicScalar(up, row, down, dest_row, width, y, x, width, red_x, red_y);
   }
 }
 
@@ -95,144 +582,6 @@ void Conversions::uyv2rgb ( unsigned char *src,
   }
 }
 
-void Conversions::uyvy2rgb ( unsigned char *src,
-                             unsigned char *dest,
-                             int width,
-                             int height ) {
-  #ifndef NO_DC1394_CONVERSIONS
-    dc1394_convert_to_RGB8(src,dest, width, height, DC1394_BYTE_ORDER_UYVY,
-                       DC1394_COLOR_CODING_YUV422, 8);
-  #else
-  
-  int NumPixels = width*height;
-                             
-  register int max_i = ( NumPixels << 1 )-1;
-  //register int max_j = NumPixels + ( NumPixels << 1 ) -1;
-  register int i = 0;
-  register int j = 0;
-  register int y0, y1, u, v;
-  register int r, g, b;
-
-  while ( i < max_i ) {
-    u  = ( unsigned char ) src[i++] - 128;
-    y0 = ( unsigned char ) src[i++];
-    v  = ( unsigned char ) src[i++] - 128;
-    y1 = ( unsigned char ) src[i++];
-    yuv2rgb ( y0, u, v, r, g, b );
-    dest[j++] = r;
-    dest[j++] = g;
-    dest[j++] = b;
-    yuv2rgb ( y1, u, v, r, g, b );
-    dest[j++] = r;
-    dest[j++] = g;
-    dest[j++] = b;
-  }
-  #endif
-}
-
-void Conversions::yuyv2rgb ( unsigned char *src,
-                            unsigned char *dest,
-                            int width,
-                            int height ) {
-#ifndef NO_DC1394_CONVERSIONS
-    dc1394_convert_to_RGB8(src,dest, width, height, DC1394_BYTE_ORDER_YUYV,
-                           DC1394_COLOR_CODING_YUV422, 8);
-#else
-    
-    int NumPixels = width*height;
-    
-    register int max_i = ( NumPixels << 1 )-1;
-    //register int max_j = NumPixels + ( NumPixels << 1 ) -1;
-    register int i = 0;
-    register int j = 0;
-    register int y0, y1, u, v;
-    register int r, g, b;
-    
-    while ( i < max_i ) {
-        y0 = ( unsigned char ) src[i++];
-        u  = ( unsigned char ) src[i++];
-        y1 = ( unsigned char ) src[i++];
-        v  = ( unsigned char ) src[i++];
-        yuv2rgb ( y0, u, v, r, g, b );
-        dest[j++] = r;
-        dest[j++] = g;
-        dest[j++] = b;
-        yuv2rgb ( y1, u, v, r, g, b );
-        dest[j++] = r;
-        dest[j++] = g;
-        dest[j++] = b;
-    }
-#endif
-}
-
-
-void Conversions::rgb2uyvy (unsigned char *src, unsigned char *dest, int width, int height)
-{
-#ifndef NO_DC1394_CONVERSIONS
-    dc1394_convert_to_RGB8(src,dest, width, height, DC1394_BYTE_ORDER_UYVY,
-                           DC1394_COLOR_CODING_RGB8, 8);
-#else
-    
-    int NumPixels = width*height;
-    
-    register int max_i = ( NumPixels << 1 )-1;
-    //register int max_j = NumPixels + ( NumPixels << 1 ) -1;
-    register int i = 0;
-    register int j = 0;
-    register int y0, y1, u, v;
-    register int r, g, b;
-    
-    while ( i < max_i ) {
-        r = ( unsigned char ) src[i++];
-        g = ( unsigned char ) src[i++];
-        b = ( unsigned char ) src[i++];
-        rgb2yuv ( r, g, b, y0, u, v );
-        r = ( unsigned char ) src[i++];
-        g = ( unsigned char ) src[i++];
-        b = ( unsigned char ) src[i++];
-        rgb2yuv ( r, g, b, y1, u, v );
-        dest[j++] = u+128;
-        dest[j++] = y0;
-        dest[j++] = v+128;
-        dest[j++] = y1;
-    }
-#endif
-
-}
-
-void Conversions::rgb2yuyv (unsigned char *src, unsigned char *dest, int width, int height)
-{
-#ifndef NO_DC1394_CONVERSIONS
-    dc1394_convert_to_RGB8(src,dest, width, height, DC1394_BYTE_ORDER_YUYV,
-                           DC1394_COLOR_CODING_RGB8, 8);
-#else
-    
-    int NumPixels = width*height;
-    
-    register int max_i = ( NumPixels << 1 )-1;
-    //register int max_j = NumPixels + ( NumPixels << 1 ) -1;
-    register int i = 0;
-    register int j = 0;
-    register int y0, y1, u, v;
-    register int r, g, b;
-    
-    while ( i < max_i ) {
-        r = ( unsigned char ) src[i++];
-        g = ( unsigned char ) src[i++];
-        b = ( unsigned char ) src[i++];
-        rgb2yuv ( r, g, b, y0, u, v );
-        r = ( unsigned char ) src[i++];
-        g = ( unsigned char ) src[i++];
-        b = ( unsigned char ) src[i++];
-        rgb2yuv ( r, g, b, y1, u, v );
-        dest[j++] = y0;
-        dest[j++] = u+128;
-        dest[j++] = y1;
-        dest[j++] = v+128;
-    }
-#endif
-}
-
 void Conversions::uyvy2bgr ( unsigned char *src,
                              unsigned char *dest,
                              int width,
@@ -298,23 +647,6 @@ void Conversions::uyyvyy2rgb ( unsigned char *src,
   }
 }
 
-void Conversions::y2rgb ( unsigned char *src,
-                          unsigned char *dest,
-                          int width,
-                          int height ) {
-  int NumPixels = width*height;
-  register int i = NumPixels-1;
-  register int j = NumPixels + ( NumPixels << 1 )-1;
-  register int y;
-
-  while ( i > 0 ) {
-    y = ( unsigned char ) src[i--];
-    dest[j--] = y;
-    dest[j--] = y;
-    dest[j--] = y;
-  }
-}
-
 void Conversions::y162rgb ( unsigned char *src,
                             unsigned char *dest,
                             int width,
@@ -14,7 +14,7 @@
 //========================================================================
 /*!
   \file    conversions.h
-  \brief   Various color conversion operations, but NOT very optimized
+  \brief   Various color conversion operations
   \author  
 */
 //========================================================================
@@ -30,10 +30,13 @@
 
 //#include "ccvt.h"
 
+#include "simd_dispatch.h"
+
 //-------------------------------------------------
-//NOTE full image conversion routines (yuv->rgb) in this file
-//     have been measured to be REALLY slow
-//     Some functions will use dc1394 for speedup (if available)
+//NOTE the full image conversions between RGB, YUV422,
+//     grey and Bayer images use SSE4.1 or AVX2 kernels
+//     if the CPU supports them. Their results are
+//     bit-identical to the scalar versions.
 //-------------------------------------------------
 
 
@@ -106,17 +109,23 @@ inline static yuv uyvy2yuv(const uyvy &color_uyvy, int x) {
   return color_yuv;
 }
 
-//DC1394 accelerated:
+//SIMD accelerated:
 static void uyvy2rgb (unsigned char *src, unsigned char *dest, int width, int height);
 static void yuyv2rgb ( unsigned char *src, unsigned char *dest, int width, int height);
+/// the chroma of each pixel pair is the mean of the chroma of both pixels
 static void rgb2uyvy (unsigned char *src, unsigned char *dest, int width, int height);
 static void rgb2yuyv ( unsigned char *src, unsigned char *dest, int width, int height);
-    
-//others (non-accelerated):
-static void uyyvyy2rgb (unsigned char *src, unsigned char *dest, int width, int height);
 static void y2rgb (unsigned char *src, unsigned char *dest, int width, int height);
 static void bgr2rgb (unsigned char *src, unsigned char *dest, int width, int height);
 static void rgb2bgr (unsigned char *src, unsigned char *dest, int width, int height);
+/// bilinear demosaicing of a RAW8 Bayer image. \p red_position is the position of
+/// the red sample in the top-left 2x2 quad (x + 2*y, i.e. 0 for RGGB, 1 for GRBG,
+/// 2 for GBRG and 3 for BGGR, as in BayerLUT::Pattern). The image is mirrored at its
+/// borders, so it must be at least 2x2 pixels.
+static void bayer2rgb (unsigned char *src, unsigned char *dest, int width, int height, int red_position=0);
+
+//others (non-accelerated):
+static void uyyvyy2rgb (unsigned char *src, unsigned char *dest, int width, int height);
 static void rgb482rgb (unsigned char *src, unsigned char *dest, int width, int height);
 static void uyv2rgb (unsigned char *src, unsigned char *dest, int width, int height);
 static void uyvy2bgr (unsigned char *src, unsigned char *dest, int width, int height);
@@ -43,6 +43,27 @@ void computeMask(const ConvexHull &convex_hull, Image<raw8> &mask) {
   }
 }
 
+// The mask is convex, so the white pixels of each row form a single span.
+static void computeRowSpans(const Image<raw8> &mask, RowSpans &spans) {
+  const int width = mask.getWidth();
+  const int height = mask.getHeight();
+  spans.clear();
+  for (int y = 0; y < height; ++y) {
+    const raw8 *row = mask.getPixelData() + y * width;
+    int minX = 0;
+    while (minX < width && row[minX].v == 0) ++minX;
+    int maxX = width;
+    while (maxX > minX && row[maxX - 1].v == 0) --maxX;
+    spans.add(minX, maxX);
+    spans.endRow();
+  }
+}
+
+void ConvexHullImageMask::_updateMask() {
+  computeMask(_convex_hull, _mask);
+  computeRowSpans(_mask, _row_spans);
+}
+
 void ConvexHullImageMask::slotMaskPointsRead() {
   lock();
   
@@ -82,7 +103,7 @@ void ConvexHullImageMask::reset() {
   lock();
   
   _convex_hull.clear();
-  computeMask(_convex_hull, _mask);
+  _updateMask();
   _v_list->resetToDefault();
   
   unlock();
@@ -92,7 +113,7 @@ void ConvexHullImageMask::_addPoint(const int x, const int y, const bool add_to_
   const bool changed = _convex_hull.addPoint(x, y);
 
   if (changed) {
-    computeMask(_convex_hull, _mask);
+    _updateMask();
 
     if (add_to_list) {
       VarTypes::VarList *point = new VarTypes::VarList();
@@ -120,7 +141,7 @@ void ConvexHullImageMask::removePoint(const int x, const int y, const int margin
       changed = _convex_hull.removePoint(x + w, y + h);
 
   if (changed) {
-    computeMask(_convex_hull, _mask);
+    _updateMask();
 
     _v_list->resetToDefault();
     for (auto it = _convex_hull.begin(); it != _convex_hull.end(); ++it) {
@@ -140,7 +161,7 @@ void ConvexHullImageMask::removePoint(const int x, const int y, const int margin
 void ConvexHullImageMask::setSize(const int w, const int h) {
   lock();
   _mask.allocate(w, h);
-  computeMask(_convex_hull, _mask);
+  _updateMask();
   unlock();
 }
 
@@ -180,6 +201,10 @@ const Image<raw8>& ConvexHullImageMask::getMask() const {
   return _mask;
 }
 
+const RowSpans& ConvexHullImageMask::getRowSpans() const {
+  return _row_spans;
+}
+
 const ConvexHull& ConvexHullImageMask::getConvexHull() const {
   return _convex_hull;
 }
@@ -3,6 +3,7 @@
 
 #include "image.h"
 #include "convex_hull.h"
+#include "row_spans.h"
 #include "VarTypes.h"
 #include <qmutex.h>
 
@@ -11,10 +12,12 @@ class ConvexHullImageMask : public QObject {
  private:
   ConvexHull _convex_hull;
   Image<raw8> _mask;
+  RowSpans _row_spans;
   VarTypes::VarExternal * _v_settings;
   VarTypes::VarList * _v_list;
   mutable QMutex mutex;
   void _addPoint(const int x, const int y, const bool add_to_list=true);
+  void _updateMask();
   
  public:
   ConvexHullImageMask(const std::string &filename = "");
@@ -28,6 +31,8 @@ class ConvexHullImageMask : public QObject {
   int getWidth() const;
   int getHeight() const;
   const Image<raw8>& getMask() const;
+  /// the unmasked pixels of each row, as the mask is convex there is at most one span per row
+  const RowSpans& getRowSpans() const;
   const ConvexHull& getConvexHull() const;
 
   void lock() const;
@@ -58,24 +58,24 @@ public:
   }
 
   ///check whether a point is within the legal field or the boundary (but not the referee walking area)
-  bool isInFieldOrPlayableBoundary(const vector2d & pos) {
+  bool isInFieldOrPlayableBoundary(const vector2d & pos) const {
     return (fabs(pos.x) <= (half_field_length+boundary_width) &&
             fabs(pos.y) <= (half_field_width+boundary_width));
   }
 
   ///check whether a point is within the legal field (excluding all boundary areas) plus some threshold
-  bool isInFieldPlusThreshold(const vector2d & pos, double threshold) {
+  bool isInFieldPlusThreshold(const vector2d & pos, double threshold) const {
     return (fabs(pos.x) <= (half_field_length+threshold) &&  fabs(pos.y) <= (half_field_width+threshold));
   }
 
   ///check whether a point is within the legal field (excluding all boundary areas)
-  bool isInField(const vector2d & pos) {
+  bool isInField(const vector2d & pos) const {
     return (fabs(pos.x) <= half_field_length && fabs(pos.y) <= half_field_width);
   }
 
   ///checks whether a point is very far in the goal (more than half-way)
   ///this is mostly used for vision filtering
-  bool isFarInGoal(const vector2d & pos) {
+  bool isFarInGoal(const vector2d & pos) const {
     return (fabs(pos.y) < half_goal_width &&
             fabs(pos.x) > half_field_length + (goal_depth/2));
   }
@@ -0,0 +1,198 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    latency_histogram.cpp
+  \brief   C++ Implementation: LatencyHistogram, LatencyStatistics
+*/
+//========================================================================
+#include "latency_histogram.h"
+#include <stdio.h>
+#include <mutex>
+
+LatencyHistogram::LatencyHistogram() : max_value(0) {
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    counts[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+int LatencyHistogram::bucketOf(uint64_t value) {
+  if (value < (uint64_t)SUB_BUCKETS) return (int)value;
+  int msb = 63 - __builtin_clzll(value);
+  if (msb >= MAX_EXPONENT) return NUM_BUCKETS - 1;
+  int e = msb - SUB_BITS;
+  return (e + 1) * SUB_BUCKETS + (int)(value >> e) - SUB_BUCKETS;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int bucket) {
+  if (bucket < SUB_BUCKETS) return (uint64_t)bucket;
+  int e = bucket / SUB_BUCKETS - 1;
+  uint64_t m = (uint64_t)(bucket % SUB_BUCKETS + SUB_BUCKETS);
+  return ((m + 1) << e) - 1;
+}
+
+void LatencyHistogram::record(int64_t nanoseconds) {
+  if (nanoseconds < 0) nanoseconds = 0;
+  counts[bucketOf((uint64_t)nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+  int64_t prev = max_value.load(std::memory_order_relaxed);
+  while (nanoseconds > prev &&
+         !max_value.compare_exchange_weak(prev, nanoseconds, std::memory_order_relaxed)) {
+  }
+}
+
+LatencyHistogram::Summary LatencyHistogram::summarize(const uint32_t * snapshot, int64_t max_ns) {
+  Summary s;
+  for (int i = 0; i < NUM_BUCKETS; i++) s.count += snapshot[i];
+  if (s.count == 0) return s;
+
+  const double quantiles[2] = {0.5, 0.99};
+  double * results[2] = {&s.p50, &s.p99};
+  for (int q = 0; q < 2; q++) {
+    uint64_t rank = (uint64_t)(quantiles[q] * (double)s.count + 0.999999);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+      seen += snapshot[i];
+      if (seen >= rank) {
+        uint64_t v = bucketUpperBound(i);
+        if ((int64_t)v > max_ns) v = (uint64_t)max_ns;
+        *results[q] = (double)v / 1000.0;
+        break;
+      }
+    }
+  }
+  s.max = (double)max_ns / 1000.0;
+  return s;
+}
+
+LatencyHistogram::Summary LatencyHistogram::summarize() const {
+  uint32_t snapshot[NUM_BUCKETS];
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    snapshot[i] = counts[i].load(std::memory_order_relaxed);
+  }
+  return summarize(snapshot, max_value.load(std::memory_order_relaxed));
+}
+
+LatencyHistogram::Summary LatencyHistogram::collect() {
+  uint32_t snapshot[NUM_BUCKETS];
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    snapshot[i] = counts[i].exchange(0, std::memory_order_relaxed);
+  }
+  return summarize(snapshot, max_value.exchange(0, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::reset() {
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    counts[i].store(0, std::memory_order_relaxed);
+  }
+  max_value.store(0, std::memory_order_relaxed);
+}
+
+LatencyStatistics::LatencyStatistics(const string & _name) : name(_name) {
+  settings = new VarList(name);
+  settings->addChild(v_count = new VarInt("samples", 0));
+  settings->addChild(v_p50 = new VarDouble("p50 (us)", 0.0));
+  settings->addChild(v_p99 = new VarDouble("p99 (us)", 0.0));
+  settings->addChild(v_max = new VarDouble("max (us)", 0.0));
+  //these are readouts only:
+  settings->addFlags(VARTYPE_FLAG_NOSTORE);
+  v_count->addFlags(VARTYPE_FLAG_READONLY);
+  v_p50->addFlags(VARTYPE_FLAG_READONLY);
+  v_p99->addFlags(VARTYPE_FLAG_READONLY);
+  v_max->addFlags(VARTYPE_FLAG_READONLY);
+}
+
+LatencyStatistics::~LatencyStatistics() {
+  delete settings;
+  delete v_count;
+  delete v_p50;
+  delete v_p99;
+  delete v_max;
+}
+
+string LatencyStatistics::getName() const {
+  return name;
+}
+
+VarList * LatencyStatistics::getSettings() {
+  return settings;
+}
+
+const LatencyHistogram::Summary & LatencyStatistics::update() {
+  last = histogram.collect();
+  v_count->setInt((int)last.count);
+  v_p50->setDouble(last.p50);
+  v_p99->setDouble(last.p99);
+  v_max->setDouble(last.max);
+  return last;
+}
+
+const LatencyHistogram::Summary & LatencyStatistics::getLastSummary() const {
+  return last;
+}
+
+static string jsonEscape(const string & s) {
+  string res;
+  for (char c : s) {
+    if (c == '"' || c == '\\') res += '\\';
+    res += c;
+  }
+  return res;
+}
+
+bool LatencyStatistics::exportTo(const string & filename, const string & source, double time,
+                                 const vector<LatencyStatistics *> & stats) {
+  //several capture threads may share one file:
+  static std::mutex file_mutex;
+  std::lock_guard<std::mutex> guard(file_mutex);
+
+  FILE * f = fopen(filename.c_str(), "a");
+  if (f == 0) {
+    fprintf(stderr, "LatencyStatistics: unable to open '%s' for writing\n", filename.c_str());
+    return false;
+  }
+
+  bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+  if (json) {
+    fprintf(f, "{\"time\":%.6f,\"source\":\"%s\",\"latency\":[", time, jsonEscape(source).c_str());
+    for (unsigned int i = 0; i < stats.size(); i++) {
+      const LatencyHistogram::Summary & s = stats[i]->getLastSummary();
+      fprintf(f, "%s{\"name\":\"%s\",\"count\":%llu,\"p50_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f}",
+              i == 0 ? "" : ",", jsonEscape(stats[i]->getName()).c_str(),
+              (unsigned long long)s.count, s.p50, s.p99, s.max);
+    }
+    fprintf(f, "]}\n");
+  } else {
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0) {
+      fprintf(f, "time,source,name,count,p50_us,p99_us,max_us\n");
+    }
+    for (auto stat : stats) {
+      const LatencyHistogram::Summary & s = stat->getLastSummary();
+      fprintf(f, "%.6f,%s,%s,%llu,%.3f,%.3f,%.3f\n", time, source.c_str(), stat->getName().c_str(),
+              (unsigned long long)s.count, s.p50, s.p99, s.max);
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+void LatencyStatistics::print(const vector<LatencyStatistics *> & stats) {
+  printf("%-23s %9s %9s %9s  (us)\n", "", "p50", "p99", "max");
+  for (auto stat : stats) {
+    const LatencyHistogram::Summary & s = stat->getLastSummary();
+    printf("%-23s %9.1f %9.1f %9.1f\n", stat->getName().c_str(), s.p50, s.p99, s.max);
+  }
+  printf("\n");
+}
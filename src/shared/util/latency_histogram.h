@@ -0,0 +1,121 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    latency_histogram.h
+  \brief   C++ Interface: LatencyHistogram, LatencyStatistics
+*/
+//========================================================================
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "VarTypes.h"
+using namespace std;
+using namespace VarTypes;
+
+/*!
+  \class   LatencyHistogram
+  \brief   A log-linear histogram of durations with a lock-free record()
+
+  Like an HDR histogram, every power of two is split into SUB_BUCKETS
+  linear buckets, so values are kept with a relative error below
+  1/SUB_BUCKETS from 1ns up to MAX_EXPONENT.
+  Recording is a single relaxed atomic increment, so it can be done from
+  any processing thread without disturbing it. Readers may summarize
+  concurrently and will see a slightly stale but valid state.
+*/
+class LatencyHistogram {
+public:
+  /// percentiles and maximum in microseconds
+  struct Summary {
+    uint64_t count = 0;
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+  };
+
+  LatencyHistogram();
+
+  void record(int64_t nanoseconds);
+  void record(std::chrono::steady_clock::duration duration) {
+    record((int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+  }
+
+  /// summarizes everything recorded so far
+  Summary summarize() const;
+
+  /// summarizes everything recorded since the last call and starts over
+  Summary collect();
+
+  void reset();
+
+protected:
+  static const int SUB_BITS = 5;
+  static const int SUB_BUCKETS = 1 << SUB_BITS;
+  static const int MAX_EXPONENT = 40; //~18 minutes
+  static const int NUM_BUCKETS = (MAX_EXPONENT - SUB_BITS + 1) * SUB_BUCKETS;
+
+  std::atomic<uint32_t> counts[NUM_BUCKETS];
+  std::atomic<int64_t> max_value;
+
+  static int bucketOf(uint64_t value);
+  static uint64_t bucketUpperBound(int bucket);
+  static Summary summarize(const uint32_t * snapshot, int64_t max_ns);
+};
+
+/*!
+  \class   LatencyStatistics
+  \brief   A named LatencyHistogram with VarTypes readouts
+
+  update() is meant to be called periodically, e.g. once per second. It
+  closes the current window, shows its p50/p99/max in the settings tree
+  and keeps the summary for export().
+*/
+class LatencyStatistics {
+public:
+  explicit LatencyStatistics(const string & name);
+  ~LatencyStatistics();
+
+  LatencyHistogram histogram;
+
+  string getName() const;
+  VarList * getSettings();
+
+  const LatencyHistogram::Summary & update();
+  const LatencyHistogram::Summary & getLastSummary() const;
+
+  /// appends the last summaries of \p stats to \p filename: one JSON object
+  /// per call if the name ends in ".json", CSV rows otherwise
+  static bool exportTo(const string & filename, const string & source, double time,
+                       const vector<LatencyStatistics *> & stats);
+
+  /// prints the last summaries of \p stats as a table
+  static void print(const vector<LatencyStatistics *> & stats);
+
+protected:
+  string name;
+  LatencyHistogram::Summary last;
+  VarList * settings;
+  VarInt * v_count;
+  VarDouble * v_p50;
+  VarDouble * v_p99;
+  VarDouble * v_max;
+};
+
+#endif
@@ -0,0 +1,239 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    lockfree_ringbuffer.h
+  \brief   C++ Interface: LockFreeRingBuffer
+*/
+//========================================================================
+
+#ifndef LOCKFREE_RINGBUFFER_H_
+#define LOCKFREE_RINGBUFFER_H_
+#include <qmutex.h>
+#include <atomic>
+#include <stdint.h>
+
+/*!
+  \class LockFreeRingBuffer
+  \brief A lock-free drop-in replacement for RingBuffer
+
+  This offers the same interface and the same overwrite semantics as
+  RingBuffer, but the read and write indices don't need a mutex.
+  All four indices are packed into one atomic word, so every operation
+  is a single compare-and-swap which either sees or changes a consistent
+  state. That keeps the guarantees of RingBuffer:
+    1) the reader and the writer will NEVER access the same bin at the same time
+    2) the reader will not leap ahead over the writer
+
+  The state lives on its own cache line, so that polling readers don't
+  false-share with the item array or the read lock.
+
+  The read lock is still a mutex, as it is only needed to coordinate
+  multiple readers among themselves.
+*/
+
+template <class ITEM>
+class LockFreeRingBuffer {
+  protected:
+    //packed indices, 16 bits each:
+    static const int CURRENT_READ = 0;
+    static const int CURRENT_WRITE = 16;
+    static const int PREVIOUS_WRITE = 32;
+    static const int PREVIOUS_READ = 48;
+
+    alignas(64) std::atomic<uint64_t> state;
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+    QMutex readlock;
+  public:
+    ITEM * items;
+    int size;
+
+    /*!
+      \brief Constructor of the Ringbuffer
+      \param _size determines how many elements are stored in it.
+
+      Note that \p _size needs to be at least 2 and less than 65535!
+    */
+    LockFreeRingBuffer ( int _size ) {
+      items=new ITEM[_size];
+      size=_size;
+      //previous_read starts at -1, which is stored as 0xFFFF:
+      state.store ( pack ( 0, 1, 0, 0xFFFF ) );
+    }
+    virtual ~LockFreeRingBuffer() {
+      delete[] items;
+    }
+  private:
+    static uint64_t pack ( int current_read, int current_write, int previous_write, int previous_read ) {
+      return ( ( uint64_t ) ( current_read & 0xFFFF ) << CURRENT_READ ) |
+             ( ( uint64_t ) ( current_write & 0xFFFF ) << CURRENT_WRITE ) |
+             ( ( uint64_t ) ( previous_write & 0xFFFF ) << PREVIOUS_WRITE ) |
+             ( ( uint64_t ) ( previous_read & 0xFFFF ) << PREVIOUS_READ );
+    }
+    static int field ( uint64_t s, int shift ) {
+      int v = ( int ) ( ( s >> shift ) & 0xFFFF );
+      return ( v == 0xFFFF ) ? -1 : v;
+    }
+    static uint64_t setField ( uint64_t s, int shift, int value ) {
+      return ( s & ~ ( ( uint64_t ) 0xFFFF << shift ) ) | ( ( uint64_t ) ( value & 0xFFFF ) << shift );
+    }
+    int next ( int cur_idx, int not_avail, bool preventLap ) const {
+      //if preventLap is true then we won't jump over
+      //not_avail.
+      int idx=cur_idx+1;
+      if ( idx >= size ) idx=0;
+      if ( idx < 0 ) idx=0;
+      if ( idx == not_avail ) {
+        if ( preventLap ) {
+          idx=cur_idx;
+        } else {
+          idx++;
+        }
+      }
+      if ( idx >= size || idx==-1 ) idx=0;
+      return idx;
+    }
+  public:
+
+    /*!
+      \brief returns the item (or a copy thereof) at index \p idx
+    */
+    ITEM getItem ( int idx ) {
+      if ( idx >= size ) idx=size-1;
+      if ( idx < 0 ) idx=0;
+      return items[idx];
+    }
+
+    /*!
+      \brief returns a pointer to the item at index \p idx
+    */
+    ITEM * getPointer ( int idx ) {
+      if ( idx >= size ) idx=size-1;
+      if ( idx < 0 ) idx=0;
+      return & ( items[idx] );
+    }
+
+    /*!
+      \brief gets the index to the next write-bin
+
+      Same as RingBuffer::nextWrite(), but lock-free.
+    */
+    int nextWrite ( bool allow_lapping ) {
+      uint64_t s = state.load ( std::memory_order_acquire );
+      uint64_t n;
+      int res;
+      do {
+        int current_write = field ( s, CURRENT_WRITE );
+        res = next ( current_write, field ( s, CURRENT_READ ), allow_lapping );
+        n = setField ( setField ( s, PREVIOUS_WRITE, current_write ), CURRENT_WRITE, res );
+      } while ( !state.compare_exchange_weak ( s, n, std::memory_order_acq_rel, std::memory_order_acquire ) );
+      return res;
+    }
+
+    /*!
+      \brief moves on to the next write-bin, without making the current one readable
+
+      Same as RingBuffer::advanceWrite(), but lock-free.
+    */
+    int advanceWrite ( bool allow_lapping ) {
+      uint64_t s = state.load ( std::memory_order_acquire );
+      uint64_t n;
+      int res;
+      do {
+        res = next ( field ( s, CURRENT_WRITE ), field ( s, CURRENT_READ ), allow_lapping );
+        n = setField ( s, CURRENT_WRITE, res );
+      } while ( !state.compare_exchange_weak ( s, n, std::memory_order_acq_rel, std::memory_order_acquire ) );
+      return res;
+    }
+
+    /*!
+      \brief makes the completed bin \p idx the most recent one for readers
+    */
+    void publishWrite ( int idx ) {
+      uint64_t s = state.load ( std::memory_order_acquire );
+      while ( !state.compare_exchange_weak ( s, setField ( s, PREVIOUS_WRITE, idx ), std::memory_order_acq_rel, std::memory_order_acquire ) ) {
+      }
+    }
+
+    /*!
+      \brief gets the index to the next read-bin
+
+      Same as RingBuffer::nextRead(), but lock-free.
+    */
+    int nextRead ( bool skip_frames ) {
+      uint64_t s = state.load ( std::memory_order_acquire );
+      uint64_t n;
+      int res;
+      do {
+        int current_read = field ( s, CURRENT_READ );
+        int current_write = field ( s, CURRENT_WRITE );
+        if ( skip_frames ) {
+          int previous_write = field ( s, PREVIOUS_WRITE );
+          int prev_frame;
+          if ( previous_write==0 ) {
+            prev_frame=size-1;
+          } else {
+            prev_frame=previous_write-1;
+            if ( prev_frame < 0 ) prev_frame=0;
+          }
+          res=next ( prev_frame,current_write,true );
+        } else {
+          res=next ( current_read,current_write,true );
+        }
+        n = setField ( setField ( s, PREVIOUS_READ, current_read ), CURRENT_READ, res );
+      } while ( !state.compare_exchange_weak ( s, n, std::memory_order_acq_rel, std::memory_order_acquire ) );
+      return res;
+    }
+
+    /*!
+      \brief returns the index of the current write-bin
+    */
+    int curWrite() {
+      return field ( state.load ( std::memory_order_acquire ), CURRENT_WRITE );
+    }
+
+    /*!
+      \brief returns the index of the most recently completed write-bin
+    */
+    int prevWrite() {
+      return field ( state.load ( std::memory_order_acquire ), PREVIOUS_WRITE );
+    }
+
+    /*!
+      \brief returns the index of the current read-bin
+    */
+    int curRead() {
+      return field ( state.load ( std::memory_order_acquire ), CURRENT_READ );
+    }
+
+    /*!
+      \brief locks the readlock mutex
+      This function is only required for scenarios where you expect to have
+      *multiple readers*, all accessing the same ringbuffer.
+    */
+    void lockRead() {
+      readlock.lock();
+    }
+
+    /*!
+      \brief unlocks the readlock mutex
+      This function is only required for scenarios where you expect to have
+      *multiple readers*, all accessing the same ringbuffer.
+    */
+    void unlockRead() {
+      readlock.unlock();
+    }
+};
+
+#endif /*LOCKFREE_RINGBUFFER_H_*/
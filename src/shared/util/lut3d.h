@@ -26,6 +26,8 @@
 #include <assert.h>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <memory>
 #include <qmutex.h>
 #include "VarTypes.h"
 #define LUTFILL_MAXDEPTH 10000
@@ -69,9 +71,37 @@ class LUTChannel {
   rgb draw_color;
 };
 
+/*!
+  \class LUTTable
+  \brief An immutable copy of the table of a LUT3D, as published to the readers
+*/
+class LUTTable {
+  protected:
+    vector<lut_mask_t> data;
+    unsigned int version;
+  public:
+    LUTTable(const lut_mask_t * table, unsigned int size, unsigned int _version) : data(table, table+size) {
+      version=_version;
+    }
+    const lut_mask_t * getTable() const {
+      return data.data();
+    }
+    /// counts the publications of the LUT, starting at 1
+    unsigned int getVersion() const {
+      return version;
+    }
+};
+
 /*!
   \class LUT3D
   \brief  A general 3D LUT class, allowing fast bit-wise lookup
+
+  The table is edited in place (under lock()) by the calibration tools,
+  which then call updateDerivedLUTs() or publish(). This publishes a copy
+  of the table by an atomic pointer swap. The vision thread only ever
+  reads published copies: it pins one with pin() per frame, which does not
+  wait for an edit in progress, and the copy stays valid for as long as it
+  is held.
   \author Stefan Zickler
 */
 class LUT3D : public QObject {
@@ -100,6 +130,16 @@ class LUT3D : public QObject {
     vector<LUTChannel> channels;
     vector<LUT3D *> derived_LUTs;
     QMutex mutex;
+    QMutex derived_mutex; //guards derived_LUTs, which the readers look up
+    //the most recently published table, only accessed with std::atomic_load()/std::atomic_store():
+    std::shared_ptr<const LUTTable> published;
+    unsigned int num_published;
+
+    //publishes a copy of the table, the caller holds the lock:
+    void publishTable() {
+      std::shared_ptr<const LUTTable> table=std::make_shared<LUTTable>(LUT,LUT_SIZE,++num_published);
+      std::atomic_store(&published,table);
+    }
   protected slots:
     void slotVBlobChange() {
       updateDerivedLUTs();
@@ -126,6 +166,7 @@ class LUT3D : public QObject {
       LUT_SIZE = (0x01 << (TOTAL_BITS+1));// + 1;
       channels.resize(sizeof(lut_mask_t));
       LUT=new lut_mask_t[LUT_SIZE];
+      num_published=0;
 
       if (filename=="") {
         v_settings=0;
@@ -137,6 +178,7 @@ class LUT3D : public QObject {
       }
 
       reset();
+      publish();
     };
 
     bool copyLUT(lut_mask_t *pDataLUT, int size_copy, int color_index=-1) {   //memory copy of other camera LUT
@@ -160,6 +202,7 @@ class LUT3D : public QObject {
         return true;
     }
     
+    /// serializes the writers of the table, readers use pin() instead
     void lock() {
       mutex.lock();
     }
@@ -170,6 +213,22 @@ class LUT3D : public QObject {
       return v_settings;
     }
 
+    /// makes the current content of the table visible to pin()
+    void publish() {
+      lock();
+      publishTable();
+      unlock();
+    }
+
+    /// returns the most recently published table, which stays valid while
+    /// the returned pointer is held, even if newer ones get published.
+    /// This is not lock-free: std::atomic_load() of a shared_ptr briefly takes
+    /// an internal lock of the standard library, which only a concurrent
+    /// pin() or publish() contends. Call it once per frame, not per pixel.
+    std::shared_ptr<const LUTTable> pin() const {
+      return std::atomic_load(&published);
+    }
+
     LUTChannel getChannel(unsigned int idx) const {
       if (idx >= channels.size()) {
         fprintf(stderr,"invalid channel selected in getChannel(...)\n");
@@ -180,6 +239,7 @@ class LUT3D : public QObject {
 
     void clearDerivedLUTs(bool unallocate_derived_memory=true) {
       lock();
+      derived_mutex.lock();
         int n = derived_LUTs.size();
         if (unallocate_derived_memory) {
           for (int i = 0; i < n; i ++) {
@@ -187,6 +247,7 @@ class LUT3D : public QObject {
           }
         }
         derived_LUTs.clear();
+      derived_mutex.unlock();
       unlock();
     }
 
@@ -196,23 +257,23 @@ class LUT3D : public QObject {
 
     LUT3D * getDerivedLUT(int idx) {
       LUT3D * res=0;
-      lock();
+      derived_mutex.lock();
         res = derived_LUTs[idx];
-      unlock();
+      derived_mutex.unlock();
       return res;
     }
 
     void addDerivedLUT(LUT3D * lut) {
-      lock();
+      derived_mutex.lock();
       if (lut!=0) {
         derived_LUTs.push_back(lut);
       }
-      unlock();
+      derived_mutex.unlock();
     }
 
     LUT3D * getDerivedLUT(ColorSpace space) {
      LUT3D * result=0;
-     lock();
+     derived_mutex.lock();
       int n = derived_LUTs.size();
       for (int i = 0; i < n; i ++) {
         if (derived_LUTs[i]->getColorSpace()==space) {
@@ -220,16 +281,24 @@ class LUT3D : public QObject {
           break;
         }
       }
-      unlock();
+      derived_mutex.unlock();
       return result;
     }
 
+    /// publishes the table, then rederives and publishes the derived LUTs
     void updateDerivedLUTs() {
       lock();
-      int n = derived_LUTs.size();
+      publishTable();
+      derived_mutex.lock();
+      vector<LUT3D *> derived = derived_LUTs;
+      derived_mutex.unlock();
+      int n = derived.size();
       for (int i = 0; i < n; i ++) {
-        derived_LUTs[i]->copyChannels(*this);
-        derived_LUTs[i]->deriveFromLUT(this);
+        derived[i]->copyChannels(*this);
+        derived[i]->lock();
+        derived[i]->deriveFromLUT(this);
+        derived[i]->publishTable();
+        derived[i]->unlock();
       }
       unlock(); 
     }
@@ -306,6 +375,7 @@ class LUT3D : public QObject {
       unlock();
     };
 
+    /// the table that is edited, see pin() for reading it while it may be edited
     lut_mask_t * getTable() const {
       return LUT;
     }
@@ -540,6 +610,47 @@ class RGBLUT : public LUT3D {
 
 };
 
+/*!
+  \class BayerLUT
+  \brief  An RGB LUT for thresholding raw Bayer images without demosaicing them
+
+  It is indexed by the red sample, the mean of the two green samples and
+  the blue sample of a 2x2 quad of the sensor, which is the color that a
+  demosaicing would produce at the center of the quad. The pattern tells
+  which sample of a quad at even coordinates has which color.
+*/
+class BayerLUT : public RGBLUT {
+  public:
+  /// named by the colors of the top-left quad, row by row. The value is the
+  /// position of the red sample in that quad (x + 2*y).
+  enum Pattern {
+    PATTERN_RGGB = 0,
+    PATTERN_GRBG = 1,
+    PATTERN_GBRG = 2,
+    PATTERN_BGGR = 3
+  };
+
+  protected:
+  std::atomic<int> pattern;
+
+  public:
+  BayerLUT(Pattern _pattern=PATTERN_RGGB, unsigned int r_bits=5, unsigned int g_bits=5, unsigned int b_bits=5, string filename="bayerlut.xml") : RGBLUT(r_bits, g_bits, b_bits, filename), pattern(_pattern) {};
+
+  Pattern getPattern() const {
+    return (Pattern)pattern.load();
+  }
+
+  /// takes effect with the next thresholding call
+  void setPattern(Pattern _pattern) {
+    pattern.store(_pattern);
+  }
+
+  virtual ColorSpace getColorSpace() const {
+    return CSPACE_BAYER;
+  }
+
+};
+
 /*!
   \class YUVLUT
   \brief  A 3D YUV LUT
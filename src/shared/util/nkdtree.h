@@ -74,6 +74,7 @@ public:
 
 protected:
   Node *root;
+  Node *free_nodes; // nodes of cleared trees, kept for reuse (chained by child[0])
   int leaf_size,max_depth;
   int is_built;
 
@@ -98,6 +99,7 @@ protected:
   void calcBBox(BBox &b,BBox &c1,BBox &c2);
 
   void freeTree(Node *p);
+  Node *newNode();
   void add(Node **q,state_t *s,int level);
   void split(Node *p,int level);
 
@@ -109,8 +111,8 @@ protected:
   void draw(const Node *t,int levels) const;
 
 public:
-  NKDTree() {root=NULL; leaf_size=16; max_depth=20; scale.set(1.0);}
-  ~NKDTree() {clear();}
+  NKDTree() {root=NULL; free_nodes=NULL; leaf_size=16; max_depth=20; scale.set(1.0);}
+  ~NKDTree();
 
   void add(state_t *s) {add(&root,s,0);}
   void build();
@@ -213,14 +215,40 @@ void NKD_FUN::calcBBox(BBox &b,BBox &c1,BBox &c2)
   b.max.max(c1.max, c2.max);
 }
 
+NKD_TEM
+NKD_FUN::~NKDTree()
+{
+  clear();
+  while(free_nodes){
+    Node *p = free_nodes;
+    free_nodes = p->child[0];
+    delete(p);
+  }
+}
+
 NKD_TEM
 void NKD_FUN::freeTree(Node *p)
+// keeps the nodes for the next tree, so rebuilding it every frame does not allocate
 {
   if(p){
-    freeTree(p->child[0]); p->child[0]=NULL;
+    freeTree(p->child[0]);
     freeTree(p->child[1]); p->child[1]=NULL;
-    delete(p);
+    p->child[0] = free_nodes;
+    free_nodes = p;
+  }
+}
+
+NKD_TEM
+typename NKD_FUN::Node *NKD_FUN::newNode()
+{
+  Node *p = free_nodes;
+  if(p){
+    free_nodes = p->child[0];
+  }else{
+    p = new Node;
   }
+  mzero(*p);
+  return(p);
 }
 
 NKD_TEM
@@ -235,8 +263,7 @@ void NKD_FUN::add(Node **q,state_t *s,int level)
 
     // make a new node if none exists here
     if(!p){
-      *q = p = new Node;
-      mzero(*p);
+      *q = p = newNode();
       initBBox(*p,*s);
     }
 
@@ -55,5 +55,8 @@ bool RANGE_FUN::inside(num v) const
 
 #undef RANGE_TEM
 #undef RANGE_FUN
+
+/// the pixels [min,max) of an image row
+typedef Range<int,false,true> PixelSpan;
 };
 #endif
@@ -29,6 +29,7 @@ RawImage::RawImage()
   height=0;
   format=COLOR_UNDEFINED;
   time=0.0;
+  borrowed=false;
 }
 
 
@@ -104,18 +105,20 @@ void RawImage::setTime(double t)
   time=t;
 }
 
-void RawImage::setData(unsigned char * d)
+void RawImage::setData(unsigned char * d, bool owned)
 {
-  if (data!=0) delete[] data;
+  if (data!=0 && !borrowed) delete[] data;
   data=d;
+  borrowed=!owned;
 }
 
 void  RawImage::allocate (ColorFormat fmt, int w, int h)
 {
   if(w >= 0 && h >= 0) {
-    if (data!=0) {
+    if (data!=0 && !borrowed) {
       delete[] data;
     }
+    borrowed=false;
     if (w==0 && h==0) {
       data=0;
     } else {
@@ -129,7 +132,7 @@ void  RawImage::allocate (ColorFormat fmt, int w, int h)
 
 void  RawImage::ensure_allocation (ColorFormat fmt, int w, int h)
 {
-  if(data == 0 || format != fmt || width != w || height!=h) {
+  if(data == 0 || borrowed || format != fmt || width != w || height!=h) {
     allocate(fmt,w,h);
   }
 }
@@ -148,6 +151,32 @@ void RawImage::clear()
   allocate(getColorFormat(),0,0);
 };
 
+void RawImage::borrow(const RawImage & img)
+{
+  if (data!=0 && !borrowed) delete[] data;
+  data=img.data;
+  width=img.width;
+  height=img.height;
+  format=img.format;
+  time=img.time;
+  borrowed=true;
+}
+
+bool RawImage::isBorrowed() const
+{
+  return borrowed;
+}
+
+void RawImage::releaseBorrowed()
+{
+  if (borrowed) {
+    data=0;
+    width=0;
+    height=0;
+    borrowed=false;
+  }
+}
+
 int RawImage::computeImageSize(ColorFormat fmt, int pixelCount)
 {
   switch (fmt) {
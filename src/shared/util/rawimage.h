@@ -54,6 +54,9 @@ class RawImage : public ImageInterface
   /// capture timestamp of the image
   double   time;
 
+  /// whether data is borrowed from a capture buffer (and must not be freed)
+  bool borrowed;
+
   public:
   RawImage();
 
@@ -77,12 +80,22 @@ class RawImage : public ImageInterface
   void setWidth(int w);
   void setHeight(int h);
   void setTime(double t);
-  void setData(unsigned char * d);
+  /// takes \p d as the image data. Unless \p owned, it is treated like a borrowed
+  /// buffer, which is never freed through this image or its copies (e.g. mapped memory).
+  void setData(unsigned char * d, bool owned=true);
   void allocate (ColorFormat fmt, int w, int h);
   void ensure_allocation (ColorFormat fmt, int w, int h);
   void deepCopyFromRawImage(const RawImage & img, bool copyMetaData);
   void clear();
 
+  /// zero-copy: refer to the data and meta-data of \p img without copying it.
+  /// The data stays owned by \p img and is never freed or written through this image.
+  /// Any later allocation gives this image its own buffer again.
+  void borrow(const RawImage & img);
+  bool isBorrowed() const;
+  /// drops a borrowed buffer, leaving an empty image (no-op for owned data)
+  void releaseBorrowed();
+
   //helpers:
   static int computeImageSize(ColorFormat fmt, int pixelCount);
 
@@ -134,6 +134,31 @@ class RingBuffer {
       return res;
     }
 
+    /*!
+      \brief moves on to the next write-bin, without making the current one readable
+
+      This works like nextWrite(), except that the bin which was just written
+      is not yet handed to the readers. This is needed if bins are finished
+      out of band (e.g. by a pipelined vision stack), which then have to be
+      made readable with publishWrite() once they are complete.
+    */
+    int advanceWrite ( bool allow_lapping ) {
+      mutex.lock();
+      current_write=next ( current_write,current_read, allow_lapping );
+      int res=current_write;
+      mutex.unlock();
+      return res;
+    }
+
+    /*!
+      \brief makes the completed bin \p idx the most recent one for readers
+    */
+    void publishWrite ( int idx ) {
+      mutex.lock();
+      previous_write=idx;
+      mutex.unlock();
+    }
+
     /*!
       \brief gets the index to the next read-bin
 
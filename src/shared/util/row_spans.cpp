@@ -0,0 +1,76 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    row_spans.cpp
+  \brief   C++ Implementation: RowSpans
+*/
+//========================================================================
+#include "row_spans.h"
+#include <algorithm>
+
+void RowSpans::setWindows(const std::vector<Window> & windows, int width, int height, const RowSpans * clip) {
+  //the windows become active in the order of their first row, and the active ones are kept sorted by x0:
+  by_row.assign(windows.begin(), windows.end());
+  std::sort(by_row.begin(), by_row.end(), [](const Window & a, const Window & b) { return a.y0 < b.y0; });
+  active.clear();
+  unsigned int next = 0;
+
+  clear();
+  for (int y = 0; y < height; y++) {
+    if (!active.empty()) {
+      active.erase(std::remove_if(active.begin(), active.end(), [y](const Window & w) { return w.y1 <= y; }),
+                   active.end());
+    }
+    for (; next < by_row.size() && by_row[next].y0 <= y; next++) {
+      const Window & w = by_row[next];
+      if (w.y1 <= y || std::min(w.x1, width) <= std::max(w.x0, 0)) continue;
+      active.insert(std::upper_bound(active.begin(), active.end(), w,
+                                     [](const Window & a, const Window & b) { return a.x0 < b.x0; }), w);
+    }
+
+    //union of the windows in this row:
+    row.clear();
+    for (const Window & w : active) {
+      int begin = std::max(w.x0, 0);
+      int end = std::min(w.x1, width);
+      if (!row.empty() && row.back().max >= begin) {
+        row.back().max = std::max(row.back().max, end);
+      } else {
+        Range::PixelSpan s;
+        s.set(begin, end);
+        row.push_back(s);
+      }
+    }
+
+    if (clip == 0) {
+      for (const Range::PixelSpan & s : row) add(s.min, s.max);
+    } else {
+      //intersect two sorted lists of disjoint spans:
+      int n = clip->getNumSpans(y);
+      const Range::PixelSpan * c = clip->getSpans(y);
+      unsigned int i = 0;
+      int k = 0;
+      while (i < row.size() && k < n) {
+        add(std::max(row[i].min, c[k].min), std::min(row[i].max, c[k].max));
+        if (row[i].max < c[k].max) {
+          i++;
+        } else {
+          k++;
+        }
+      }
+    }
+    endRow();
+  }
+}
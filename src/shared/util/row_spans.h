@@ -0,0 +1,105 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    row_spans.h
+  \brief   C++ Interface: RowSpans
+*/
+//========================================================================
+#ifndef ROW_SPANS_H
+#define ROW_SPANS_H
+
+#include <vector>
+#include "range.h"
+
+/*!
+  \class   RowSpans
+  \brief   A set of image pixels, stored as a list of spans for each row
+
+  The spans of a row are sorted and neither overlap nor touch, so that
+  a run of pixels never crosses the boundary between two spans.
+  Rows are built one after the other with add() and endRow().
+*/
+class RowSpans {
+public:
+  /// an image rectangle [x0,x1) x [y0,y1)
+  struct Window {
+    int x0, y0, x1, y1;
+  };
+
+protected:
+  std::vector<int> first; //index of the first span of each row, and the end of the last row
+  std::vector<Range::PixelSpan> spans;
+  int num_pixels;
+  //scratch space of setWindows(), kept to avoid allocations per call:
+  std::vector<Window> by_row;
+  std::vector<Window> active;
+  std::vector<Range::PixelSpan> row;
+public:
+  RowSpans() : first(1, 0), num_pixels(0) {}
+
+  /// removes all rows
+  void clear() {
+    first.resize(1);
+    spans.clear();
+    num_pixels = 0;
+  }
+
+  /// adds [begin,end) to the current row. Spans must be added from left to
+  /// right, touching or overlapping spans are merged
+  void add(int begin, int end) {
+    if (end <= begin) return;
+    if ((int)spans.size() > first.back() && spans.back().max >= begin) {
+      if (end > spans.back().max) {
+        num_pixels += end - spans.back().max;
+        spans.back().max = end;
+      }
+      return;
+    }
+    Range::PixelSpan s;
+    s.set(begin, end);
+    spans.push_back(s);
+    num_pixels += end - begin;
+  }
+
+  /// finishes the current row and starts the next one
+  void endRow() {
+    first.push_back(spans.size());
+  }
+
+  /// the number of finished rows
+  int getHeight() const {
+    return (int)first.size() - 1;
+  }
+
+  /// the number of pixels in all spans
+  int getNumPixels() const {
+    return num_pixels;
+  }
+
+  int getNumSpans(int y) const {
+    return first[y + 1] - first[y];
+  }
+
+  const Range::PixelSpan * getSpans(int y) const {
+    return spans.data() + first[y];
+  }
+
+  /// replaces all rows by the pixels of a \p width x \p height image that are
+  /// inside of any of the \p windows, and also inside of \p clip (if not null).
+  /// Each row only looks at the windows that overlap it.
+  void setWindows(const std::vector<Window> & windows, int width, int height, const RowSpans * clip);
+};
+
+#endif
@@ -0,0 +1,53 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    simd_dispatch.cpp
+  \brief   C++ Implementation: SimdDispatch
+*/
+//========================================================================
+#include "simd_dispatch.h"
+#include <atomic>
+
+static std::atomic<int> & activeLevel() {
+  static std::atomic<int> level(SimdDispatch::getSupportedLevel());
+  return level;
+}
+
+SimdDispatch::SimdLevel SimdDispatch::getSupportedLevel() {
+#ifdef SIMD_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+  if (__builtin_cpu_supports("sse4.1")) return SIMD_SSE41;
+#endif
+  return SIMD_NONE;
+}
+
+SimdDispatch::SimdLevel SimdDispatch::getLevel() {
+  return (SimdLevel)activeLevel().load(std::memory_order_relaxed);
+}
+
+SimdDispatch::SimdLevel SimdDispatch::setLevel(SimdLevel level) {
+  SimdLevel supported = getSupportedLevel();
+  activeLevel().store(level < supported ? level : supported);
+  return getLevel();
+}
+
+const char * SimdDispatch::getLevelName(SimdLevel level) {
+  switch (level) {
+    case SIMD_SSE41: return "SSE4.1";
+    case SIMD_AVX2: return "AVX2";
+    default: return "scalar";
+  }
+}
@@ -0,0 +1,54 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    simd_dispatch.h
+  \brief   C++ Interface: SimdDispatch
+*/
+//========================================================================
+#ifndef SIMD_DISPATCH_H
+#define SIMD_DISPATCH_H
+
+// runtime-dispatched SIMD kernels (x86 with GCC/Clang only)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_DISPATCH
+#endif
+
+/*!
+  \class   SimdDispatch
+  \brief   Selects the instruction set of all runtime-dispatched SIMD kernels
+
+  The kernels are compiled with per-function target attributes, so they are
+  available even without -march=native, and are picked by the level returned
+  here. The thresholding and the color conversions share the one level, so
+  limiting it (e.g. to compare against the scalar versions) affects both.
+*/
+class SimdDispatch {
+public:
+  enum SimdLevel {
+    SIMD_NONE = 0,
+    SIMD_SSE41,
+    SIMD_AVX2
+  };
+
+  /// the best level that the CPU supports
+  static SimdLevel getSupportedLevel();
+  /// the level the kernels currently use, the supported one unless limited
+  static SimdLevel getLevel();
+  /// limits the kernels to \p level, returns the level that is actually in use
+  static SimdLevel setLevel(SimdLevel level);
+  static const char * getLevelName(SimdLevel level);
+};
+
+#endif
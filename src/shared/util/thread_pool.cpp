@@ -0,0 +1,191 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    thread_pool.cpp
+  \brief   C++ Implementation: ThreadPool
+*/
+//========================================================================
+#include "thread_pool.h"
+#include "affinity_manager.h"
+
+static inline void cpuRelax(int spins) {
+  //busy-wait briefly, then give the core away in case it is oversubscribed
+  if (spins < 64) {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+  } else {
+    std::this_thread::yield();
+  }
+}
+
+static int global_num_workers = -1;
+static AffinityManager * global_affinity = nullptr;
+static int global_first_core = 0;
+
+ThreadPool::ThreadPool(int num_workers, AffinityManager * _affinity, int _first_core)
+  : enqueue_pos(0), dequeue_pos(0), pending(0), stopping(false), sleeping(0),
+    affinity(_affinity), first_core(_first_core)
+{
+  for (unsigned int i = 0; i < QUEUE_SIZE; i++) {
+    queue[i].sequence.store(i, std::memory_order_relaxed);
+    queue[i].batch = nullptr;
+    queue[i].index = 0;
+  }
+  if (num_workers < 0) {
+    num_workers = (int)std::thread::hardware_concurrency() - 1;
+  }
+  for (int i = 0; i < num_workers; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> guard(sleep_mutex);
+    stopping = true;
+  }
+  wakeup.notify_all();
+  for (auto & worker : workers) {
+    worker.join();
+  }
+}
+
+int ThreadPool::getNumWorkers() const {
+  return (int)workers.size();
+}
+
+ThreadPool & ThreadPool::global() {
+  static ThreadPool pool(global_num_workers, global_affinity, global_first_core);
+  return pool;
+}
+
+void ThreadPool::configureGlobal(int num_workers, AffinityManager * _affinity, int _first_core) {
+  global_num_workers = num_workers;
+  global_affinity = _affinity;
+  global_first_core = _first_core;
+}
+
+bool ThreadPool::push(Batch * batch, int index) {
+  //bounded multi-producer/multi-consumer queue (D. Vyukov)
+  Slot * slot;
+  unsigned int pos = enqueue_pos.load(std::memory_order_relaxed);
+  while (true) {
+    slot = &queue[pos & (QUEUE_SIZE - 1)];
+    unsigned int seq = slot->sequence.load(std::memory_order_acquire);
+    int diff = (int)(seq - pos);
+    if (diff == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      return false; //full
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  slot->batch = batch;
+  slot->index = index;
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  pending++;
+  return true;
+}
+
+bool ThreadPool::pop(Batch * & batch, int & index) {
+  Slot * slot;
+  unsigned int pos = dequeue_pos.load(std::memory_order_relaxed);
+  while (true) {
+    slot = &queue[pos & (QUEUE_SIZE - 1)];
+    unsigned int seq = slot->sequence.load(std::memory_order_acquire);
+    int diff = (int)(seq - (pos + 1));
+    if (diff == 0) {
+      if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      return false; //empty
+    } else {
+      pos = dequeue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  batch = slot->batch;
+  index = slot->index;
+  slot->sequence.store(pos + QUEUE_SIZE, std::memory_order_release);
+  pending--;
+  return true;
+}
+
+bool ThreadPool::runOne() {
+  Batch * batch;
+  int index;
+  if (!pop(batch, index)) return false;
+  (*batch->task)(index);
+  //this is the last access to the batch, its owner may return right after:
+  batch->remaining.fetch_sub(1, std::memory_order_acq_rel);
+  return true;
+}
+
+void ThreadPool::parallelFor(int num_tasks, const std::function<void(int)> & task) {
+  if (num_tasks <= 0) return;
+  if (num_tasks == 1 || workers.empty()) {
+    for (int i = 0; i < num_tasks; i++) task(i);
+    return;
+  }
+
+  Batch batch;
+  batch.task = &task;
+  batch.remaining.store(num_tasks, std::memory_order_relaxed);
+
+  //queue all but the first task, which the calling thread takes itself:
+  for (int i = 1; i < num_tasks; i++) {
+    if (!push(&batch, i)) {
+      //queue is full, so just do it here
+      task(i);
+      batch.remaining.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  if (sleeping.load() > 0) {
+    std::lock_guard<std::mutex> guard(sleep_mutex);
+    wakeup.notify_all();
+  }
+
+  task(0);
+  batch.remaining.fetch_sub(1, std::memory_order_acq_rel);
+
+  //help out with whatever is queued until our batch is complete:
+  int spins = 0;
+  while (batch.remaining.load(std::memory_order_acquire) > 0) {
+    if (!runOne()) cpuRelax(spins++);
+  }
+}
+
+void ThreadPool::workerLoop(int id) {
+  if (affinity != nullptr) affinity->demandCore(first_core + id);
+
+  while (true) {
+    int spins = 0;
+    while (spins < SPIN_COUNT) {
+      if (runOne()) {
+        spins = 0;
+      } else {
+        if (stopping.load(std::memory_order_relaxed)) return;
+        cpuRelax(spins++);
+      }
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    sleeping++;
+    wakeup.wait(lock, [this] { return pending.load() > 0 || stopping.load(); });
+    sleeping--;
+    if (stopping && pending.load() == 0) return;
+  }
+}
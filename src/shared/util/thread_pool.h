@@ -0,0 +1,98 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    thread_pool.h
+  \brief   C++ Interface: ThreadPool
+*/
+//========================================================================
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class AffinityManager;
+
+/*!
+  \class   ThreadPool
+  \brief   A persistent pool of worker threads for data-parallel plugin work
+
+  Tasks are handed to the workers through a bounded lock-free queue.
+  parallelFor() blocks until all of its tasks are done, while the calling
+  thread helps processing them, so it acts as a barrier for the caller.
+  Idle workers spin for a short while before going to sleep, which keeps the
+  dispatch latency low at camera frame rates.
+
+  Several capture threads may use the same pool concurrently.
+*/
+class ThreadPool {
+public:
+  /// creates a pool with the given number of workers (negative: one less than
+  /// the number of hardware threads). If an affinity manager is given, worker i
+  /// is pinned to core first_core+i.
+  explicit ThreadPool(int num_workers, AffinityManager * affinity = nullptr, int first_core = 0);
+  ~ThreadPool();
+
+  int getNumWorkers() const;
+
+  /// calls task(i) for all i in [0,num_tasks) and returns when all calls are done
+  void parallelFor(int num_tasks, const std::function<void(int)> & task);
+
+  /// the pool shared by all vision stacks
+  static ThreadPool & global();
+
+  /// sets up the shared pool, must be called before the first call of global()
+  static void configureGlobal(int num_workers, AffinityManager * affinity, int first_core);
+
+protected:
+  struct Batch {
+    const std::function<void(int)> * task;
+    std::atomic<int> remaining;
+  };
+
+  struct Slot {
+    std::atomic<unsigned int> sequence;
+    Batch * batch;
+    int index;
+  };
+
+  static const unsigned int QUEUE_SIZE = 1024;
+  static const int SPIN_COUNT = 2000;
+
+  Slot queue[QUEUE_SIZE];
+  std::atomic<unsigned int> enqueue_pos;
+  std::atomic<unsigned int> dequeue_pos;
+  std::atomic<int> pending;
+
+  std::atomic<bool> stopping;
+  std::atomic<int> sleeping;
+  std::mutex sleep_mutex;
+  std::condition_variable wakeup;
+
+  std::vector<std::thread> workers;
+  AffinityManager * affinity;
+  int first_core;
+
+  bool push(Batch * batch, int index);
+  bool pop(Batch * & batch, int & index);
+  bool runOne();
+  void workerLoop(int id);
+};
+
+#endif
@@ -0,0 +1,69 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    VarSnapshot.cpp
+  \brief   C++ Implementation: VarSnapshotBase
+*/
+//========================================================================
+#include "VarSnapshot.h"
+#include <QQueue>
+
+namespace VarTypes {
+
+  VarSnapshotBase::VarSnapshotBase() : version(0)
+  {
+  }
+
+  VarSnapshotBase::~VarSnapshotBase()
+  {
+  }
+
+  void VarSnapshotBase::rebuild() {
+    //concurrent changes are serialized here, the last build reads the latest values:
+    std::lock_guard<std::mutex> lock(build_mutex);
+    build();
+    version++;
+  }
+
+  void VarSnapshotBase::changeSlot(VarType * item) {
+    (void)item;
+    rebuild();
+  }
+
+  unsigned int VarSnapshotBase::getVersion() const {
+    return version.load();
+  }
+
+  void VarSnapshotBase::addItem(VarType * item) {
+    if (item==0) return;
+    //direct connection: the snapshot is up to date as soon as the change returns
+    connect(item, SIGNAL(hasChanged(VarType *)), this, SLOT(changeSlot(VarType *)),
+            (Qt::ConnectionType)(Qt::DirectConnection | Qt::UniqueConnection));
+  }
+
+  void VarSnapshotBase::addRecursive(VarType * item, bool include_root) {
+    QQueue<VarType *> queue;
+    if (item!=0) queue.enqueue(item);
+    while(queue.isEmpty()==false) {
+      VarType * d = queue.dequeue();
+      if ((d!=item) || include_root) addItem(d);
+      vector<VarType *> children = d->getChildren();
+      int s=children.size();
+      for (int i=0;i<s;i++) {
+        if (children[i]!=0) queue.enqueue(children[i]);
+      }
+    }
+  }
+};
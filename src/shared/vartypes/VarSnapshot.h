@@ -0,0 +1,101 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    VarSnapshot.h
+  \brief   C++ Interface: VarSnapshotBase, VarSnapshot
+*/
+//========================================================================
+#ifndef VARSNAPSHOT_H
+#define VARSNAPSHOT_H
+#include "primitives/VarType.h"
+#include <QObject>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace VarTypes {
+  /**
+    @brief  The untyped part of VarSnapshot, which watches the VarTypes
+  */
+  class VarSnapshotBase : public QObject {
+  Q_OBJECT
+  protected:
+    std::mutex build_mutex;
+    std::atomic<unsigned int> version;
+    virtual void build() = 0;
+    void rebuild();
+  protected slots:
+    void changeSlot(VarType * item);
+  public:
+    VarSnapshotBase();
+    virtual ~VarSnapshotBase();
+
+    void addItem(VarType * item);
+    void addRecursive(VarType * item, bool include_root=true);
+
+    /// increases with every rebuilt snapshot, without locking
+    unsigned int getVersion() const;
+  };
+
+  /**
+    @brief  An immutable copy of some VarTypes values in a plain struct T
+
+    The copy is made by the read function whenever one of the watched items
+    changes. This happens directly in the thread that changed the item
+    (usually the GUI thread), so the processing threads never wait for the
+    VarTypes or for a rebuild.
+
+    get() is not lock-free, though: std::atomic_load() of a shared_ptr takes
+    one of a small set of internal spinlocks/mutexes of the standard library
+    (libstdc++ hashes the address into a pool of them) for the duration of
+    a reference count increment. It is only contended by a concurrent get()
+    or rebuild of the same snapshot, which is why hot paths should call get()
+    once per frame and keep the returned pointer until the frame is done,
+    rather than once per value. That also keeps all values consistent with
+    each other.
+  */
+  template <class T>
+  class VarSnapshot : public VarSnapshotBase {
+  public:
+    typedef std::function<void (T &)> ReadFunction;
+
+    explicit VarSnapshot(const ReadFunction & read) : read(read) {}
+
+    virtual ~VarSnapshot() {}
+
+    /// the current snapshot, made on the first call if there is none yet.
+    /// Takes a short internal lock, see the class description.
+    std::shared_ptr<const T> get() {
+      std::shared_ptr<const T> result = std::atomic_load(&snapshot);
+      if (result == nullptr) {
+        rebuild();
+        result = std::atomic_load(&snapshot);
+      }
+      return result;
+    }
+
+  protected:
+    ReadFunction read;
+    std::shared_ptr<const T> snapshot;
+
+    virtual void build() {
+      std::shared_ptr<T> next(new T());
+      read(*next);
+      std::atomic_store(&snapshot, std::shared_ptr<const T>(next));
+    }
+  };
+};
+#endif